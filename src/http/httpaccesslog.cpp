@@ -0,0 +1,229 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpaccesslog.h"
+
+// Qt includes
+#include <QLocale>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    namespace {
+
+        const char* methodName(Method method)
+        {
+            switch (method) {
+            case OPTIONS:
+                return "OPTIONS";
+            case GET:
+                return "GET";
+            case HEAD:
+                return "HEAD";
+            case POST:
+                return "POST";
+            case PUT:
+                return "PUT";
+            case DELETE:
+                return "DELETE";
+            case TRACE:
+                return "TRACE";
+            case CONNECT:
+                return "CONNECT";
+            default:
+                return "-";
+            }
+        }
+
+        /** Appends a string as a quoted JSON string. */
+        void appendJsonString(QByteArray& line, const QString& string)
+        {
+            static const char hexDigits[] = "0123456789abcdef";
+            line += '"';
+            for (unsigned char c : string.toUtf8()) {
+                if (c == '"' || c == '\\') {
+                    line += '\\';
+                    line += char(c);
+                } else if (c < 0x20) {
+                    line += "\\u00";
+                    line += hexDigits[c >> 4];
+                    line += hexDigits[c & 0xf];
+                } else {
+                    line += char(c);
+                }
+            }
+            line += '"';
+        }
+
+        /**
+         * Appends a string for a quoted field of the combined log format.
+         * Like nginx and Apache, backslashes, quotes and control bytes are
+         * escaped, so clients cannot forge fields or lines.
+         */
+        void appendQuotedField(QByteArray& line, const QString& string)
+        {
+            static const char hexDigits[] = "0123456789ABCDEF";
+            line += '"';
+            if (string.isEmpty()) {
+                line += '-';
+            } else {
+                for (unsigned char c : string.toUtf8()) {
+                    if (c == '"' || c == '\\') {
+                        line += '\\';
+                        line += char(c);
+                    } else if (c < 0x20 || c == 0x7f) {
+                        line += "\\x";
+                        line += hexDigits[c >> 4];
+                        line += hexDigits[c & 0xf];
+                    } else {
+                        line += char(c);
+                    }
+                }
+            }
+            line += '"';
+        }
+
+        qint64 microseconds(qint64 nanoseconds)
+        {
+            return nanoseconds / 1000;
+        }
+
+    } // namespace
+
+    AccessLogEntry::AccessLogEntry()
+        : method(UNKNOW)
+        , statusCode(0)
+        , responseBytes(0)
+        , parseDuration(0)
+        , routeDuration(0)
+        , deliverDuration(0)
+        , writeDuration(0)
+    {
+    }
+
+    AccessLog::AccessLog(QString fileName, Format format)
+        : m_format(format)
+        , m_sink(fileName)
+    {
+    }
+
+    AccessLog::~AccessLog()
+    {
+        close();
+    }
+
+    bool AccessLog::open()
+    {
+        return m_sink.open();
+    }
+
+    void AccessLog::close()
+    {
+        m_sink.close();
+    }
+
+    AccessLog::Format AccessLog::format() const
+    {
+        return m_format;
+    }
+
+    AsyncLogSink& AccessLog::sink()
+    {
+        return m_sink;
+    }
+
+    void AccessLog::log(const AccessLogEntry& entry)
+    {
+        m_sink.write(formatEntry(entry, m_format));
+    }
+
+    QByteArray AccessLog::formatEntry(const AccessLogEntry& entry, Format format)
+    {
+        QByteArray line;
+        line.reserve(256);
+        QDateTime time = entry.time.toUTC();
+
+        if (format == JsonLinesFormat) {
+            line += "{\"time\":";
+            appendJsonString(line, time.toString(Qt::ISODateWithMs));
+            line += ",\"remoteAddress\":";
+            appendJsonString(line, entry.remoteAddress);
+            line += ",\"method\":\"";
+            line += methodName(entry.method);
+            line += "\",\"uri\":";
+            appendJsonString(line, entry.uniqueResourceIdentifier);
+            line += ",\"version\":";
+            appendJsonString(line, entry.version);
+            line += ",\"status\":";
+            line += QByteArray::number(entry.statusCode);
+            line += ",\"bytes\":";
+            line += QByteArray::number(entry.responseBytes);
+            line += ",\"referer\":";
+            appendJsonString(line, entry.referer);
+            line += ",\"userAgent\":";
+            appendJsonString(line, entry.userAgent);
+            line += ",\"parseUs\":";
+            line += QByteArray::number(microseconds(entry.parseDuration));
+            line += ",\"routeUs\":";
+            line += QByteArray::number(microseconds(entry.routeDuration));
+            line += ",\"deliverUs\":";
+            line += QByteArray::number(microseconds(entry.deliverDuration));
+            line += ",\"writeUs\":";
+            line += QByteArray::number(microseconds(entry.writeDuration));
+            line += "}\n";
+            return line;
+        }
+
+        // host ident authuser [date] "request" status bytes "referer" "user-agent"
+        line += entry.remoteAddress.isEmpty() ? QByteArray("-") : entry.remoteAddress.toUtf8();
+        line += " - - [";
+        line += QLocale::c().toString(time, "dd/MMM/yyyy:hh:mm:ss").toLatin1();
+        line += " +0000] ";
+        // The request target and version are taken from the request as sent.
+        appendQuotedField(line,
+            QString("%1 %2 %3").arg(QString::fromLatin1(methodName(entry.method)), entry.uniqueResourceIdentifier, entry.version));
+        line += ' ';
+        line += QByteArray::number(entry.statusCode);
+        line += ' ';
+        line += QByteArray::number(entry.responseBytes);
+        line += ' ';
+        appendQuotedField(line, entry.referer);
+        line += ' ';
+        appendQuotedField(line, entry.userAgent);
+        line += " parse=";
+        line += QByteArray::number(microseconds(entry.parseDuration));
+        line += "us route=";
+        line += QByteArray::number(microseconds(entry.routeDuration));
+        line += "us deliver=";
+        line += QByteArray::number(microseconds(entry.deliverDuration));
+        line += "us write=";
+        line += QByteArray::number(microseconds(entry.writeDuration));
+        line += "us\n";
+        return line;
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,114 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "httprequest.h"
+#include "misc/asynclogsink.h"
+
+// Qt includes
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * @struct AccessLogEntry
+     * Describes a served request. Durations are in nanoseconds.
+     */
+    struct AccessLogEntry {
+        AccessLogEntry();
+
+        QDateTime time;
+        QString remoteAddress;
+        Http::Method method;
+        QString uniqueResourceIdentifier;
+        QString version;
+        QString referer;
+        QString userAgent;
+        int statusCode;
+        qint64 responseBytes;
+
+        /** Time spent parsing the request. */
+        qint64 parseDuration;
+        /** Time spent matching a resource. */
+        qint64 routeDuration;
+        /** Time spent in Resource::deliver(). */
+        qint64 deliverDuration;
+        /** Time from writing the first byte to handing over the last one to the socket. */
+        qint64 writeDuration;
+    };
+
+    /**
+     * @class AccessLog
+     * Writes a line per served request to a file. Lines are formatted in the
+     * server thread and written by a background thread, so logging does not
+     * block on the file.
+     */
+    class AccessLog {
+    public:
+        enum Format {
+            /** Combined log format, followed by the phase durations. */
+            CombinedFormat,
+            /** A JSON object per line. */
+            JsonLinesFormat
+        };
+
+        AccessLog(QString fileName, Format format = CombinedFormat);
+        ~AccessLog();
+
+        /**
+         * Opens the file for appending.
+         * @returns false, if the file could not be opened.
+         */
+        bool open();
+
+        /** Writes all pending lines and closes the file. */
+        void close();
+
+        /** @returns the format of the lines. */
+        Format format() const;
+
+        /** @returns the sink lines are written to, eg. to set its overflow policy. */
+        AsyncLogSink& sink();
+
+        /** Formats an entry and queues it for writing. May be called from any thread. */
+        void log(const AccessLogEntry& entry);
+
+        /** @returns the entry formatted as a line, including its line break. */
+        static QByteArray formatEntry(const AccessLogEntry& entry, Format format);
+
+    private:
+        AccessLog(const AccessLog&);
+
+        Format m_format;
+        AsyncLogSink m_sink;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,332 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpbyteranges.h"
+
+// Qt includes
+#include <QDateTime>
+#include <QFileInfo>
+#include <QLocale>
+#include <QRandomGenerator>
+
+// Standard includes
+#include <algorithm>
+#include <cstring>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    namespace {
+
+        /** @returns the value of a non-empty string of digits, or -1. */
+        qint64 parsePosition(const QByteArray& digits)
+        {
+            // More digits would overflow, and no file is that large anyway.
+            if (digits.isEmpty() || digits.size() > 18) {
+                return -1;
+            }
+
+            qint64 value = 0;
+            for (char c : digits) {
+                if (c < '0' || c > '9') {
+                    return -1;
+                }
+                value = value * 10 + (c - '0');
+            }
+            return value;
+        }
+
+        /**
+         * Device serving several ranges of a file as a multipart/byteranges
+         * body. Each part is a header followed by the range of the file,
+         * which is read when the part is sent.
+         */
+        class MultipartRangesDevice : public QIODevice {
+        public:
+            MultipartRangesDevice(QFile* file,
+                const QList<ByteRange>& ranges,
+                const QByteArray& contentType,
+                const QByteArray& boundary)
+                : m_file(file)
+                , m_size(0)
+            {
+                m_file->setParent(this);
+
+                QByteArray fileSize = QByteArray::number(m_file->size());
+                for (const ByteRange& range : ranges) {
+                    QByteArray partHeader;
+                    partHeader += "\r\n--";
+                    partHeader += boundary;
+                    partHeader += "\r\nContent-Type: ";
+                    partHeader += contentType;
+                    partHeader += "\r\nContent-Range: bytes ";
+                    partHeader += QByteArray::number(range.first);
+                    partHeader += '-';
+                    partHeader += QByteArray::number(range.last);
+                    partHeader += '/';
+                    partHeader += fileSize;
+                    partHeader += "\r\n\r\n";
+                    appendSegment(partHeader, -1, partHeader.size());
+                    appendSegment(QByteArray(), range.first, range.last - range.first + 1);
+                }
+
+                QByteArray closeDelimiter = "\r\n--" + boundary + "--\r\n";
+                appendSegment(closeDelimiter, -1, closeDelimiter.size());
+
+                // Positions are tracked by QIODevice, there is nothing to buffer.
+                open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+            }
+
+            bool isSequential() const
+            {
+                return false;
+            }
+
+            qint64 size() const
+            {
+                return m_size;
+            }
+
+        protected:
+            qint64 readData(char* data, qint64 maxSize)
+            {
+                qint64 position = pos();
+                qint64 bytesRead = 0;
+                for (const Segment& segment : m_segments) {
+                    if (bytesRead == maxSize) {
+                        break;
+                    }
+
+                    qint64 segmentEnd = segment.position + segment.length;
+                    if (position >= segmentEnd) {
+                        continue;
+                    }
+
+                    qint64 offset = position - segment.position;
+                    qint64 count = qMin(maxSize - bytesRead, segment.length - offset);
+                    if (segment.fileOffset < 0) {
+                        memcpy(data + bytesRead, segment.data.constData() + offset, count);
+                    } else {
+                        if (!m_file->seek(segment.fileOffset + offset)) {
+                            return bytesRead > 0 ? bytesRead : -1;
+                        }
+                        qint64 fileBytesRead = m_file->read(data + bytesRead, count);
+                        if (fileBytesRead <= 0) {
+                            return bytesRead > 0 ? bytesRead : -1;
+                        }
+                        count = fileBytesRead;
+                    }
+                    bytesRead += count;
+                    position += count;
+                    if (position < segmentEnd) {
+                        // The file returned less than asked for.
+                        break;
+                    }
+                }
+                return bytesRead;
+            }
+
+            qint64 writeData(const char*, qint64)
+            {
+                return -1;
+            }
+
+        private:
+            struct Segment {
+                qint64 position;
+                qint64 length;
+                qint64 fileOffset;
+                QByteArray data;
+            };
+
+            void appendSegment(const QByteArray& data, qint64 fileOffset, qint64 length)
+            {
+                Segment segment;
+                segment.position = m_size;
+                segment.length = length;
+                segment.fileOffset = fileOffset;
+                segment.data = data;
+                m_segments.append(segment);
+                m_size += length;
+            }
+
+            QFile* m_file;
+            QList<Segment> m_segments;
+            qint64 m_size;
+        };
+
+    } // namespace
+
+    ByteRanges::ParseResult ByteRanges::parse(QByteArrayView value, qint64 size, QList<ByteRange>& ranges)
+    {
+        ranges.clear();
+
+        QByteArray rangesSpecifier = value.toByteArray().trimmed();
+        int equalsSign = rangesSpecifier.indexOf('=');
+        if (equalsSign < 0 || rangesSpecifier.left(equalsSign).trimmed().toLower() != "bytes") {
+            return Invalid;
+        }
+
+        QList<QByteArray> rangeSpecs = rangesSpecifier.mid(equalsSign + 1).split(',');
+        if (rangeSpecs.size() > MaxRanges) {
+            return Invalid;
+        }
+
+        bool hasRangeSpec = false;
+        for (const QByteArray& untrimmedRangeSpec : rangeSpecs) {
+            QByteArray rangeSpec = untrimmedRangeSpec.trimmed();
+            if (rangeSpec.isEmpty()) {
+                continue;
+            }
+            hasRangeSpec = true;
+
+            int dash = rangeSpec.indexOf('-');
+            if (dash < 0) {
+                return Invalid;
+            }
+
+            ByteRange range;
+            if (dash == 0) {
+                // A suffix range selects the last bytes of the resource.
+                qint64 suffixLength = parsePosition(rangeSpec.mid(1));
+                if (suffixLength < 0) {
+                    return Invalid;
+                }
+                if (suffixLength == 0 || size == 0) {
+                    continue;
+                }
+                range.first = qMax(qint64(0), size - suffixLength);
+                range.last = size - 1;
+            } else {
+                range.first = parsePosition(rangeSpec.left(dash));
+                if (range.first < 0) {
+                    return Invalid;
+                }
+
+                if (dash == rangeSpec.size() - 1) {
+                    range.last = size - 1;
+                } else {
+                    range.last = parsePosition(rangeSpec.mid(dash + 1));
+                    if (range.last < range.first) {
+                        return Invalid;
+                    }
+                    range.last = qMin(range.last, size - 1);
+                }
+
+                if (range.first >= size) {
+                    continue;
+                }
+            }
+            ranges.append(range);
+        }
+
+        if (!hasRangeSpec) {
+            return Invalid;
+        }
+
+        if (ranges.isEmpty()) {
+            return NotSatisfiable;
+        }
+
+        // Coalesce overlapping and adjacent ranges, so no part of the file is
+        // sent twice.
+        std::sort(ranges.begin(), ranges.end(), [](const ByteRange& a, const ByteRange& b) {
+            return a.first < b.first;
+        });
+
+        QList<ByteRange> coalescedRanges;
+        coalescedRanges.append(ranges.first());
+        for (int i = 1; i < ranges.size(); i++) {
+            ByteRange& lastRange = coalescedRanges.last();
+            if (ranges.at(i).first <= lastRange.last + 1) {
+                lastRange.last = qMax(lastRange.last, ranges.at(i).last);
+            } else {
+                coalescedRanges.append(ranges.at(i));
+            }
+        }
+        ranges = coalescedRanges;
+        return Satisfiable;
+    }
+
+    void ByteRanges::deliverFile(const Request& request, Response& response, QFile* file, const QString& contentType)
+    {
+        qint64 size = file->size();
+
+        // Validators let clients resume a download only if the file has not
+        // changed in between.
+        QDateTime lastModified = QFileInfo(*file).lastModified().toUTC();
+        QByteArray lastModifiedDate = QLocale::c().toString(lastModified, "ddd, dd MMM yyyy hh:mm:ss 'GMT'").toLatin1();
+        QByteArray entityTag = '"' + QByteArray::number(lastModified.toMSecsSinceEpoch(), 16)
+            + '-' + QByteArray::number(size, 16) + '"';
+
+        response.setHeader(Http::ContentType, contentType);
+        response.setHeader(Http::AcceptRanges, "bytes");
+        response.setHeader(Http::LastModified, QString::fromLatin1(lastModifiedDate));
+        response.setHeader(Http::ETag, QString::fromLatin1(entityTag));
+
+        QByteArrayView rangeHeader = request.rawHeader(Http::Range);
+        QList<ByteRange> ranges;
+        ParseResult parseResult = Invalid;
+        if (request.method() == Method::GET && !rangeHeader.isEmpty()) {
+            // A range is only served if the client's copy is still current.
+            // Weak entity tags never match.
+            QByteArray ifRange = request.rawHeader(Http::IfRange).toByteArray().trimmed();
+            if (ifRange.isEmpty() || ifRange == entityTag || ifRange == lastModifiedDate) {
+                parseResult = parse(rangeHeader, size, ranges);
+            }
+        }
+
+        if (parseResult == NotSatisfiable) {
+            delete file;
+            response.setStatusCode(Http::RequestedRangeNotSatisfiable);
+            response.setHeader(Http::ContentRange, QString("bytes */%1").arg(size));
+            response.setBody("");
+            return;
+        }
+
+        if (parseResult == Invalid) {
+            response.setStatusCode(Http::Ok);
+            response.setBodyDevice(file, size);
+            return;
+        }
+
+        response.setStatusCode(Http::PartialContent);
+        if (ranges.size() == 1) {
+            const ByteRange& range = ranges.first();
+            file->seek(range.first);
+            response.setHeader(Http::ContentRange, QString("bytes %1-%2/%3").arg(range.first).arg(range.last).arg(size));
+            response.setBodyDevice(file, range.last - range.first + 1);
+            return;
+        }
+
+        QByteArray boundary = "QtWebServer" + QByteArray::number(QRandomGenerator::global()->generate64(), 16);
+        MultipartRangesDevice* multipartDevice = new MultipartRangesDevice(file, ranges, contentType.toUtf8(), boundary);
+        response.setHeader(Http::ContentType, "multipart/byteranges; boundary=" + QString::fromLatin1(boundary));
+        response.setBodyDevice(multipartDevice, multipartDevice->size());
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
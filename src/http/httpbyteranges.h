@@ -0,0 +1,92 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "httprequest.h"
+#include "httpresponse.h"
+
+// Qt includes
+#include <QByteArrayView>
+#include <QFile>
+#include <QList>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /** An inclusive range of byte positions. */
+    struct ByteRange {
+        qint64 first;
+        qint64 last;
+    };
+
+    /**
+     * @class ByteRanges
+     * Support for range requests on file-backed resources. Ranges are served
+     * by seeking on the file, so only the requested parts are read.
+     */
+    class ByteRanges {
+    public:
+        enum ParseResult {
+            /** The header is malformed or unsupported and has to be ignored. */
+            Invalid,
+            /** At least one range can be served. */
+            Satisfiable,
+            /** None of the ranges overlaps the resource. */
+            NotSatisfiable
+        };
+
+        /**
+         * Parses the value of a Range header. Overlapping and adjacent ranges
+         * are coalesced, so the resulting ranges are sorted and disjoint.
+         * @param value The value of the Range header.
+         * @param size The size of the resource.
+         * @param ranges Receives the satisfiable ranges.
+         * @returns whether the ranges can be served.
+         */
+        static ParseResult parse(QByteArrayView value, qint64 size, QList<ByteRange>& ranges);
+
+        /**
+         * Responds with a file, honouring the Range and If-Range headers of
+         * the request. Serves either the whole file, a single range, several
+         * ranges as multipart/byteranges or a 416 if no range can be served.
+         * @param request The request to respond to.
+         * @param response The response to be filled.
+         * @param file An open file. The response takes it over.
+         * @param contentType The content type of the file.
+         */
+        static void deliverFile(const Request& request, Response& response, QFile* file, const QString& contentType);
+
+    private:
+        ByteRanges() { }
+        ~ByteRanges() { }
+
+        /** Maximum number of ranges served for a single request. */
+        static const int MaxRanges = 32;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,185 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpchunkeddecoder.h"
+
+namespace QtWebServer {
+
+namespace Http {
+
+    namespace {
+        // Trailers are buffered, so we need a limit for them.
+        const int maximumTrailerSize = 8 * 1024;
+
+        int hexDigitValue(char c)
+        {
+            if (c >= '0' && c <= '9') {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f') {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'F') {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+    }
+
+    ChunkedDecoder::ChunkedDecoder()
+    {
+        reset();
+    }
+
+    ChunkedDecoder::Result ChunkedDecoder::decode(const char* data, int size, int& consumed, QByteArray& body)
+    {
+        int position = 0;
+        while (position < size) {
+            char c = data[position];
+            switch (m_state) {
+            case StateChunkSize: {
+                int digit = hexDigitValue(c);
+                if (digit >= 0) {
+                    // Anything above 15 digits would overflow.
+                    if (++m_chunkSizeDigits > 15) {
+                        m_state = StateError;
+                        break;
+                    }
+                    m_chunkSize = m_chunkSize * 16 + digit;
+                    position++;
+                    break;
+                }
+                if (m_chunkSizeDigits == 0) {
+                    m_state = StateError;
+                    break;
+                }
+                m_state = StateChunkExtension;
+                break;
+            }
+
+            case StateChunkExtension:
+                // Chunk extensions are ignored, we only look for the end of
+                // the chunk size line.
+                position++;
+                if (c == '\n') {
+                    m_state = m_chunkSize > 0 ? StateChunkData : StateTrailer;
+                }
+                break;
+
+            case StateChunkData: {
+                // Take as much of the chunk as has arrived in one go.
+                qint64 available = qMin<qint64>(m_chunkSize, size - position);
+                body.append(data + position, available);
+                position += available;
+                m_chunkSize -= available;
+                if (m_chunkSize == 0) {
+                    m_state = StateChunkDataEnd;
+                }
+                break;
+            }
+
+            case StateChunkDataEnd:
+                // Every chunk is followed by a line ending.
+                position++;
+                if (c == '\n') {
+                    m_chunkSizeDigits = 0;
+                    m_state = StateChunkSize;
+                } else if (c != '\r') {
+                    m_state = StateError;
+                }
+                break;
+
+            case StateTrailer:
+                position++;
+                if (c != '\n') {
+                    if (++m_trailerSize > maximumTrailerSize) {
+                        m_state = StateError;
+                        break;
+                    }
+                    m_trailerLine.append(c);
+                    break;
+                }
+
+                if (m_trailerLine.endsWith('\r')) {
+                    m_trailerLine.chop(1);
+                }
+
+                // An empty line ends the trailer and thereby the body.
+                if (m_trailerLine.isEmpty()) {
+                    m_state = StateComplete;
+                    consumed = position;
+                    return Complete;
+                }
+                parseTrailerLine();
+                break;
+
+            case StateComplete:
+                consumed = position;
+                return Complete;
+
+            case StateError:
+                consumed = position;
+                return Error;
+            }
+        }
+
+        consumed = position;
+        switch (m_state) {
+        case StateComplete:
+            return Complete;
+        case StateError:
+            return Error;
+        default:
+            return NeedMoreData;
+        }
+    }
+
+    QList<QPair<QByteArray, QByteArray>> ChunkedDecoder::trailers() const
+    {
+        return m_trailers;
+    }
+
+    void ChunkedDecoder::reset()
+    {
+        m_state = StateChunkSize;
+        m_chunkSize = 0;
+        m_chunkSizeDigits = 0;
+        m_trailerLine.clear();
+        m_trailerSize = 0;
+        m_trailers.clear();
+    }
+
+    void ChunkedDecoder::parseTrailerLine()
+    {
+        int colon = m_trailerLine.indexOf(':');
+        if (colon > 0) {
+            m_trailers.append(qMakePair(m_trailerLine.left(colon).trimmed(),
+                m_trailerLine.mid(colon + 1).trimmed()));
+        }
+        m_trailerLine.clear();
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
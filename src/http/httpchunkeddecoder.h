@@ -0,0 +1,95 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * @class ChunkedDecoder
+     * Streaming decoder for bodies sent with "Transfer-Encoding: chunked".
+     * Data is decoded as it arrives. The decoder keeps its state between
+     * calls, so every byte is looked at exactly once and nothing but the
+     * trailer is buffered.
+     */
+    class ChunkedDecoder {
+    public:
+        /**
+         * @brief The Result enum
+         */
+        enum Result {
+            NeedMoreData, /** The body is not complete yet. */
+            Complete, /** The last chunk and the trailer have been decoded. */
+            Error /** The data is not validly chunked. */
+        };
+
+        ChunkedDecoder();
+
+        /**
+         * Decodes as much of the given data as possible.
+         * @param data The encoded data.
+         * @param size The size of the encoded data.
+         * @param consumed Receives the number of bytes that have been
+         * consumed. Bytes after the end of the body are not consumed.
+         * @param body The decoded data is appended to this.
+         * @returns the decoder state.
+         */
+        Result decode(const char* data, int size, int& consumed, QByteArray& body);
+
+        /** @returns the trailer fields that have been received after the last chunk. */
+        QList<QPair<QByteArray, QByteArray>> trailers() const;
+
+        /** Resets the decoder for the next body. */
+        void reset();
+
+    private:
+        enum State {
+            StateChunkSize,
+            StateChunkExtension,
+            StateChunkData,
+            StateChunkDataEnd,
+            StateTrailer,
+            StateComplete,
+            StateError
+        };
+
+        void parseTrailerLine();
+
+        State m_state;
+        qint64 m_chunkSize;
+        int m_chunkSizeDigits;
+        QByteArray m_trailerLine;
+        int m_trailerSize;
+        QList<QPair<QByteArray, QByteArray>> m_trailers;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,611 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpconnectionstate.h"
+#include "httpresponsestream.h"
+#include "misc/metrics.h"
+
+// Qt includes
+#include <QFileDevice>
+
+// System includes
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <sys/sendfile.h>
+#endif
+
+namespace QtWebServer {
+
+namespace Http {
+
+    namespace {
+
+        /** Metrics shared by all connections, registered on first use. */
+        struct ConnectionMetrics {
+            int receivedBytes;
+            int sentBytes;
+            int queuedResponses;
+            int finishedResponses;
+
+            ConnectionMetrics()
+            {
+                Metrics& metrics = Metrics::instance();
+                receivedBytes = metrics.counter("qtwebserver_http_received_bytes_total",
+                    "Bytes received from HTTP clients.");
+                sentBytes = metrics.counter("qtwebserver_http_sent_bytes_total",
+                    "Bytes of HTTP responses handed to the sockets.");
+                queuedResponses = metrics.counter("qtwebserver_http_queued_responses_total",
+                    "Responses reserved in a connection's response queue.");
+                finishedResponses = metrics.counter("qtwebserver_http_finished_responses_total",
+                    "Responses that have been written or dropped with their connection.");
+
+                // Both counters are merged over all threads, so their
+                // difference is exact at the time of the scrape.
+                int queued = queuedResponses;
+                int finished = finishedResponses;
+                metrics.addGauge("qtwebserver_http_pending_requests",
+                    "Requests received but not completely answered yet.",
+                    [queued, finished]() {
+                        Metrics& metrics = Metrics::instance();
+                        Metrics::GaugeSample sample;
+                        sample.value = double(metrics.counterValue(queued)) - double(metrics.counterValue(finished));
+                        return QList<Metrics::GaugeSample>() << sample;
+                    });
+            }
+        };
+
+        const ConnectionMetrics& connectionMetrics()
+        {
+            static const ConnectionMetrics instance;
+            return instance;
+        }
+
+    } // namespace
+
+    ConnectionState::ConnectionState(QSslSocket* sslSocket)
+        : Tcp::ConnectionData(sslSocket)
+        , m_sslSocket(sslSocket)
+        , m_guard(std::make_shared<ConnectionGuard>())
+        , m_parseDuration(0)
+        , m_takenRequestParseDuration(0)
+        , m_nextResponseId(0)
+        , m_servedRequests(0)
+        , m_idleTimeoutSeconds(0)
+        , m_writingResponses(false)
+        , m_sendFileNotifier(0)
+        , m_protocolHandler(0)
+    {
+        m_guard->connection = this;
+
+        m_idleTimer.setSingleShot(true);
+        connect(&m_idleTimer, &QTimer::timeout, this, &ConnectionState::idleTimeout);
+
+        // Streamed bodies are written as fast as the client receives them.
+        connect(m_sslSocket, &QIODevice::bytesWritten, this, &ConnectionState::continueWriting);
+    }
+
+    ConnectionState::~ConnectionState()
+    {
+        // Responses completed from now on are dropped.
+        m_guard->mutex.lock();
+        m_guard->connection = 0;
+        m_guard->mutex.unlock();
+
+        // The handler writes to this connection while it is closing.
+        delete m_protocolHandler;
+
+        if (!m_responseQueue.isEmpty()) {
+            Metrics::instance().increment(connectionMetrics().finishedResponses, m_responseQueue.size());
+        }
+    }
+
+    QSslSocket* ConnectionState::socket() const
+    {
+        return m_sslSocket;
+    }
+
+    std::shared_ptr<ConnectionGuard> ConnectionState::guard() const
+    {
+        return m_guard;
+    }
+
+    bool ConnectionState::hasPendingRequest() const
+    {
+        return !m_requestParser.isEmpty();
+    }
+
+    void ConnectionState::receive(const QByteArray& data)
+    {
+        // The parser continues where it stopped on the last read, so data
+        // that has been parsed already is not looked at again.
+        Metrics::instance().increment(connectionMetrics().receivedBytes, data.size());
+
+        if (m_protocolHandler) {
+            m_protocolHandler->receive(data);
+            return;
+        }
+
+        QElapsedTimer parseTimer;
+        parseTimer.start();
+        m_requestParser.feed(data);
+        m_requestParser.parse();
+        m_parseDuration += parseTimer.nsecsElapsed();
+    }
+
+    bool ConnectionState::hasCompleteRequest() const
+    {
+        return m_requestParser.result() == RequestParser::Complete;
+    }
+
+    bool ConnectionState::hasInvalidRequest() const
+    {
+        return m_requestParser.result() == RequestParser::Error;
+    }
+
+    Request ConnectionState::takeRequest()
+    {
+        Request request = m_requestParser.takeRequest();
+        m_takenRequestParseDuration = m_parseDuration;
+
+        // Continue with the next pipelined request, if any has been received.
+        QElapsedTimer parseTimer;
+        parseTimer.start();
+        m_requestParser.parse();
+        m_parseDuration = parseTimer.nsecsElapsed();
+        return request;
+    }
+
+    qint64 ConnectionState::parseDuration() const
+    {
+        return m_takenRequestParseDuration;
+    }
+
+    void ConnectionState::resetRequest()
+    {
+        m_requestParser.reset();
+        m_parseDuration = 0;
+    }
+
+    void ConnectionState::setMaxRequestBodySize(int maxBodySize)
+    {
+        m_requestParser.setMaxBodySize(maxBodySize);
+    }
+
+    quint64 ConnectionState::enqueueResponse()
+    {
+        QueuedResponse queuedResponse;
+        queuedResponse.responseId = m_nextResponseId++;
+        queuedResponse.complete = false;
+        queuedResponse.closeConnection = false;
+        queuedResponse.streamed = false;
+        queuedResponse.bodySize = -1;
+        queuedResponse.bodyBytesWritten = 0;
+        queuedResponse.chunked = false;
+        queuedResponse.bodyDeviceFinished = false;
+        queuedResponse.bodyTransfer = ReadTransfer;
+        queuedResponse.bodyOffset = 0;
+        queuedResponse.bodyMap = 0;
+        queuedResponse.accessLog = 0;
+        m_responseQueue.append(queuedResponse);
+        Metrics::instance().increment(connectionMetrics().queuedResponses);
+        return queuedResponse.responseId;
+    }
+
+    void ConnectionState::completeResponse(quint64 responseId, Response& response, bool closeConnection)
+    {
+        for (QueuedResponse& queuedResponse : m_responseQueue) {
+            if (queuedResponse.responseId != responseId) {
+                continue;
+            }
+
+            queuedResponse.complete = true;
+            queuedResponse.closeConnection = closeConnection;
+
+            QIODevice* bodyDevice = response.m_bodyDevice.get();
+            if (!bodyDevice) {
+                queuedResponse.data = response.toByteArray();
+                return;
+            }
+
+            queuedResponse.chunked = response.headerFields().value(TransferEncoding).toByteArray().toLower().contains("chunked");
+            queuedResponse.data = response.headerToByteArray();
+            queuedResponse.streamed = true;
+            queuedResponse.bodyDevice = response.m_bodyDevice;
+            queuedResponse.bodySize = response.bodySize();
+
+            // Files of known size do not have to be copied through a buffer.
+            QFileDevice* fileDevice = qobject_cast<QFileDevice*>(bodyDevice);
+            if (fileDevice && fileDevice->handle() != -1
+                && queuedResponse.bodySize >= 0 && !queuedResponse.chunked) {
+                queuedResponse.bodyOffset = fileDevice->pos();
+#if defined(Q_OS_LINUX)
+                queuedResponse.bodyTransfer = m_sslSocket->isEncrypted() ? MappedTransfer : SendFileTransfer;
+#else
+                queuedResponse.bodyTransfer = MappedTransfer;
+#endif
+            }
+
+            // The device is released along with the queued response at the
+            // latest, which is dropped with the connection.
+            connect(bodyDevice, &QIODevice::readyRead, this, &ConnectionState::continueWriting);
+            connect(bodyDevice, &QIODevice::readChannelFinished, this, [this, responseId]() {
+                for (QueuedResponse& queuedResponse : m_responseQueue) {
+                    if (queuedResponse.responseId == responseId) {
+                        queuedResponse.bodyDeviceFinished = true;
+                    }
+                }
+                continueWriting();
+            });
+            return;
+        }
+    }
+
+    void ConnectionState::logResponse(quint64 responseId, AccessLog* accessLog, const AccessLogEntry& entry)
+    {
+        for (QueuedResponse& queuedResponse : m_responseQueue) {
+            if (queuedResponse.responseId == responseId) {
+                queuedResponse.accessLog = accessLog;
+                queuedResponse.accessLogEntry = entry;
+                return;
+            }
+        }
+    }
+
+    void ConnectionState::logWrittenResponse(QueuedResponse& queuedResponse)
+    {
+        if (!queuedResponse.accessLog) {
+            return;
+        }
+
+        AccessLogEntry& entry = queuedResponse.accessLogEntry;
+        entry.responseBytes += queuedResponse.bodyBytesWritten;
+        if (queuedResponse.writeTimer.isValid()) {
+            entry.writeDuration = queuedResponse.writeTimer.nsecsElapsed();
+        }
+        queuedResponse.accessLog->log(entry);
+    }
+
+    bool ConnectionState::writeResponses()
+    {
+        // Reading from a body device may make it produce more data right
+        // away, which must not write responses from within this loop.
+        if (m_writingResponses) {
+            return false;
+        }
+        m_writingResponses = true;
+
+        while (!m_responseQueue.isEmpty() && m_responseQueue.first().complete) {
+            QueuedResponse& queuedResponse = m_responseQueue.first();
+
+            // Write the whole response or the header of a streamed one.
+            if (!queuedResponse.data.isEmpty()) {
+                if (queuedResponse.accessLog) {
+                    queuedResponse.writeTimer.start();
+                    queuedResponse.accessLogEntry.responseBytes = queuedResponse.data.size();
+                }
+                m_sslSocket->write(queuedResponse.data);
+                countSentBytes(queuedResponse.data.size());
+                queuedResponse.data.clear();
+            }
+
+            // Responses after a streamed body have to wait until it is done.
+            if (queuedResponse.streamed) {
+                if (!writeBody(queuedResponse)) {
+                    m_writingResponses = false;
+                    return false;
+                }
+            }
+
+            logWrittenResponse(queuedResponse);
+            bool closeConnection = queuedResponse.closeConnection;
+            m_responseQueue.removeFirst();
+            Metrics::instance().increment(connectionMetrics().finishedResponses);
+            if (closeConnection) {
+                // Nothing will be written after this response. This is kind of
+                // weird, but seems to perform a disconnect in opposition to
+                // close. The connection state is released along with the socket.
+                Metrics::instance().increment(connectionMetrics().finishedResponses, m_responseQueue.size());
+                m_responseQueue.clear();
+                m_writingResponses = false;
+                m_sslSocket->disconnectFromHost();
+                return true;
+            }
+        }
+
+        m_writingResponses = false;
+
+        // The response that started the handler has been written, the
+        // handler may write to the connection now.
+        if (m_protocolHandler) {
+            if (m_responseQueue.isEmpty()) {
+                m_protocolHandler->open();
+            }
+            return false;
+        }
+
+        // Wait for the next request once everything has been written.
+        if (m_responseQueue.isEmpty()
+            && m_idleTimeoutSeconds > 0
+            && !m_idleTimer.isActive()
+            && m_sslSocket->state() == QAbstractSocket::ConnectedState) {
+            m_idleTimer.start(m_idleTimeoutSeconds * 1000);
+        }
+        return false;
+    }
+
+    bool ConnectionState::writeBody(QueuedResponse& queuedResponse)
+    {
+        bool complete = false;
+        switch (queuedResponse.bodyTransfer) {
+        case SendFileTransfer:
+            complete = sendFileBody(queuedResponse);
+            break;
+        case MappedTransfer:
+            complete = writeMappedBody(queuedResponse);
+            break;
+        default:
+            complete = readBody(queuedResponse);
+            break;
+        }
+
+        if (!complete) {
+            return false;
+        }
+        if (m_sendFileNotifier) {
+            m_sendFileNotifier->setEnabled(false);
+        }
+
+        if (queuedResponse.chunked) {
+            m_sslSocket->write("0\r\n\r\n");
+            countSentBytes(5);
+        }
+
+        // If the device ended early, the client cannot tell where the next
+        // response would start.
+        if (queuedResponse.bodySize >= 0 && queuedResponse.bodyBytesWritten < queuedResponse.bodySize) {
+            queuedResponse.closeConnection = true;
+        }
+
+        QIODevice* bodyDevice = queuedResponse.bodyDevice.get();
+        if (queuedResponse.bodyMap) {
+            static_cast<QFileDevice*>(bodyDevice)->unmap(queuedResponse.bodyMap);
+            queuedResponse.bodyMap = 0;
+        }
+        bodyDevice->disconnect(this);
+        queuedResponse.bodyDevice.reset();
+        queuedResponse.streamed = false;
+        return true;
+    }
+
+    bool ConnectionState::readBody(QueuedResponse& queuedResponse)
+    {
+        QIODevice* bodyDevice = queuedResponse.bodyDevice.get();
+
+        // Only read as much as the socket takes, the rest is read when the
+        // client has received the data written so far.
+        while (m_sslSocket->bytesToWrite() < WriteHighWaterMark) {
+            qint64 maxSize = BodyChunkSize;
+            if (queuedResponse.bodySize >= 0) {
+                maxSize = qMin(maxSize, queuedResponse.bodySize - queuedResponse.bodyBytesWritten);
+                if (maxSize == 0) {
+                    return true;
+                }
+            }
+
+            QByteArray chunk = bodyDevice->read(maxSize);
+            if (chunk.isEmpty()) {
+                // Either the body is done or we have to wait for more data.
+                return bodyDeviceAtEnd(queuedResponse);
+            }
+
+            queuedResponse.bodyBytesWritten += chunk.size();
+            if (queuedResponse.chunked) {
+                QByteArray chunkHeader = QByteArray::number(chunk.size(), 16);
+                chunkHeader += "\r\n";
+                m_sslSocket->write(chunkHeader);
+                countSentBytes(chunkHeader.size());
+                chunk += "\r\n";
+            }
+            m_sslSocket->write(chunk);
+            countSentBytes(chunk.size());
+        }
+        return false;
+    }
+
+    bool ConnectionState::sendFileBody(QueuedResponse& queuedResponse)
+    {
+#if defined(Q_OS_LINUX)
+        // The kernel writes to the socket directly, so the header and
+        // everything else buffered by the socket has to go out first.
+        if (m_sslSocket->bytesToWrite() > 0) {
+            return false;
+        }
+
+        QFileDevice* fileDevice = static_cast<QFileDevice*>(queuedResponse.bodyDevice.get());
+        while (queuedResponse.bodyBytesWritten < queuedResponse.bodySize) {
+            off_t offset = queuedResponse.bodyOffset + queuedResponse.bodyBytesWritten;
+            size_t count = qMin(SendFileChunkSize, queuedResponse.bodySize - queuedResponse.bodyBytesWritten);
+            ssize_t bytesSent = ::sendfile(m_sslSocket->socketDescriptor(), fileDevice->handle(), &offset, count);
+            if (bytesSent > 0) {
+                queuedResponse.bodyBytesWritten += bytesSent;
+                countSentBytes(bytesSent);
+                continue;
+            }
+
+            if (bytesSent == 0) {
+                // The file is shorter than announced.
+                return true;
+            }
+
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // The socket does not emit bytesWritten for data the kernel
+                // sent on its own, so wait for the descriptor to become
+                // writable. The socket's own write notifier is off while its
+                // buffer is empty, and ours is off again before anything else
+                // is written to the socket.
+                if (!m_sendFileNotifier) {
+                    m_sendFileNotifier = new QSocketNotifier(m_sslSocket->socketDescriptor(), QSocketNotifier::Write, this);
+                    connect(m_sendFileNotifier, &QSocketNotifier::activated, this, [this]() {
+                        m_sendFileNotifier->setEnabled(false);
+                        continueWriting();
+                    });
+                    connect(m_sslSocket, &QAbstractSocket::disconnected, m_sendFileNotifier, [this]() {
+                        m_sendFileNotifier->setEnabled(false);
+                    });
+                }
+                m_sendFileNotifier->setEnabled(true);
+                return false;
+            }
+
+            // Not every file system supports sendfile, fall back to mapping.
+            if ((errno == EINVAL || errno == ENOSYS) && queuedResponse.bodyBytesWritten == 0) {
+                queuedResponse.bodyTransfer = MappedTransfer;
+                return writeMappedBody(queuedResponse);
+            }
+
+            // Give up on the body, the connection will be closed.
+            return true;
+        }
+        return true;
+#else
+        queuedResponse.bodyTransfer = MappedTransfer;
+        return writeMappedBody(queuedResponse);
+#endif
+    }
+
+    bool ConnectionState::writeMappedBody(QueuedResponse& queuedResponse)
+    {
+        if (!queuedResponse.bodyMap) {
+            QFileDevice* fileDevice = static_cast<QFileDevice*>(queuedResponse.bodyDevice.get());
+            queuedResponse.bodyMap = fileDevice->map(queuedResponse.bodyOffset, queuedResponse.bodySize);
+            if (!queuedResponse.bodyMap) {
+                // Mapping fails for empty files or if the address space is
+                // exhausted, reading always works.
+                queuedResponse.bodyTransfer = ReadTransfer;
+                fileDevice->seek(queuedResponse.bodyOffset + queuedResponse.bodyBytesWritten);
+                return readBody(queuedResponse);
+            }
+        }
+
+        // Only the pages that are being written have to be in memory.
+        while (m_sslSocket->bytesToWrite() < WriteHighWaterMark
+            && queuedResponse.bodyBytesWritten < queuedResponse.bodySize) {
+            qint64 count = qMin(BodyChunkSize, queuedResponse.bodySize - queuedResponse.bodyBytesWritten);
+            m_sslSocket->write(reinterpret_cast<const char*>(queuedResponse.bodyMap) + queuedResponse.bodyBytesWritten, count);
+            queuedResponse.bodyBytesWritten += count;
+            countSentBytes(count);
+        }
+        return queuedResponse.bodyBytesWritten == queuedResponse.bodySize;
+    }
+
+    bool ConnectionState::bodyDeviceAtEnd(const QueuedResponse& queuedResponse) const
+    {
+        QIODevice* bodyDevice = queuedResponse.bodyDevice.get();
+        if (!bodyDevice->isOpen() || queuedResponse.bodyDeviceFinished) {
+            return true;
+        }
+
+        // Sequential devices may still receive data until they announce the
+        // end of their read channel, which may have happened before we took
+        // the device over.
+        if (bodyDevice->isSequential()) {
+            ResponseStream* responseStream = qobject_cast<ResponseStream*>(bodyDevice);
+            return responseStream && responseStream->atEnd();
+        }
+        return bodyDevice->atEnd();
+    }
+
+    void ConnectionState::countSentBytes(qint64 bytes)
+    {
+        Metrics::instance().increment(connectionMetrics().sentBytes, bytes);
+    }
+
+    int ConnectionState::servedRequests() const
+    {
+        return m_servedRequests;
+    }
+
+    void ConnectionState::countServedRequest()
+    {
+        m_servedRequests++;
+    }
+
+    void ConnectionState::startIdleTimer(int seconds)
+    {
+        // Protocol handlers decide themselves when to close the connection.
+        if (m_protocolHandler) {
+            return;
+        }
+
+        m_idleTimeoutSeconds = seconds;
+        if (m_responseQueue.isEmpty()) {
+            m_idleTimer.start(seconds * 1000);
+        }
+    }
+
+    void ConnectionState::stopIdleTimer()
+    {
+        m_idleTimer.stop();
+    }
+
+    void ConnectionState::upgrade(ProtocolHandler* protocolHandler)
+    {
+        m_protocolHandler = protocolHandler;
+
+        // A client may send frames right after the upgrade request.
+        m_protocolHandler->receive(m_requestParser.bufferedData());
+        m_requestParser.reset();
+        m_parseDuration = 0;
+    }
+
+    ProtocolHandler* ConnectionState::protocolHandler() const
+    {
+        return m_protocolHandler;
+    }
+
+    void ConnectionState::write(const QByteArray& data)
+    {
+        m_sslSocket->write(data);
+        countSentBytes(data.size());
+    }
+
+    void ConnectionState::idleTimeout()
+    {
+        m_sslSocket->disconnectFromHost();
+    }
+
+    void ConnectionState::continueWriting()
+    {
+        if (!m_responseQueue.isEmpty()) {
+            writeResponses();
+        }
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,280 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "httpaccesslog.h"
+#include "httpprotocolhandler.h"
+#include "httprequestparser.h"
+#include "httpresponse.h"
+#include "tcp/tcpresponder.h"
+
+// Qt includes
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QSocketNotifier>
+#include <QSslSocket>
+#include <QTimer>
+
+// Standard includes
+#include <memory>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    class ConnectionState;
+
+    /**
+     * @struct ConnectionGuard
+     * Lets other threads refer to a connection state that may be destroyed
+     * meanwhile. The connection is 0 once it has been destroyed, and it is
+     * not destroyed while the mutex is held.
+     */
+    struct ConnectionGuard {
+        QMutex mutex;
+        ConnectionState* connection;
+    };
+
+    /**
+     * @class ConnectionState
+     * Holds the HTTP state of a single client connection. It is owned by the
+     * server thread of the socket and created as a child of the socket, so it
+     * lives in the socket's thread and is destroyed along with it at the latest.
+     */
+    class ConnectionState : public Tcp::ConnectionData {
+        Q_OBJECT
+    public:
+        ConnectionState(QSslSocket* sslSocket);
+        ~ConnectionState();
+
+        /** @returns the socket of this connection. */
+        QSslSocket* socket() const;
+
+        /** @returns the guard for referring to this connection from other threads. */
+        std::shared_ptr<ConnectionGuard> guard() const;
+
+        /** @returns true, if data for a request has been received. */
+        bool hasPendingRequest() const;
+
+        /**
+         * Feeds data that has been read from the socket. The data may contain
+         * the rest of the current request as well as any number of pipelined
+         * requests following it.
+         * @param data The data read from the socket.
+         */
+        void receive(const QByteArray& data);
+
+        /** @returns true, if a complete request can be taken. */
+        bool hasCompleteRequest() const;
+
+        /** @returns true, if the pending request could not be parsed. */
+        bool hasInvalidRequest() const;
+
+        /**
+         * Takes the next complete request and starts parsing the request
+         * following it, if it has been received already.
+         * @returns the complete request.
+         */
+        Request takeRequest();
+
+        /**
+         * @returns the time in nanoseconds spent parsing the request taken
+         * last, including the reads it has been received in.
+         */
+        qint64 parseDuration() const;
+
+        /** Resets the parser state and drops all data not parsed yet. */
+        void resetRequest();
+
+        /** Sets the maximum size of request bodies, see RequestParser::setMaxBodySize(). */
+        void setMaxRequestBodySize(int maxBodySize);
+
+        /**
+         * Reserves a place for a response in the response queue. Responses
+         * are written in the order their places have been reserved, which is
+         * the order their requests have been received.
+         * @returns an identifier for the reserved place.
+         */
+        quint64 enqueueResponse();
+
+        /**
+         * Sets the response for a reserved place. If the response body is
+         * streamed from a device, the device is taken over by the connection.
+         * @param responseId The identifier returned by enqueueResponse().
+         * @param response The response to be sent.
+         * @param closeConnection Whether to close the connection after this
+         * response has been written.
+         */
+        void completeResponse(quint64 responseId, Response& response, bool closeConnection);
+
+        /**
+         * Logs a response to the access log once it has been written. The
+         * size and the write duration are filled in then.
+         * @param responseId The identifier returned by enqueueResponse().
+         * @param accessLog The log to write to. It has to outlive the connection.
+         * @param entry The entry describing the request.
+         */
+        void logResponse(quint64 responseId, AccessLog* accessLog, const AccessLogEntry& entry);
+
+        /**
+         * Writes all responses from the front of the queue that are ready,
+         * stopping at the first response that is not complete yet. A streamed
+         * body is written as long as the socket keeps up with it, writing
+         * continues when the client has received data or the body device has
+         * more data to read.
+         * @returns true, if the connection has been closed.
+         */
+        bool writeResponses();
+
+        /** @returns the number of requests that have been served. */
+        int servedRequests() const;
+
+        /** Counts a request as served. */
+        void countServedRequest();
+
+        /**
+         * Starts the idle timer. The connection will be closed if no data
+         * arrives within the given amount of time. While responses are still
+         * being written, the timer is started once they have been written.
+         * @param seconds The idle timeout in seconds.
+         */
+        void startIdleTimer(int seconds);
+
+        /** Stops the idle timer. */
+        void stopIdleTimer();
+
+        /**
+         * Lets a protocol handler take over the connection, for example after
+         * a WebSocket handshake. No more requests are parsed, data received
+         * after the current request is handed to the handler instead. The
+         * handler is opened once the responses queued so far have been written.
+         * @param protocolHandler The handler, a child of this connection.
+         */
+        void upgrade(ProtocolHandler* protocolHandler);
+
+        /** @returns the handler that has taken over the connection, or 0. */
+        ProtocolHandler* protocolHandler() const;
+
+        /**
+         * Writes data right away, bypassing the response queue. Only for
+         * connections that a protocol handler has taken over.
+         * @param data The data to write.
+         */
+        void write(const QByteArray& data);
+
+    private slots:
+        /** Closes the connection after it has been idle for too long. */
+        void idleTimeout();
+
+        /** Continues writing a streamed response body. */
+        void continueWriting();
+
+    private:
+        /** The way a streamed body is transferred to the socket. */
+        enum BodyTransfer {
+            /** Read from the device and write to the socket. */
+            ReadTransfer,
+            /** Let the kernel copy from the file to the socket. */
+            SendFileTransfer,
+            /** Write to the socket from a mapping of the file. */
+            MappedTransfer
+        };
+
+        struct QueuedResponse {
+            quint64 responseId;
+            bool complete;
+            bool closeConnection;
+            QByteArray data;
+            bool streamed;
+            /** Shared with the response, which may still be copied elsewhere. */
+            std::shared_ptr<QIODevice> bodyDevice;
+            qint64 bodySize;
+            qint64 bodyBytesWritten;
+            bool chunked;
+            bool bodyDeviceFinished;
+            BodyTransfer bodyTransfer;
+            qint64 bodyOffset;
+            uchar* bodyMap;
+            AccessLog* accessLog;
+            AccessLogEntry accessLogEntry;
+            QElapsedTimer writeTimer;
+        };
+
+        /** Finishes the access log entry of a response that has been written. */
+        void logWrittenResponse(QueuedResponse& queuedResponse);
+
+        /**
+         * Writes as much of a streamed body as the socket takes without
+         * exceeding the high water mark.
+         * @returns true, if the body has been written completely.
+         */
+        bool writeBody(QueuedResponse& queuedResponse);
+
+        /** Writes a streamed body by reading it from its device. */
+        bool readBody(QueuedResponse& queuedResponse);
+
+        /** Writes a file body with sendfile(2), bypassing user space. */
+        bool sendFileBody(QueuedResponse& queuedResponse);
+
+        /** Writes a file body from a mapping of the file. */
+        bool writeMappedBody(QueuedResponse& queuedResponse);
+
+        /** @returns true, if the body device will not provide more data. */
+        bool bodyDeviceAtEnd(const QueuedResponse& queuedResponse) const;
+
+        /** Counts data handed to the socket in the metrics. */
+        void countSentBytes(qint64 bytes);
+
+        /** Amount of data that is read from a body device at once. */
+        static constexpr qint64 BodyChunkSize = 64 * 1024;
+
+        /** Amount of data pending on the socket before writing pauses. */
+        static constexpr qint64 WriteHighWaterMark = 256 * 1024;
+
+        /** Amount of data passed to sendfile(2) at once. */
+        static constexpr qint64 SendFileChunkSize = 1024 * 1024;
+
+        QSslSocket* m_sslSocket;
+        std::shared_ptr<ConnectionGuard> m_guard;
+        RequestParser m_requestParser;
+        qint64 m_parseDuration;
+        qint64 m_takenRequestParseDuration;
+        QList<QueuedResponse> m_responseQueue;
+        quint64 m_nextResponseId;
+        int m_servedRequests;
+        int m_idleTimeoutSeconds;
+        bool m_writingResponses;
+        QTimer m_idleTimer;
+        /** Enabled while sendfile(2) waits for the socket to take more data. */
+        QSocketNotifier* m_sendFileNotifier;
+        ProtocolHandler* m_protocolHandler;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,172 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpeventhub.h"
+#include "httpeventstream.h"
+#include "misc/metrics.h"
+#include "misc/threadsafety.h"
+
+// Qt includes
+#include <QList>
+#include <QObject>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * Delivers events to the subscribers in one thread. It lives in that
+     * thread, so its subscribers are only touched there and need no lock.
+     */
+    class EventHub::Dispatcher : public QObject {
+    public:
+        QList<EventStream*> subscribers;
+
+        void deliver(const QByteArray& encodedEvent)
+        {
+            // A stream may close while receiving an event and unsubscribe,
+            // so we iterate over a copy.
+            const QList<EventStream*> eventStreams = subscribers;
+            for (EventStream* eventStream : eventStreams) {
+                eventStream->sendEncoded(encodedEvent);
+            }
+        }
+    };
+
+    EventHub::EventHub()
+        : m_subscriberCount(0)
+    {
+        m_publishedCounter = Metrics::instance().counter("qtwebserver_sse_published_events_total",
+            "Server-sent events published to a hub, counted once for all subscribers.");
+    }
+
+    EventHub::~EventHub()
+    {
+        MutexLocker mutexLocker(m_mutex);
+        Q_UNUSED(mutexLocker);
+        for (Dispatcher* dispatcher : m_dispatchers) {
+            dispatcher->deleteLater();
+        }
+        m_dispatchers.clear();
+    }
+
+    QByteArray EventHub::encode(const QByteArray& data, const QByteArray& event, const QByteArray& id)
+    {
+        // Fields end at line breaks, so they must not contain any.
+        QByteArray payload;
+        payload.reserve(data.size() + event.size() + id.size() + 32);
+        if (!event.isEmpty()) {
+            payload += "event: ";
+            payload += QByteArray(event).replace('\r', "").replace('\n', "");
+            payload += '\n';
+        }
+        if (!id.isEmpty()) {
+            payload += "id: ";
+            payload += QByteArray(id).replace('\r', "").replace('\n', "");
+            payload += '\n';
+        }
+
+        // Every line of the data becomes a data field of its own, the client
+        // joins them with line feeds again.
+        const QList<QByteArray> lines = QByteArray(data).replace("\r\n", "\n").replace('\r', '\n').split('\n');
+        for (const QByteArray& line : lines) {
+            payload += "data: ";
+            payload += line;
+            payload += '\n';
+        }
+        payload += '\n';
+
+        QByteArray encodedEvent = QByteArray::number(payload.size(), 16);
+        encodedEvent.reserve(encodedEvent.size() + payload.size() + 4);
+        encodedEvent += "\r\n";
+        encodedEvent += payload;
+        encodedEvent += "\r\n";
+        return encodedEvent;
+    }
+
+    void EventHub::publish(const QByteArray& data, const QByteArray& event, const QByteArray& id)
+    {
+        publishEncoded(encode(data, event, id));
+    }
+
+    void EventHub::publishEncoded(const QByteArray& encodedEvent)
+    {
+        Metrics::instance().increment(m_publishedCounter);
+
+        // The encoded event is shared with every thread, not copied.
+        MutexLocker mutexLocker(m_mutex);
+        Q_UNUSED(mutexLocker);
+        for (Dispatcher* dispatcher : m_dispatchers) {
+            QMetaObject::invokeMethod(dispatcher, [dispatcher, encodedEvent]() {
+                dispatcher->deliver(encodedEvent);
+            }, Qt::QueuedConnection);
+        }
+    }
+
+    int EventHub::subscriberCount() const
+    {
+        return m_subscriberCount.loadRelaxed();
+    }
+
+    void EventHub::subscribe(EventStream* eventStream)
+    {
+        MutexLocker mutexLocker(m_mutex);
+        Q_UNUSED(mutexLocker);
+        Dispatcher*& dispatcher = m_dispatchers[QThread::currentThread()];
+        if (!dispatcher) {
+            dispatcher = new Dispatcher();
+        }
+        dispatcher->subscribers.append(eventStream);
+        m_subscriberCount.ref();
+    }
+
+    void EventHub::unsubscribe(EventStream* eventStream)
+    {
+        Dispatcher* emptyDispatcher = 0;
+        {
+            MutexLocker mutexLocker(m_mutex);
+            Q_UNUSED(mutexLocker);
+            QHash<QThread*, Dispatcher*>::iterator dispatcher = m_dispatchers.find(QThread::currentThread());
+            if (dispatcher == m_dispatchers.end() || !dispatcher.value()->subscribers.removeOne(eventStream)) {
+                return;
+            }
+            m_subscriberCount.deref();
+
+            // Threads without subscribers do not get deliveries anymore.
+            if (dispatcher.value()->subscribers.isEmpty()) {
+                emptyDispatcher = dispatcher.value();
+                m_dispatchers.erase(dispatcher);
+            }
+        }
+
+        // The dispatcher may be delivering right now. Deliveries that have
+        // been posted already find no subscribers anymore.
+        if (emptyDispatcher) {
+            emptyDispatcher->deleteLater();
+        }
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
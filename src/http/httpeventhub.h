@@ -0,0 +1,109 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    class EventStream;
+
+    /**
+     * @class EventHub
+     * Broadcasts server-sent events to the event streams subscribed to it.
+     * An event is encoded once and the encoded bytes are shared by all
+     * subscribers. Subscribers are grouped by the server thread of their
+     * connection, so publishing posts one delivery per thread rather than one
+     * per subscriber. Publishing is thread-safe and does not wait for the
+     * events to be delivered.
+     */
+    class EventHub {
+    public:
+        EventHub();
+
+        /** All streams have to be unsubscribed before. */
+        ~EventHub();
+
+        /**
+         * Encodes an event in the text/event-stream format, framed as a chunk
+         * of a chunked response body.
+         * @param data The data of the event. Multiple lines are sent as
+         * multiple data fields.
+         * @param event The event type, or empty for "message".
+         * @param id The event id, which the client sends back as Last-Event-ID
+         * when it reconnects.
+         * @returns the encoded event.
+         */
+        static QByteArray encode(const QByteArray& data,
+            const QByteArray& event = QByteArray(),
+            const QByteArray& id = QByteArray());
+
+        /**
+         * Sends an event to all subscribers. May be called from any thread.
+         * @see encode()
+         */
+        void publish(const QByteArray& data,
+            const QByteArray& event = QByteArray(),
+            const QByteArray& id = QByteArray());
+
+        /**
+         * Sends an event that has been encoded with encode() before to all
+         * subscribers. May be called from any thread.
+         */
+        void publishEncoded(const QByteArray& encodedEvent);
+
+        /** @returns the number of subscribed streams. */
+        int subscriberCount() const;
+
+        /**
+         * Subscribes a stream. Called by the stream in its own thread, and it
+         * has to unsubscribe in that thread, too.
+         */
+        void subscribe(EventStream* eventStream);
+
+        /** Unsubscribes a stream. Events that are being delivered are dropped. */
+        void unsubscribe(EventStream* eventStream);
+
+    private:
+        Q_DISABLE_COPY(EventHub)
+
+        class Dispatcher;
+
+        /** Guards the dispatchers, their subscribers belong to their threads. */
+        QMutex m_mutex;
+        QHash<QThread*, Dispatcher*> m_dispatchers;
+        QAtomicInt m_subscriberCount;
+        int m_publishedCounter;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
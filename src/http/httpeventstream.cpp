@@ -0,0 +1,226 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpeventstream.h"
+#include "httpconnectionstate.h"
+#include "httpeventhub.h"
+#include "httpeventstreamresource.h"
+#include "misc/metrics.h"
+
+namespace QtWebServer {
+
+namespace Http {
+
+    namespace {
+
+        /** Metrics shared by all event streams, registered on first use. */
+        struct EventStreamMetrics {
+            int openedStreams;
+            int closedStreams;
+            int droppedEvents;
+            int disconnectedSlowConsumers;
+
+            EventStreamMetrics()
+            {
+                Metrics& metrics = Metrics::instance();
+                openedStreams = metrics.counter("qtwebserver_sse_opened_streams_total",
+                    "Event streams that have been opened.");
+                closedStreams = metrics.counter("qtwebserver_sse_closed_streams_total",
+                    "Event streams that have been closed or lost.");
+                droppedEvents = metrics.counter("qtwebserver_sse_dropped_events_total",
+                    "Events dropped for clients that did not keep up.");
+                disconnectedSlowConsumers = metrics.counter("qtwebserver_sse_disconnected_slow_consumers_total",
+                    "Event streams closed because their client did not keep up.");
+
+                int opened = openedStreams;
+                int closed = closedStreams;
+                metrics.addGauge("qtwebserver_sse_streams",
+                    "Event streams that are open.",
+                    [opened, closed]() {
+                        Metrics& metrics = Metrics::instance();
+                        Metrics::GaugeSample sample;
+                        sample.value = double(metrics.counterValue(opened)) - double(metrics.counterValue(closed));
+                        return QList<Metrics::GaugeSample>() << sample;
+                    });
+            }
+        };
+
+        const EventStreamMetrics& eventStreamMetrics()
+        {
+            static const EventStreamMetrics instance;
+            return instance;
+        }
+
+    } // namespace
+
+    EventStream::EventStream(ConnectionState* connection,
+        const Request& request,
+        std::shared_ptr<EventStreamResource> resource)
+        : ProtocolHandler(connection)
+        , m_connection(connection)
+        , m_sslSocket(connection->socket())
+        , m_request(request)
+        , m_resource(resource)
+        , m_state(StateConnecting)
+        , m_highWaterMark(resource->highWaterMark())
+        , m_slowConsumerPolicy(resource->slowConsumerPolicy())
+        , m_droppedEvents(0)
+    {
+        connect(m_sslSocket, &QAbstractSocket::disconnected, this, &EventStream::socketDisconnected);
+    }
+
+    EventStream::~EventStream()
+    {
+        finish();
+    }
+
+    const Request& EventStream::request() const
+    {
+        return m_request;
+    }
+
+    QByteArray EventStream::lastEventId() const
+    {
+        return m_request.rawHeader("Last-Event-ID").toByteArray();
+    }
+
+    bool EventStream::isOpen() const
+    {
+        return m_state == StateOpen;
+    }
+
+    qint64 EventStream::highWaterMark() const
+    {
+        return m_highWaterMark;
+    }
+
+    void EventStream::setHighWaterMark(qint64 highWaterMark)
+    {
+        m_highWaterMark = highWaterMark;
+    }
+
+    EventStream::SlowConsumerPolicy EventStream::slowConsumerPolicy() const
+    {
+        return m_slowConsumerPolicy;
+    }
+
+    void EventStream::setSlowConsumerPolicy(SlowConsumerPolicy slowConsumerPolicy)
+    {
+        m_slowConsumerPolicy = slowConsumerPolicy;
+    }
+
+    qint64 EventStream::droppedEvents() const
+    {
+        return m_droppedEvents;
+    }
+
+    void EventStream::receive(const QByteArray& data)
+    {
+        Q_UNUSED(data);
+    }
+
+    void EventStream::open()
+    {
+        if (m_state != StateConnecting) {
+            return;
+        }
+
+        // Events published while the resource is being notified are posted
+        // to this thread, so they arrive after anything it sends right away.
+        m_state = StateOpen;
+        Metrics::instance().increment(eventStreamMetrics().openedStreams);
+        m_resource->eventHub()->subscribe(this);
+        m_resource->opened(this);
+    }
+
+    void EventStream::send(const QByteArray& data, const QByteArray& event, const QByteArray& id)
+    {
+        sendEncoded(EventHub::encode(data, event, id));
+    }
+
+    void EventStream::sendEncoded(const QByteArray& encodedEvent)
+    {
+        if (m_state != StateOpen) {
+            return;
+        }
+
+        // Events are written whole or not at all, so the client never sees
+        // a partial event.
+        if (m_sslSocket->bytesToWrite() >= m_highWaterMark) {
+            if (m_slowConsumerPolicy == DropEvents) {
+                m_droppedEvents++;
+                Metrics::instance().increment(eventStreamMetrics().droppedEvents);
+                return;
+            }
+
+            // Flushing what is pending would take too long, so the
+            // connection is dropped right away.
+            Metrics::instance().increment(eventStreamMetrics().disconnectedSlowConsumers);
+            finish();
+            m_sslSocket->abort();
+            return;
+        }
+
+        m_connection->write(encodedEvent);
+    }
+
+    void EventStream::close()
+    {
+        if (m_state == StateClosed) {
+            return;
+        }
+
+        // The last chunk ends the response body properly.
+        if (m_state == StateOpen) {
+            m_connection->write("0\r\n\r\n");
+        }
+        finish();
+        m_sslSocket->disconnectFromHost();
+    }
+
+    void EventStream::socketDisconnected()
+    {
+        finish();
+    }
+
+    void EventStream::finish()
+    {
+        if (m_state == StateClosed) {
+            return;
+        }
+
+        // The resource only learns about streams that have been opened.
+        bool opened = m_state == StateOpen;
+        m_state = StateClosed;
+        if (opened) {
+            m_resource->eventHub()->unsubscribe(this);
+            Metrics::instance().increment(eventStreamMetrics().closedStreams);
+            m_resource->closed(this);
+            emit closed();
+        }
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
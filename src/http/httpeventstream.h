@@ -0,0 +1,150 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "httpprotocolhandler.h"
+#include "httprequest.h"
+
+// Qt includes
+#include <QByteArray>
+#include <QSslSocket>
+
+// Standard includes
+#include <memory>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    class ConnectionState;
+    class EventStreamResource;
+
+    /**
+     * @class EventStream
+     * A connection that receives server-sent events as the body of a
+     * text/event-stream response. It stays in the server thread that has
+     * been serving the connection and is subscribed to the event hub of its
+     * resource while it is open. The slots have to be called in that thread,
+     * other threads publish events through the hub.
+     *
+     * Events are only written as long as less than the high water mark is
+     * pending on the socket. Events for a slower client are either dropped
+     * or the client is disconnected, so a slow client cannot make the server
+     * buffer an unbounded amount of data.
+     */
+    class EventStream : public ProtocolHandler {
+        Q_OBJECT
+    public:
+        /** What happens to events for a client that does not keep up. */
+        enum SlowConsumerPolicy {
+            /** Drop events until the client has caught up. */
+            DropEvents,
+            /** Close the connection, the client may reconnect with Last-Event-ID. */
+            DisconnectSlowConsumer
+        };
+
+        /**
+         * Created by the web engine once the response header has been queued.
+         * @param connection The connection, which becomes the parent.
+         * @param request The request that has opened the stream.
+         * @param resource The resource the request has been routed to.
+         */
+        EventStream(ConnectionState* connection,
+            const Request& request,
+            std::shared_ptr<EventStreamResource> resource);
+        ~EventStream();
+
+        /** @returns the request that has opened the stream, including its URI parameters. */
+        const Request& request() const;
+
+        /** @returns the id of the last event the client has received before reconnecting, if any. */
+        QByteArray lastEventId() const;
+
+        /** @returns true, if events can be sent. */
+        bool isOpen() const;
+
+        /** @returns the number of bytes pending on the socket before events are held back. */
+        qint64 highWaterMark() const;
+
+        /** Sets the number of bytes pending on the socket before events are held back. */
+        void setHighWaterMark(qint64 highWaterMark);
+
+        /** @returns what happens to events for a client that does not keep up. */
+        SlowConsumerPolicy slowConsumerPolicy() const;
+
+        /** Sets what happens to events for a client that does not keep up. */
+        void setSlowConsumerPolicy(SlowConsumerPolicy slowConsumerPolicy);
+
+        /** @returns the number of events that have been dropped for this client. */
+        qint64 droppedEvents() const;
+
+        /** Clients are not supposed to send anything, so data is ignored. */
+        virtual void receive(const QByteArray& data);
+
+        /** Subscribes to the hub and lets the resource know about the stream. */
+        virtual void open();
+
+    public slots:
+        /** Sends an event to this client only, see EventHub::encode(). */
+        void send(const QByteArray& data,
+            const QByteArray& event = QByteArray(),
+            const QByteArray& id = QByteArray());
+
+        /** Sends an event that has been encoded with EventHub::encode(). */
+        void sendEncoded(const QByteArray& encodedEvent);
+
+        /** Ends the response body and closes the connection. */
+        void close();
+
+    signals:
+        /** Emitted once, when the stream has been closed or the connection has been lost. */
+        void closed();
+
+    private slots:
+        void socketDisconnected();
+
+    private:
+        enum State {
+            StateConnecting,
+            StateOpen,
+            StateClosed
+        };
+
+        /** Marks the stream as closed and lets the hub and the resource know once. */
+        void finish();
+
+        ConnectionState* m_connection;
+        QSslSocket* m_sslSocket;
+        Request m_request;
+        std::shared_ptr<EventStreamResource> m_resource;
+        State m_state;
+        qint64 m_highWaterMark;
+        SlowConsumerPolicy m_slowConsumerPolicy;
+        qint64 m_droppedEvents;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
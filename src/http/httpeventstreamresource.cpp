@@ -0,0 +1,95 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpeventstreamresource.h"
+
+namespace QtWebServer {
+
+namespace Http {
+
+    EventStreamResource::EventStreamResource(QString uniqueIdentifier,
+        QObject* parent)
+        : Resource(uniqueIdentifier, parent)
+    {
+        setContentType("text/event-stream");
+        m_highWaterMark = 256 * 1024;
+        m_slowConsumerPolicy = EventStream::DropEvents;
+    }
+
+    EventStreamResource::~EventStreamResource()
+    {
+    }
+
+    EventHub* EventStreamResource::eventHub()
+    {
+        return &m_eventHub;
+    }
+
+    qint64 EventStreamResource::highWaterMark() const
+    {
+        return m_highWaterMark.r();
+    }
+
+    void EventStreamResource::setHighWaterMark(qint64 highWaterMark)
+    {
+        m_highWaterMark = highWaterMark;
+    }
+
+    EventStream::SlowConsumerPolicy EventStreamResource::slowConsumerPolicy() const
+    {
+        return EventStream::SlowConsumerPolicy(m_slowConsumerPolicy.r());
+    }
+
+    void EventStreamResource::setSlowConsumerPolicy(EventStream::SlowConsumerPolicy slowConsumerPolicy)
+    {
+        m_slowConsumerPolicy = int(slowConsumerPolicy);
+    }
+
+    void EventStreamResource::deliver(const Request& request, Response& response)
+    {
+        Q_UNUSED(request);
+        response.setStatusCode(MethodNotAllowed);
+        response.setHeader(Http::Allow, "GET");
+    }
+
+    bool EventStreamResource::acceptConnection(const Request& request, Response& response)
+    {
+        Q_UNUSED(request);
+        Q_UNUSED(response);
+        return true;
+    }
+
+    void EventStreamResource::opened(EventStream* eventStream)
+    {
+        Q_UNUSED(eventStream);
+    }
+
+    void EventStreamResource::closed(EventStream* eventStream)
+    {
+        Q_UNUSED(eventStream);
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,105 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "httpeventhub.h"
+#include "httpeventstream.h"
+#include "httpresource.h"
+#include "misc/threadsafety.h"
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * @class EventStreamResource
+     * Resource serving server-sent events. GET requests are answered by the
+     * web engine with a text/event-stream response that is kept open, the
+     * connection stays in the server thread that has accepted it. Events
+     * published to the resource's hub are sent to all open streams:
+     *   eventStreamResource->eventHub()->publish("{\"load\": 0.5}", "status");
+     *
+     * @attention: The notifications are called from the server threads of
+     * the streams, so they may be called from several threads at once.
+     * They are not delivered in a worker pool.
+     */
+    class EventStreamResource : public Resource {
+        Q_OBJECT
+    public:
+        EventStreamResource(QString uniqueIdentifier,
+            QObject* parent = 0);
+        ~EventStreamResource();
+
+        /** @returns the hub that broadcasts events to the streams of this resource. */
+        EventHub* eventHub();
+
+        /** @returns the high water mark new streams start with. */
+        qint64 highWaterMark() const;
+
+        /**
+         * Sets the number of bytes that may be pending on the socket of a
+         * stream before events are held back. Applies to new streams, the
+         * default is 256 KiB.
+         */
+        void setHighWaterMark(qint64 highWaterMark);
+
+        /** @returns the slow consumer policy new streams start with. */
+        EventStream::SlowConsumerPolicy slowConsumerPolicy() const;
+
+        /** Sets what happens to events for slow clients of new streams. */
+        void setSlowConsumerPolicy(EventStream::SlowConsumerPolicy slowConsumerPolicy);
+
+        /** Answers requests other than GET with 405 Method Not Allowed. */
+        virtual void deliver(const Request& request, Response& response);
+
+        /**
+         * Decides whether a stream is opened for a request. Headers may be
+         * added to the response. The default implementation accepts all
+         * requests.
+         * @returns false, to answer the request with 403 Forbidden instead.
+         */
+        virtual bool acceptConnection(const Request& request, Response& response);
+
+        /**
+         * Called when a stream has been opened, for example to send the
+         * current state or the events missed since EventStream::lastEventId().
+         */
+        virtual void opened(EventStream* eventStream);
+
+        /**
+         * Called when a stream has been closed or its connection has been
+         * lost. The stream is destroyed along with its connection later.
+         */
+        virtual void closed(EventStream* eventStream);
+
+    private:
+        EventHub m_eventHub;
+        ThreadGuard<qint64> m_highWaterMark;
+        ThreadGuard<int> m_slowConsumerPolicy;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -87,14 +87,225 @@ namespace Http {
         { WWWAuthenticate, "WWW-Authenticate" }
     };
 
+    namespace {
+        const char* rawHeaderName(int header)
+        {
+            // The map is ordered like the enum, so we can index it directly.
+            if (header >= 0 && header < HEADER_COUNT && headerNameMap[header].header == header) {
+                return headerNameMap[header].headerName;
+            }
+            for (int i = 0; i < HEADER_COUNT; i++) {
+                if (headerNameMap[i].header == header) {
+                    return headerNameMap[i].headerName;
+                }
+            }
+            return "";
+        }
+
+        bool equalsIgnoringCase(QByteArrayView a, QByteArrayView b)
+        {
+            return a.size() == b.size() && qstrnicmp(a.data(), a.size(), b.data(), b.size()) == 0;
+        }
+
+        // Header names bucketed by their length, so a lookup only compares
+        // against the few names of the same length.
+        struct HeaderNameIndex {
+            enum { MaximumLength = 32 };
+            QVarLengthArray<int, 8> byLength[MaximumLength];
+
+            HeaderNameIndex()
+            {
+                for (int i = 0; i < HEADER_COUNT; i++) {
+                    int length = qstrlen(headerNameMap[i].headerName);
+                    if (length < MaximumLength) {
+                        byLength[length].append(headerNameMap[i].header);
+                    }
+                }
+            }
+        };
+    }
+
     QString headerName(Http::Header header)
     {
+        return QString::fromLatin1(rawHeaderName(header));
+    }
+
+    int headerFromName(QByteArrayView name)
+    {
+        static const HeaderNameIndex headerNameIndex;
+        if (name.size() >= HeaderNameIndex::MaximumLength) {
+            return -1;
+        }
+
+        for (int header : headerNameIndex.byLength[name.size()]) {
+            if (equalsIgnoringCase(name, rawHeaderName(header))) {
+                return header;
+            }
+        }
+        return -1;
+    }
+
+    Headers::Headers()
+    {
+        clear();
+    }
+
+    bool Headers::contains(Header header) const
+    {
+        return m_knownFields[header] >= 0;
+    }
+
+    bool Headers::contains(QByteArrayView name) const
+    {
+        return indexOf(name) >= 0;
+    }
+
+    QByteArrayView Headers::value(Header header) const
+    {
+        int index = m_knownFields[header];
+        return index >= 0 ? value(index) : QByteArrayView();
+    }
+
+    QByteArrayView Headers::value(QByteArrayView name) const
+    {
+        int index = indexOf(name);
+        return index >= 0 ? value(index) : QByteArrayView();
+    }
+
+    void Headers::setValue(Header header, QByteArrayView value)
+    {
+        int valueOffset = m_buffer.size();
+        m_buffer.append(value);
+        setField(header, -1, 0, valueOffset, value.size());
+    }
+
+    void Headers::setValue(QByteArrayView name, QByteArrayView value)
+    {
+        int header = headerFromName(name);
+        if (header >= 0) {
+            setValue((Header)header, value);
+            return;
+        }
+
+        int nameOffset = m_buffer.size();
+        m_buffer.append(name);
+        int valueOffset = m_buffer.size();
+        m_buffer.append(value);
+        setField(-1, nameOffset, name.size(), valueOffset, value.size());
+    }
+
+    void Headers::remove(Header header)
+    {
+        int index = m_knownFields[header];
+        if (index < 0) {
+            return;
+        }
+
+        m_fields.remove(index);
+        m_knownFields[header] = -1;
+        for (int i = 0; i < HEADER_COUNT; i++) {
+            if (m_knownFields[i] > index) {
+                m_knownFields[i]--;
+            }
+        }
+    }
+
+    void Headers::clear()
+    {
+        m_buffer.clear();
+        m_fields.clear();
         for (int i = 0; i < HEADER_COUNT; i++) {
-            if (headerNameMap[i].header == header) {
-                return headerNameMap[i].headerName;
+            m_knownFields[i] = -1;
+        }
+    }
+
+    int Headers::count() const
+    {
+        return m_fields.size();
+    }
+
+    QByteArrayView Headers::name(int index) const
+    {
+        const Field& field = m_fields.at(index);
+        if (field.nameOffset < 0) {
+            return QByteArrayView(rawHeaderName(field.header));
+        }
+        return range(field.nameOffset, field.nameLength);
+    }
+
+    QByteArrayView Headers::value(int index) const
+    {
+        const Field& field = m_fields.at(index);
+        return range(field.valueOffset, field.valueLength);
+    }
+
+    QMap<QString, QString> Headers::toMap() const
+    {
+        QMap<QString, QString> headerMap;
+        for (int i = 0; i < m_fields.size(); i++) {
+            headerMap.insert(QString::fromUtf8(name(i)), QString::fromUtf8(value(i)));
+        }
+        return headerMap;
+    }
+
+    void Headers::setBuffer(const QByteArray& buffer)
+    {
+        m_buffer = buffer;
+    }
+
+    void Headers::appendField(int nameOffset, int nameLength, int valueOffset, int valueLength)
+    {
+        int header = headerFromName(range(nameOffset, nameLength));
+        setField(header, nameOffset, nameLength, valueOffset, valueLength);
+    }
+
+    int Headers::indexOf(QByteArrayView name) const
+    {
+        int header = headerFromName(name);
+        if (header >= 0) {
+            return m_knownFields[header];
+        }
+
+        for (int i = 0; i < m_fields.size(); i++) {
+            if (m_fields.at(i).header < 0 && equalsIgnoringCase(this->name(i), name)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void Headers::setField(int header, int nameOffset, int nameLength, int valueOffset, int valueLength)
+    {
+        Field field = { header, nameOffset, nameLength, valueOffset, valueLength };
+
+        // Replace a previous field with the same name.
+        int index = -1;
+        if (header >= 0) {
+            index = m_knownFields[header];
+        } else {
+            for (int i = 0; i < m_fields.size(); i++) {
+                if (m_fields.at(i).header < 0
+                    && equalsIgnoringCase(this->name(i), range(nameOffset, nameLength))) {
+                    index = i;
+                    break;
+                }
             }
         }
-        return "";
+
+        if (index >= 0) {
+            m_fields[index] = field;
+            return;
+        }
+
+        m_fields.append(field);
+        if (header >= 0) {
+            m_knownFields[header] = m_fields.size() - 1;
+        }
+    }
+
+    QByteArrayView Headers::range(int offset, int length) const
+    {
+        return QByteArrayView(m_buffer.constData() + offset, length);
     }
 
 } // namespace Http
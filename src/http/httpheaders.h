@@ -24,8 +24,11 @@
 #pragma once
 
 // Qt includes
+#include <QByteArray>
+#include <QByteArrayView>
 #include <QMap>
 #include <QString>
+#include <QVarLengthArray>
 
 namespace QtWebServer {
 
@@ -107,6 +110,91 @@ namespace Http {
 
     QString headerName(Http::Header header);
 
+    /**
+     * Looks up a header by its name, ignoring case.
+     * @returns the header, or -1 if the name is not a known header.
+     */
+    int headerFromName(QByteArrayView name);
+
+    /**
+     * @class Headers
+     * Compact storage for HTTP header fields. Header fields are kept as byte
+     * ranges into a single buffer, which for received requests is a copy of
+     * the header block made in one go, so names and values are not copied one
+     * by one. Headers
+     * from the Header enum are found through a slot per header, all others by
+     * a case-insensitive scan over a small flat list. Lookups do not allocate.
+     */
+    class Headers {
+    public:
+        Headers();
+
+        /** @returns true, if the header is present. */
+        bool contains(Header header) const;
+
+        /** @returns true, if a header with the given name is present. */
+        bool contains(QByteArrayView name) const;
+
+        /** @returns the value of the header, or an empty view. */
+        QByteArrayView value(Header header) const;
+
+        /** @returns the value of the header with the given name, or an empty view. */
+        QByteArrayView value(QByteArrayView name) const;
+
+        /** Sets the value of a header, replacing a previous value. */
+        void setValue(Header header, QByteArrayView value);
+
+        /** Sets the value of a header by name, replacing a previous value. */
+        void setValue(QByteArrayView name, QByteArrayView value);
+
+        /** Removes a header. */
+        void remove(Header header);
+
+        /** Removes all headers. */
+        void clear();
+
+        /** @returns the number of header fields. */
+        int count() const;
+
+        /** @returns the name of the header field at the given index. */
+        QByteArrayView name(int index) const;
+
+        /** @returns the value of the header field at the given index. */
+        QByteArrayView value(int index) const;
+
+        /** @returns a copy of all header fields as a map. */
+        QMap<QString, QString> toMap() const;
+
+        /**
+         * Sets the buffer the ranges passed to appendField() refer to. The
+         * buffer is shared, not copied.
+         */
+        void setBuffer(const QByteArray& buffer);
+
+        /**
+         * Adds a header field that is located in the buffer. A previous field
+         * with the same name is replaced.
+         */
+        void appendField(int nameOffset, int nameLength, int valueOffset, int valueLength);
+
+    private:
+        struct Field {
+            int header;
+            int nameOffset;
+            int nameLength;
+            int valueOffset;
+            int valueLength;
+        };
+
+        int indexOf(QByteArrayView name) const;
+        void setField(int header, int nameOffset, int nameLength, int valueOffset, int valueLength);
+        QByteArrayView range(int offset, int length) const;
+
+        QByteArray m_buffer;
+        QVarLengthArray<Field, 16> m_fields;
+        qint16 m_knownFields[HEADER_COUNT];
+    };
+
 } // namespace Http
 
 } // namespace QtWebServer
@@ -23,6 +23,10 @@
 
 // Own includes
 #include "httpiodeviceresource.h"
+#include "httpbyteranges.h"
+
+// Qt includes
+#include <QFile>
 
 namespace QtWebServer {
 
@@ -54,6 +58,22 @@ namespace Http {
         if (request.method() == Method::GET) {
             response.setHeader(Http::ContentType, contentType());
 
+            // Files are opened for every request, so they can be streamed to
+            // several clients at once without being read into memory. Range
+            // requests are served for files only.
+            QFile* file = qobject_cast<QFile*>(m_ioDevice);
+            if (file) {
+                QFile* bodyFile = new QFile(file->fileName());
+                if (bodyFile->open(QIODevice::ReadOnly)) {
+                    ByteRanges::deliverFile(request, response, bodyFile, contentType());
+                } else {
+                    delete bodyFile;
+                    response.setBody("");
+                    response.setStatusCode(Forbidden);
+                }
+                return;
+            }
+
             m_ioDevice->open(QIODevice::ReadOnly);
             if (m_ioDevice->isOpen()) {
                 response.setBody(m_ioDevice->readAll());
@@ -0,0 +1,57 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpmetricsresource.h"
+#include "misc/metrics.h"
+
+namespace QtWebServer {
+
+namespace Http {
+
+    MetricsResource::MetricsResource(QString uniqueIdentifier,
+        QObject* parent)
+        : Resource(uniqueIdentifier, parent)
+    {
+        setContentType("text/plain; version=0.0.4");
+    }
+
+    MetricsResource::~MetricsResource()
+    {
+    }
+
+    void MetricsResource::deliver(const Request& request, Response& response)
+    {
+        if (request.method() == Method::GET) {
+            response.setHeader(Http::ContentType, contentType());
+            response.setHeader(Http::CacheControl, "no-cache");
+            response.setBody(Metrics::instance().exposition());
+            response.setStatusCode(StatusCode::Ok);
+        } else {
+            response.setStatusCode(StatusCode::MethodNotAllowed);
+        }
+    }
+
+} // Http
+
+} // QtWebServer
@@ -0,0 +1,64 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QByteArray>
+#include <QObject>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * @class ProtocolHandler
+     * Takes over a connection after its last HTTP response, for example to
+     * speak the WebSocket protocol or to keep streaming events. A handler is
+     * a child of the connection's state, so it stays in the server thread of
+     * the connection and is destroyed along with it.
+     */
+    class ProtocolHandler : public QObject {
+        Q_OBJECT
+    public:
+        ProtocolHandler(QObject* parent = 0);
+        virtual ~ProtocolHandler();
+
+        /**
+         * Handles data received after the last request. Data may be received
+         * before the handler has been opened.
+         * @param data The data read from the socket.
+         */
+        virtual void receive(const QByteArray& data) = 0;
+
+        /**
+         * Called once the responses queued before the handler took over have
+         * been written, the last of them being the one that started it. The
+         * handler may write to the connection from now on.
+         */
+        virtual void open() = 0;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -23,11 +23,7 @@
 
 // Own includes
 #include "httprequest.h"
-#include "util/utilformurlcodec.h"
-
-// Qt includes
-#include <QRegularExpression>
-#include <QStringList>
+#include "httprequestparser.h"
 
 namespace QtWebServer {
 
@@ -61,6 +57,16 @@ namespace Http {
         return m_uniqueResourceIdentifier;
     }
 
+    QMap<QString, QString> Request::uriParameters() const
+    {
+        return m_uriParameters;
+    }
+
+    void Request::setUriParameters(const QMap<QString, QString>& uriParameters)
+    {
+        m_uriParameters = uriParameters;
+    }
+
     QString Request::version() const
     {
         return m_version;
@@ -73,19 +79,34 @@ namespace Http {
 
     QMap<QString, QString> Request::headers() const
     {
-        return m_headers;
+        return m_headers.toMap();
     }
 
     QString Request::header(Header header) const
     {
-        return this->header(headerName(header));
+        return QString::fromUtf8(m_headers.value(header));
     }
 
     QString Request::header(QString headerName) const
+    {
+        return QString::fromUtf8(m_headers.value(headerName.toUtf8()));
+    }
+
+    QByteArrayView Request::rawHeader(Header header) const
+    {
+        return m_headers.value(header);
+    }
+
+    QByteArrayView Request::rawHeader(QByteArrayView headerName) const
     {
         return m_headers.value(headerName);
     }
 
+    const Headers& Request::headerFields() const
+    {
+        return m_headers;
+    }
+
     QMap<QString, QString> Request::getParameters() const
     {
         return m_getParameters;
@@ -101,22 +122,22 @@ namespace Http {
         return m_body;
     }
 
-    void Request::appendBodyData(QByteArray bodyData)
-    {
-        m_body.append(bodyData);
-    }
-
     bool Request::isComplete() const
     {
-        if (m_headers.contains(headerName(ContentLength))) {
-            bool contentLengthValid = false;
-            long long contentLength = m_headers.value(headerName(ContentLength)).toLongLong(&contentLengthValid);
-            if (contentLengthValid) {
-                return m_body.count() == contentLength;
-            }
+        // Chunked bodies are complete once the last chunk has been decoded.
+        if (isChunked()) {
+            return m_chunkedBodyComplete;
         }
 
-        // TODO: Chunked transfer mode here.
+        // A malformed length does not tell where the body ends, so the
+        // request can never be complete.
+        qint64 contentLength = expectedBodyLength();
+        if (contentLength == InvalidBodyLength) {
+            return false;
+        }
+        if (contentLength >= 0) {
+            return m_body.size() == contentLength;
+        }
 
         // If there is nothing indicating the content length
         // and no information about chunked transfer mode then
@@ -124,34 +145,51 @@ namespace Http {
         return true;
     }
 
-    QByteArray Request::takeLine(QByteArray& rawRequest)
+    bool Request::isChunked() const
     {
-        // Lines in the HTTP protocol are defined to be separated by '\r\n'
-        QByteArray line;
-        int rawSize = rawRequest.size();
-        int rawPosition;
-
-        // Watch out for the first occurrence of '\r'
-        for (rawPosition = 0; rawPosition < rawSize - 1; rawPosition++) {
-            if (rawRequest[rawPosition] == '\r' && rawRequest[rawPosition + 1] == '\n') {
-                break;
-            }
+        // Chunked has to be the last transfer coding applied.
+        QByteArrayView transferEncoding = m_headers.value(TransferEncoding);
+        int end = transferEncoding.size();
+        while (end > 0 && (transferEncoding[end - 1] == ' ' || transferEncoding[end - 1] == '\t')) {
+            end--;
+        }
+
+        // "chunked" has to be a whole token, so "xchunked" does not count.
+        const char chunked[] = "chunked";
+        int length = sizeof(chunked) - 1;
+        if (end < length
+            || qstrnicmp(transferEncoding.data() + end - length, length, chunked, length) != 0) {
+            return false;
         }
+        int start = end - length;
+        if (start == 0) {
+            return true;
+        }
+        char previous = transferEncoding[start - 1];
+        return previous == ',' || previous == ' ' || previous == '\t';
+    }
 
-        // If there is just two characters left, this must be EOF
-        if (rawPosition != rawSize - 2) {
-            // Get the line contents
-            line = rawRequest.left(rawPosition);
-
-            // Get the remaining data, skipping '\r\n'
-            rawRequest = rawRequest.right(rawSize - line.count() - 2);
-        } else {
-            // EOF
-            rawRequest = "";
-            line = rawRequest;
+    qint64 Request::expectedBodyLength() const
+    {
+        if (!m_headers.contains(ContentLength)) {
+            return NoBodyLength;
         }
 
-        return line;
+        // Only plain digits are accepted, no signs, lists or trailing junk.
+        // Eighteen digits cannot overflow.
+        QByteArrayView contentLengthValue = m_headers.value(ContentLength);
+        if (contentLengthValue.isEmpty() || contentLengthValue.size() > 18) {
+            return InvalidBodyLength;
+        }
+
+        qint64 contentLength = 0;
+        for (char c : contentLengthValue) {
+            if (c < '0' || c > '9') {
+                return InvalidBodyLength;
+            }
+            contentLength = contentLength * 10 + (c - '0');
+        }
+        return contentLength;
     }
 
     void Request::setDefaults()
@@ -160,111 +198,28 @@ namespace Http {
         m_getParameters.clear();
         m_postParameters.clear();
         m_urlParameters.clear();
+        m_uriParameters.clear();
         m_valid = false;
+        m_chunkedBodyComplete = false;
         m_method = Method::GET;
         m_uniqueResourceIdentifier = "";
         m_version = "";
         m_body = "";
     }
 
-    void Request::deserialize(QByteArray rawRequest)
+    void Request::deserialize(const QByteArray& rawRequest)
     {
-        // Read ahead the first line in the request
-        QByteArray rawRequestLine = takeLine(rawRequest);
-        QStringList requestLine = QString::fromUtf8(rawRequestLine)
-                                      .split(QRegularExpression("\\s+"));
-
-        QStringList rawRequestLines = QString::fromUtf8(rawRequest).split("\n");
-
-        if (requestLine.count() < 3) {
-            // The request line has to contain three strings: The method
-            // string, the request uri and the HTTP version. If we were
-            // strict, we shouldn't even accept anything larger than four
-            // strings, but we're permissive here.
-            return;
-        }
-
-        m_method = Method::UNKNOW;
-        QString methodString = requestLine.at(0);
-        if (methodString == "OPTIONS") {
-            m_method = Method::OPTIONS;
-        } else if (methodString == "GET") {
-            m_method = Method::GET;
-        } else if (methodString == "HEAD") {
-            m_method = Method::HEAD;
-        } else if (methodString == "POST") {
-            m_method = Method::POST;
-        } else if (methodString == "PUT") {
-            m_method = Method::PUT;
-        } else if (methodString == "DELETE") {
-            m_method = Method::DELETE;
-        } else if (methodString == "TRACE") {
-            m_method = Method::TRACE;
-        } else if (methodString == "CONNECT") {
-            m_method = Method::CONNECT;
-        }
-
-        // add post paremeters
-        if (m_method == Method::POST) {
-            log("We get POST!");
-            QString postLine = rawRequestLines.at(rawRequestLines.count() - 1);
-            if (!postLine.isEmpty()) {
-                QStringList postData = postLine.split('&', Qt::SkipEmptyParts);
-                for (int i = 0; i < postData.count(); i++) {
-                    QStringList post = postData.at(i).split('=', Qt::SkipEmptyParts);
-                    if (post.count() == 2) {
-                        m_postParameters.insert(post.at(0), post.at(1));
-                    }
-                }
-            }
-        }
-
-        QStringList splittedURI = requestLine.at(1).split('?', Qt::SkipEmptyParts);
-        if (splittedURI.count() > 1) {
-            m_urlParameters = Util::FormUrlCodec::decodeFormUrl(splittedURI.at(1).toUtf8());
-            // add get parameters
-            QStringList getData = splittedURI.at(1).split('&', Qt::SkipEmptyParts);
-            for (int i = 0; i < getData.count(); i++) {
-                QStringList get = getData.at(i).split('=', Qt::SkipEmptyParts);
-                if (get.count() == 2) {
-                    m_getParameters.insert(get.at(0), get.at(1));
-                }
-            }
-        }
-
-        m_uniqueResourceIdentifier = splittedURI.at(0);
-
-        m_version = requestLine.at(2);
-
-        QByteArray nextLine;
-        while (!(nextLine = takeLine(rawRequest)).isEmpty()) {
-            deserializeHeader(nextLine);
-        }
-
-        // By definition, all that follows after a \r\n\r\n is the body of the request.
-        m_body = QByteArray(rawRequest);
-        m_valid = true;
-    }
-
-    void Request::deserializeHeader(const QByteArray& rawHeader)
-    {
-        QString headerLine = QString::fromUtf8(rawHeader);
-        int colonPosition;
-        int headerLineLength = headerLine.count();
-        for (colonPosition = 0; colonPosition < headerLineLength; colonPosition++) {
-            if (headerLine.at(colonPosition) == ':') {
-                break;
-            }
-        }
+        RequestParser requestParser;
+        requestParser.feed(rawRequest);
 
-        if (colonPosition == headerLineLength) {
-            log(QString("Invalid header line found %1").arg(headerLine), Log::Warning);
+        // A request is only valid once its header is complete. The body may
+        // still be incomplete and can be appended to later.
+        if (requestParser.parse() == RequestParser::Error
+            || !requestParser.isHeaderComplete()) {
             return;
         }
 
-        QString headerName = headerLine.left(colonPosition);
-        QString headerValue = headerLine.right(headerLineLength - colonPosition - 1).trimmed();
-        m_headers.insert(headerName, headerValue);
+        *this = requestParser.takeRequest();
     }
 
 } // namespace Http
@@ -54,8 +54,16 @@ namespace Http {
      * single components.
      */
     class Request : public Logger {
+        friend class RequestParser;
+
     public:
         Request();
+
+        /**
+         * Parses a request with RequestParser. Data after the end of the
+         * first request is ignored, use RequestParser directly to read
+         * pipelined requests.
+         */
         Request(const QByteArray& rawRequest);
 
         /**
@@ -75,6 +83,15 @@ namespace Http {
         /** @returns the HTTP version for this request. */
         QString version() const;
 
+        /**
+         * @returns the parameters captured from the resource's unique
+         * identifier template when the request has been routed.
+         */
+        QMap<QString, QString> uriParameters() const;
+
+        /** Sets the parameters captured from the unique identifier template. */
+        void setUriParameters(const QMap<QString, QString>& uriParameters);
+
         /** @returns url parameters. */
         QMap<QString, QByteArray> urlParameters() const;
 
@@ -89,30 +106,59 @@ namespace Http {
         QString header(Header header) const;
         QString header(QString headerName) const;
 
+        /**
+         * @returns the raw value of the specified header. The view refers to
+         * the request's own data, so this does not allocate.
+         */
+        QByteArrayView rawHeader(Header header) const;
+
+        /**
+         * @returns the raw value of the header with the given name, which is
+         * matched ignoring case. This does not allocate.
+         */
+        QByteArrayView rawHeader(QByteArrayView headerName) const;
+
+        /** @returns all header fields of this request. */
+        const Headers& headerFields() const;
+
         /** @returns the body of the request. */
         QByteArray body() const;
 
-        void appendBodyData(QByteArray bodyData);
-
         /**
          * Determines whether the request is complete either based
          * on the content length or when all chunks have been transmitted
          */
         bool isComplete() const;
 
+        /** @returns true, if the body is sent with chunked transfer encoding. */
+        bool isChunked() const;
+
     private:
+        /** Returned by expectedBodyLength() if there is no Content-Length. */
+        static constexpr qint64 NoBodyLength = -1;
+
+        /** Returned by expectedBodyLength() if the Content-Length is malformed. */
+        static constexpr qint64 InvalidBodyLength = -2;
+
+        /**
+         * @returns the length announced by the Content-Length header,
+         * NoBodyLength if it is missing or InvalidBodyLength if it is not a
+         * plain decimal number.
+         */
+        qint64 expectedBodyLength() const;
+
         void setDefaults();
-        void deserialize(QByteArray rawRequest);
-        void deserializeHeader(const QByteArray& rawHeader);
-        QByteArray takeLine(QByteArray& rawRequest);
+        void deserialize(const QByteArray& rawRequest);
 
         QByteArray m_body;
         Http::Method m_method;
         QString m_uniqueResourceIdentifier;
         QString m_version;
         bool m_valid;
+        bool m_chunkedBodyComplete;
         QMap<QString, QByteArray> m_urlParameters;
-        QMap<QString, QString> m_headers;
+        QMap<QString, QString> m_uriParameters;
+        Headers m_headers;
         QMap<QString, QString> m_getParameters;
         QMap<QString, QString> m_postParameters;
     };
@@ -0,0 +1,535 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httprequestparser.h"
+#include "httpscanner.h"
+#include "util/utilformurlcodec.h"
+
+// Qt includes
+#include <QStringList>
+
+// Standard includes
+#include <cstring>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    namespace {
+        typedef struct {
+            const char* methodName;
+            int length;
+            Method method;
+        } MethodNamePair;
+
+        const MethodNamePair methodNameMap[] = {
+            { "GET", 3, Method::GET },
+            { "POST", 4, Method::POST },
+            { "HEAD", 4, Method::HEAD },
+            { "PUT", 3, Method::PUT },
+            { "DELETE", 6, Method::DELETE },
+            { "OPTIONS", 7, Method::OPTIONS },
+            { "TRACE", 5, Method::TRACE },
+            { "CONNECT", 7, Method::CONNECT }
+        };
+
+        Method methodFromToken(const char* data, int size)
+        {
+            for (const MethodNamePair& methodNamePair : methodNameMap) {
+                if (methodNamePair.length == size
+                    && memcmp(methodNamePair.methodName, data, size) == 0) {
+                    return methodNamePair.method;
+                }
+            }
+            return Method::UNKNOW;
+        }
+
+        bool isWhitespace(char c)
+        {
+            return c == ' ' || c == '\t';
+        }
+
+        // Characters allowed in a field name (RFC 9110 5.6.2).
+        bool isTokenCharacter(char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                || (c != 0 && strchr("!#$%&'*+-.^_`|~", c) != 0);
+        }
+
+        // Fields that control framing, routing, authentication or how the
+        // request is handled must not come from a trailer (RFC 9110 6.5.1).
+        // Framing has been decided by then, so such trailer fields are dropped.
+        const Header headersForbiddenInTrailer[] = {
+            CacheControl, Connection, ContentEncoding, ContentLength, ContentRange,
+            ContentType, Expect, Host, IfMatch, IfModifiedSince, IfNoneMatch,
+            IfRange, IfUnmodifiedSince, MaxForwards, Pragma, Authorization,
+            ProxyAuthenticate, ProxyAuthorization, Cookie, SetCookie, Range, TE,
+            Trailer, TransferEncoding, Upgrade, WWWAuthenticate
+        };
+
+        bool isAllowedInTrailer(const QByteArray& name)
+        {
+            int header = headerFromName(name);
+            if (header < 0) {
+                return name.compare("Keep-Alive", Qt::CaseInsensitive) != 0
+                    && !(name.size() >= 6 && qstrnicmp(name.constData(), 6, "Proxy-", 6) == 0);
+            }
+            for (Header forbidden : headersForbiddenInTrailer) {
+                if (header == forbidden) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Decoded chunks are dropped from the receive buffer once this much
+        // encoded data has piled up.
+        const int compactThreshold = 64 * 1024;
+    }
+
+    RequestParser::RequestParser()
+    {
+        m_maxHeaderSize = 64 * 1024;
+        m_maxBodySize = 64 * 1024 * 1024;
+        reset();
+    }
+
+    void RequestParser::feed(const QByteArray& data)
+    {
+        m_buffer.append(data);
+    }
+
+    RequestParser::Result RequestParser::parse()
+    {
+        const char* data = m_buffer.constData();
+        int size = m_buffer.size();
+
+        for (;;) {
+            switch (m_state) {
+            case StateRequestLine: {
+                int lineEnd = findLineEnd(m_position);
+                if (lineEnd < 0) {
+                    // Do not wait forever for the end of garbage or of a
+                    // request line that is too large.
+                    if (m_headerSize + size - m_position > m_maxHeaderSize
+                        || !isRequestLinePrefix(data + m_position, size - m_position)) {
+                        return fail();
+                    }
+                    return m_result = NeedMoreData;
+                }
+
+                int lineStart = m_position;
+                int lineLength = lineLengthWithoutCarriageReturn(lineStart, lineEnd);
+                if (!consumeHeaderLine(lineEnd)) {
+                    return fail();
+                }
+
+                // Empty lines preceding the request line are ignored.
+                if (lineLength == 0) {
+                    continue;
+                }
+                if (!parseRequestLine(data + lineStart, lineLength)) {
+                    return fail();
+                }
+                m_state = StateHeaders;
+                continue;
+            }
+
+            case StateHeaders: {
+                // Wait for the complete header block before looking at single
+                // lines. The scan for its end resumes where it stopped the last
+                // time, starting at the line ending before the current line.
+                if (m_headerEnd < 0) {
+                    int scanStart = qMax(m_position - 1, m_headerScanPosition);
+                    int headerEnd = Scanner::findHeaderEnd(data + scanStart, size - scanStart);
+                    if (headerEnd < 0) {
+                        if (m_headerSize + size - m_position > m_maxHeaderSize) {
+                            return fail();
+                        }
+                        // The empty line may straddle the end of the data.
+                        m_headerScanPosition = qMax(scanStart, size - 2);
+                        return m_result = NeedMoreData;
+                    }
+                    m_headerEnd = scanStart + headerEnd;
+
+                    // All header lines are in the buffer now. The header
+                    // fields refer to a copy of just the header block, so the
+                    // request does not keep the body and pipelined requests
+                    // alive, and appending to the receive buffer does not
+                    // have to copy it.
+                    m_request.m_headers.setBuffer(m_buffer.left(m_headerEnd));
+                }
+
+                // Scan for the colon and the line ending in one pass. There is
+                // always a line ending before the end of the header block.
+                int lineStart = m_position;
+                int colon = -1;
+                int lineEnd = lineStart + Scanner::findEitherByte(data + lineStart, m_headerEnd - lineStart, ':', '\n');
+                if (data[lineEnd] == ':') {
+                    colon = lineEnd - lineStart;
+                    lineEnd = findLineEnd(lineEnd + 1);
+                }
+
+                int lineLength = lineLengthWithoutCarriageReturn(lineStart, lineEnd);
+                if (!consumeHeaderLine(lineEnd)) {
+                    return fail();
+                }
+
+                if (lineLength == 0) {
+                    // By definition, all that follows after a \r\n\r\n is the
+                    // body of the request. A chunked transfer encoding takes
+                    // precedence over the content length.
+                    if (m_request.m_headers.contains(TransferEncoding)) {
+                        // Without chunked as the final coding, the body would
+                        // end with the connection, which requests cannot do.
+                        if (!m_request.isChunked()) {
+                            return fail();
+                        }
+                        m_request.m_valid = true;
+                        m_chunkedDecoder.reset();
+                        m_state = StateChunkedBody;
+                        continue;
+                    }
+
+                    // If we cannot tell where the body ends, we cannot tell
+                    // where the next request starts either. Guessing would let
+                    // a body be taken for a request, so we give up instead.
+                    m_bodyLength = m_request.expectedBodyLength();
+                    if (m_conflictingContentLengths || m_bodyLength == Request::InvalidBodyLength) {
+                        return fail();
+                    }
+                    if (m_bodyLength == Request::NoBodyLength) {
+                        m_bodyLength = 0;
+                    }
+                    if (m_bodyLength > m_maxBodySize) {
+                        return fail();
+                    }
+                    m_request.m_valid = true;
+                    m_state = StateBody;
+                    continue;
+                }
+
+                // A field that is not understood as sent could be taken for
+                // another one by the next hop, so such requests are refused.
+                if (!parseHeaderLine(lineStart, lineLength, colon)) {
+                    return fail();
+                }
+                continue;
+            }
+
+            case StateBody:
+                if (size - m_position < m_bodyLength) {
+                    return m_result = NeedMoreData;
+                }
+
+                m_request.m_body = m_buffer.mid(m_position, m_bodyLength);
+                m_position += m_bodyLength;
+                return complete();
+
+            case StateChunkedBody: {
+                // Only the data that has arrived since the last call is
+                // decoded, straight into the body.
+                int consumed = 0;
+                ChunkedDecoder::Result result = m_chunkedDecoder.decode(data + m_position,
+                    size - m_position, consumed, m_request.m_body);
+                m_position += consumed;
+
+                if (result == ChunkedDecoder::Error || m_request.m_body.size() > m_maxBodySize) {
+                    return fail();
+                }
+
+                if (result == ChunkedDecoder::NeedMoreData) {
+                    // Drop the encoded data that has been decoded already, so
+                    // long uploads are not kept twice in memory.
+                    if (m_position >= compactThreshold) {
+                        m_buffer.remove(0, m_position);
+                        m_position = 0;
+                    }
+                    return m_result = NeedMoreData;
+                }
+
+                typedef QPair<QByteArray, QByteArray> TrailerField;
+                foreach (const TrailerField& trailer, m_chunkedDecoder.trailers()) {
+                    if (isAllowedInTrailer(trailer.first)) {
+                        m_request.m_headers.setValue(trailer.first, trailer.second);
+                    }
+                }
+                m_request.m_chunkedBodyComplete = true;
+                return complete();
+            }
+
+            case StateComplete:
+                return m_result = Complete;
+
+            case StateError:
+                return m_result = Error;
+            }
+        }
+    }
+
+    RequestParser::Result RequestParser::result() const
+    {
+        return m_result;
+    }
+
+    bool RequestParser::isHeaderComplete() const
+    {
+        return m_state == StateBody || m_state == StateChunkedBody || m_state == StateComplete;
+    }
+
+    Request RequestParser::takeRequest()
+    {
+        Request request = m_request;
+        if (m_state == StateBody) {
+            // Hand out what we have got of the body so far.
+            request.m_body = m_buffer.mid(m_position);
+            m_position = m_buffer.size();
+        }
+
+        // Discard the data of this request at once, instead of line by line.
+        m_buffer.remove(0, m_position);
+        m_position = 0;
+        m_headerSize = 0;
+        m_headerEnd = -1;
+        m_headerScanPosition = 0;
+        m_bodyLength = 0;
+        m_conflictingContentLengths = false;
+        m_state = StateRequestLine;
+        m_result = NeedMoreData;
+        m_request = Request();
+        return request;
+    }
+
+    QByteArray RequestParser::bufferedData() const
+    {
+        return m_buffer;
+    }
+
+    bool RequestParser::isEmpty() const
+    {
+        return m_buffer.isEmpty();
+    }
+
+    void RequestParser::reset()
+    {
+        m_buffer.clear();
+        m_position = 0;
+        m_headerSize = 0;
+        m_headerEnd = -1;
+        m_headerScanPosition = 0;
+        m_bodyLength = 0;
+        m_conflictingContentLengths = false;
+        m_state = StateRequestLine;
+        m_result = NeedMoreData;
+        m_request = Request();
+    }
+
+    int RequestParser::maxHeaderSize() const
+    {
+        return m_maxHeaderSize;
+    }
+
+    void RequestParser::setMaxHeaderSize(int maxHeaderSize)
+    {
+        m_maxHeaderSize = maxHeaderSize;
+    }
+
+    int RequestParser::maxBodySize() const
+    {
+        return m_maxBodySize;
+    }
+
+    void RequestParser::setMaxBodySize(int maxBodySize)
+    {
+        m_maxBodySize = qBound(0, maxBodySize, MaxBodySizeLimit);
+    }
+
+    int RequestParser::findLineEnd(int from) const
+    {
+        int lineEnd = Scanner::findByte(m_buffer.constData() + from, m_buffer.size() - from, '\n');
+        return lineEnd < 0 ? -1 : from + lineEnd;
+    }
+
+    int RequestParser::lineLengthWithoutCarriageReturn(int lineStart, int lineEnd) const
+    {
+        // Lines in the HTTP protocol are defined to be separated by '\r\n',
+        // but we also accept a bare '\n'.
+        int lineLength = lineEnd - lineStart;
+        if (lineLength > 0 && m_buffer.at(lineEnd - 1) == '\r') {
+            lineLength--;
+        }
+        return lineLength;
+    }
+
+    bool RequestParser::consumeHeaderLine(int lineEnd)
+    {
+        m_headerSize += lineEnd + 1 - m_position;
+        m_position = lineEnd + 1;
+        return m_headerSize <= m_maxHeaderSize;
+    }
+
+    bool RequestParser::isRequestLinePrefix(const char* data, int size) const
+    {
+        // Without the complete line we can at least check that the method is
+        // made of upper case letters. This tells HTTP apart from an SSL
+        // handshake or other binary data right away.
+        for (int i = 0; i < size; i++) {
+            char c = data[i];
+            if (c == ' ') {
+                return i > 0;
+            }
+            if (c == '\r') {
+                return i == size - 1;
+            }
+            if (c < 'A' || c > 'Z') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool RequestParser::parseRequestLine(const char* data, int size)
+    {
+        // The request line has to contain three strings: The method string,
+        // the request uri and the HTTP version. If we were strict, we
+        // shouldn't even accept anything larger than four strings, but we're
+        // permissive here.
+        const char* tokens[3];
+        int tokenSizes[3];
+        int tokenCount = 0;
+        int position = 0;
+        while (tokenCount < 3) {
+            while (position < size && isWhitespace(data[position])) {
+                position++;
+            }
+            if (position == size) {
+                break;
+            }
+
+            int tokenStart = position;
+            while (position < size && !isWhitespace(data[position])) {
+                position++;
+            }
+            tokens[tokenCount] = data + tokenStart;
+            tokenSizes[tokenCount] = position - tokenStart;
+            tokenCount++;
+        }
+
+        if (tokenCount < 3) {
+            return false;
+        }
+
+        m_request.m_method = methodFromToken(tokens[0], tokenSizes[0]);
+
+        const char* uri = tokens[1];
+        int uriSize = tokenSizes[1];
+        const char* questionMark = (const char*)memchr(uri, '?', uriSize);
+        if (questionMark) {
+            int pathSize = questionMark - uri;
+            QByteArray query(questionMark + 1, uriSize - pathSize - 1);
+            if (!query.isEmpty()) {
+                m_request.m_urlParameters = Util::FormUrlCodec::decodeFormUrl(query);
+                // add get parameters
+                parseParameters(query, m_request.m_getParameters);
+            }
+            uriSize = pathSize;
+        }
+
+        m_request.m_uniqueResourceIdentifier = QString::fromUtf8(uri, uriSize);
+        m_request.m_version = QString::fromLatin1(tokens[2], tokenSizes[2]);
+        return true;
+    }
+
+    bool RequestParser::parseHeaderLine(int lineStart, int lineLength, int colon)
+    {
+        // Lines without a colon and obsolete line folding, which starts a
+        // line with whitespace, are not accepted (RFC 9112 5.1, 5.2). No
+        // whitespace is allowed between the name and the colon either.
+        if (colon <= 0) {
+            return false;
+        }
+
+        const char* data = m_buffer.constData() + lineStart;
+        for (int i = 0; i < colon; i++) {
+            if (!isTokenCharacter(data[i])) {
+                return false;
+            }
+        }
+
+        int valueStart = colon + 1;
+        int valueEnd = lineLength;
+        while (valueStart < valueEnd && isWhitespace(data[valueStart])) {
+            valueStart++;
+        }
+        while (valueEnd > valueStart && isWhitespace(data[valueEnd - 1])) {
+            valueEnd--;
+        }
+
+        // Only the last of several Content-Length fields is kept, so they
+        // have to agree.
+        if (m_request.m_headers.contains(ContentLength)
+            && headerFromName(QByteArrayView(data, colon)) == ContentLength
+            && m_request.m_headers.value(ContentLength) != QByteArrayView(data + valueStart, valueEnd - valueStart)) {
+            m_conflictingContentLengths = true;
+        }
+
+        // Only remember where name and value are, the header refers to its
+        // copy of the header block.
+        m_request.m_headers.appendField(lineStart, colon,
+            lineStart + valueStart, valueEnd - valueStart);
+        return true;
+    }
+
+    void RequestParser::parseParameters(const QByteArray& data, QMap<QString, QString>& parameters)
+    {
+        QStringList pairs = QString::fromUtf8(data).split('&', Qt::SkipEmptyParts);
+        for (int i = 0; i < pairs.count(); i++) {
+            QStringList pair = pairs.at(i).split('=', Qt::SkipEmptyParts);
+            if (pair.count() == 2) {
+                parameters.insert(pair.at(0), pair.at(1));
+            }
+        }
+    }
+
+    RequestParser::Result RequestParser::complete()
+    {
+        // add post paremeters
+        if (m_request.m_method == Method::POST) {
+            QTWEBSERVER_LOG(m_request, Log::Verbose, "We get POST!");
+            parseParameters(m_request.m_body, m_request.m_postParameters);
+        }
+
+        m_state = StateComplete;
+        return m_result = Complete;
+    }
+
+    RequestParser::Result RequestParser::fail()
+    {
+        m_state = StateError;
+        return m_result = Error;
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,160 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "httpchunkeddecoder.h"
+#include "httprequest.h"
+
+// Qt includes
+#include <QByteArray>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * @class RequestParser
+     * Incremental HTTP request parser. Data is appended to a single receive
+     * buffer and parsed in place by a resumable state machine that only keeps
+     * offsets into the buffer, so nothing is parsed twice when a request
+     * arrives in several pieces.
+     */
+    class RequestParser {
+    public:
+        /**
+         * @brief The Result enum
+         */
+        enum Result {
+            NeedMoreData, /** The request is not complete yet. */
+            Complete, /** A complete request can be taken. */
+            Error /** The data is not a valid HTTP request. */
+        };
+
+        RequestParser();
+
+        /**
+         * Appends data to the receive buffer. Call parse() afterwards.
+         * @param data The data received.
+         */
+        void feed(const QByteArray& data);
+
+        /**
+         * Continues parsing where the last call stopped.
+         * @returns the parse result.
+         */
+        Result parse();
+
+        /** @returns the result of the last call to parse(). */
+        Result result() const;
+
+        /** @returns true, if the header of the current request has been parsed. */
+        bool isHeaderComplete() const;
+
+        /**
+         * Takes the current request and discards its data from the receive
+         * buffer, so parsing can continue with the next request. If the
+         * request is not complete yet, it contains the body received so far.
+         * @returns the request.
+         */
+        Request takeRequest();
+
+        /** @returns the buffered data that has not been taken yet. */
+        QByteArray bufferedData() const;
+
+        /** @returns true, if there is no buffered data. */
+        bool isEmpty() const;
+
+        /** Discards all buffered data and resets the parser state. */
+        void reset();
+
+        /** @returns the maximum size of a request header in bytes. */
+        int maxHeaderSize() const;
+
+        /** Sets the maximum size of a request header in bytes. */
+        void setMaxHeaderSize(int maxHeaderSize);
+
+        /** @returns the maximum size of a request body in bytes. */
+        int maxBodySize() const;
+
+        /**
+         * Sets the maximum size of a request body in bytes, after decoding a
+         * chunked body. Requests announcing or sending a larger body are an
+         * error. Bodies are kept in memory, so the size is limited to 1 GiB.
+         */
+        void setMaxBodySize(int maxBodySize);
+
+        /** Upper bound for the maximum body size, keeping offsets in range. */
+        static constexpr int MaxBodySizeLimit = 1024 * 1024 * 1024;
+
+    private:
+        enum State {
+            StateRequestLine,
+            StateHeaders,
+            StateBody,
+            StateChunkedBody,
+            StateComplete,
+            StateError
+        };
+
+        /** @returns the position of the next '\n' at or after from, or -1. */
+        int findLineEnd(int from) const;
+
+        /** @returns the length of a line without its line ending. */
+        int lineLengthWithoutCarriageReturn(int lineStart, int lineEnd) const;
+
+        /**
+         * Moves past a line of the header.
+         * @returns false, if the header has become too large.
+         */
+        bool consumeHeaderLine(int lineEnd);
+
+        /** @returns true, if the given unterminated request line can be valid. */
+        bool isRequestLinePrefix(const char* data, int size) const;
+
+        bool parseRequestLine(const char* data, int size);
+        bool parseHeaderLine(int lineStart, int lineLength, int colon);
+        void parseParameters(const QByteArray& data, QMap<QString, QString>& parameters);
+
+        Result complete();
+        Result fail();
+
+        QByteArray m_buffer;
+        int m_position;
+        int m_headerSize;
+        int m_headerEnd;
+        int m_headerScanPosition;
+        qint64 m_bodyLength;
+        bool m_conflictingContentLengths;
+        int m_maxHeaderSize;
+        int m_maxBodySize;
+        State m_state;
+        Result m_result;
+        Request m_request;
+        ChunkedDecoder m_chunkedDecoder;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
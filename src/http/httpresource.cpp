@@ -23,9 +23,7 @@
 
 // Own includes
 #include "httpresource.h"
-
-// Qt includes
-#include <QStringList>
+#include "httprouter.h"
 
 namespace QtWebServer {
 
@@ -34,70 +32,75 @@ namespace Http {
     Resource::Resource(QString uniqueIdentifier,
         QObject* parent)
         : QObject(parent)
+        , m_workerPool(0)
+        , m_matchesTemplateOnly(0)
     {
         m_uniqueIdentifier = uniqueIdentifier;
     }
 
     bool Resource::match(QString uniqueIdentifier)
     {
-        // Split both the unique identifier of this resource the one in question,
-        // so we can compare those.
-        QStringList splittedReferenceUri = this->uniqueIdentifier().split("/", Qt::SkipEmptyParts);
-        QStringList splittedRequestedUri = uniqueIdentifier.split("/", Qt::SkipEmptyParts);
-
-        int count = splittedRequestedUri.count();
-
-        // In case we have a different depth, the unique identifiers cannot match.
-        if (splittedReferenceUri.count() != count) {
-            return false;
-        }
-
-        // Compare each part of the passed unique identifier.
-        for (int depth = 0; depth < count; depth++) {
-            // In case we have a variable, we do not need an exact match.
-            if (splittedReferenceUri.at(depth).startsWith("{") && splittedReferenceUri.at(depth).endsWith("}")) {
-                continue;
-            }
+        // Compare the template of this resource segment by segment, without
+        // splitting it into separate strings.
+        return Router::matchTemplate(this->uniqueIdentifier(), uniqueIdentifier, 0);
+    }
 
-            // Otherwise, we expect the unique idenfier parts to match exactly.
-            if (splittedReferenceUri.at(depth) != splittedRequestedUri.at(depth)) {
-                return false;
-            }
-        }
+    bool Resource::matchesTemplateOnly() const
+    {
+        return m_matchesTemplateOnly.loadRelaxed() != 0;
+    }
 
-        return true;
+    void Resource::setMatchesTemplateOnly(bool templateOnly)
+    {
+        m_matchesTemplateOnly.storeRelaxed(templateOnly ? 1 : 0);
     }
 
     QMap<QString, QString> Resource::uriParameters(QString uniqueIdentifier)
     {
-        // Split both the unique identifier of this resource the one in question,
-        // so we can compare those.
-        QStringList splittedReferenceUri = this->uniqueIdentifier().split("/", Qt::SkipEmptyParts);
-        QStringList splittedRequestedUri = uniqueIdentifier.split("/", Qt::SkipEmptyParts);
-
-        // Create a parameter map.
         QMap<QString, QString> uriParameterMap;
+        if (!Router::matchTemplate(this->uniqueIdentifier(), uniqueIdentifier, &uriParameterMap)) {
+            // In case the unique identifiers do not match, there are no parameters.
+            uriParameterMap.clear();
+        }
+        return uriParameterMap;
+    }
 
-        int count = splittedRequestedUri.count();
+    WorkerPool* Resource::workerPool() const
+    {
+        return m_workerPool.loadAcquire();
+    }
 
-        // In case we have a different depth, the unique identifiers cannot match.
-        if (splittedReferenceUri.count() != count) {
-            return uriParameterMap;
-        }
+    void Resource::setWorkerPool(WorkerPool* workerPool)
+    {
+        m_workerPool.storeRelease(workerPool);
+    }
+
+    void Resource::deliverAsync(const Http::Request& request, Http::ResponseHandle responseHandle)
+    {
+        // The pending response keeps the resource alive until it is complete.
+        WorkerPool* pool = m_workerPool.loadAcquire();
+        if (pool) {
+            bool started = pool->tryStart([this, request, responseHandle]() mutable {
+                Response response;
+                deliver(request, response);
+                responseHandle.complete(response);
+            });
+            if (started) {
+                return;
+            }
 
-        // Compare each part of the passed unique identifier.
-        for (int depth = 0; depth < count; depth++) {
-            QString uriSegment = splittedReferenceUri.at(depth);
-            if (uriSegment.startsWith("{") && uriSegment.endsWith("}")) {
-                // Truncate the { and }
-                uriSegment = uriSegment.mid(1, uriSegment.count() - 2);
-                QString key = uriSegment;
-                QString value = splittedRequestedUri.at(depth);
-                uriParameterMap.insert(key, value);
+            if (pool->rejectionPolicy() == WorkerPool::RejectWhenFull) {
+                Response response;
+                response.setStatusCode(ServiceUnavailable);
+                response.setHeader(RetryAfter, "1");
+                responseHandle.complete(response);
+                return;
             }
         }
 
-        return uriParameterMap;
+        Response response;
+        deliver(request, response);
+        responseHandle.complete(response);
     }
 
     QString Resource::uniqueIdentifier()
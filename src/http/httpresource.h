@@ -26,9 +26,13 @@
 // Own includes
 #include "httprequest.h"
 #include "httpresponse.h"
+#include "httpresponsehandle.h"
 #include "misc/threadsafety.h"
+#include "misc/workerpool.h"
 
 // Qt includes
+#include <QAtomicInt>
+#include <QAtomicPointer>
 #include <QObject>
 #include <QString>
 
@@ -52,14 +56,33 @@ namespace Http {
         /**
          * Resource matching method. The default implementation matches
          * the unique identifier against a template that allows variable uris.
+         * The web engine routes by template and asks match() to confirm the
+         * resource found that way, and asks all resources in the order they
+         * have been added if no template matches. Resources that do not
+         * reimplement match() can skip this, see setMatchesTemplateOnly().
          *
          * @attention: This method may be called from multiple threads. You are
          * not allowed to perform any operations that are not threadsafe.
          */
         virtual bool match(QString uniqueIdentifier);
 
+        /** @returns true, if the web engine routes by template without consulting match(). */
+        bool matchesTemplateOnly() const;
+
+        /**
+         * Lets the web engine route requests to this resource by its template
+         * alone, so match() is not called for it. Requests that no template
+         * matches then do not have to ask this resource, which keeps them
+         * cheap when there are many resources. Only enable this if match()
+         * is not reimplemented, and before the resource is added.
+         * @param templateOnly true, to skip match().
+         */
+        void setMatchesTemplateOnly(bool templateOnly);
+
         /**
          * Parses the passed unique identifier and returns a map of uri parameters.
+         * Requests routed by the web engine carry their parameters already,
+         * see Request::uriParameters().
          * @param uniqueIdentifier The unique identifier to parse.
          * @returns a map of uri parameters parsed from the give identifier.
          */
@@ -91,9 +114,39 @@ namespace Http {
         /** Defines the resource's response behaviour. */
         virtual void deliver(const Http::Request& request, Http::Response& response) = 0;
 
+        /** @returns the pool responses are delivered in, or 0. */
+        WorkerPool* workerPool() const;
+
+        /**
+         * Lets responses be delivered by a worker pool instead of the thread
+         * serving the connection, which then only reads requests and writes
+         * responses. This keeps CPU-heavy resources from delaying other
+         * connections. deliver() has to be thread-safe then. If the pool is
+         * full, the request is answered with 503 Service Unavailable or
+         * delivered in the connection's thread, depending on the pool's
+         * rejection policy. The pool is not owned by the resource.
+         * @param workerPool The pool, or 0 to deliver in the connection's thread.
+         */
+        void setWorkerPool(WorkerPool* workerPool);
+
+        /**
+         * Delivers a response that may be completed later, for example once
+         * a database query has finished. The handle may be kept and completed
+         * from any thread after returning, the connection does not occupy its
+         * thread meanwhile. The default implementation completes the response
+         * with deliver(), in the worker pool if one has been set.
+         * @param request The request to respond to.
+         * @param responseHandle The handle to complete the response with.
+         */
+        virtual void deliverAsync(const Http::Request& request, Http::ResponseHandle responseHandle);
+
     private:
         ThreadGuard<QString> m_uniqueIdentifier;
         ThreadGuard<QString> m_contentType;
+
+        /** Read for every request, so it is not guarded by a lock. */
+        QAtomicPointer<WorkerPool> m_workerPool;
+        QAtomicInt m_matchesTemplateOnly;
     };
 
 } // namespace Http
@@ -21,9 +21,6 @@
 // Please contact Jacob Dawid <jacob@omg-it.works>
 //
 
-// Qt includes
-#include <QStringBuilder>
-
 // Own includes
 #include "httpresponse.h"
 
@@ -31,38 +28,76 @@ namespace QtWebServer {
 
 namespace Http {
 
+    namespace {
+
+        /** Body devices may be deleted while they are emitting a signal. */
+        void deleteBodyDevice(QIODevice* device)
+        {
+            device->deleteLater();
+        }
+
+    } // namespace
+
     Response::Response()
         : Logger("WebServer::Http::Response")
     {
         m_statusCode = Http::Ok;
         m_body = "";
+        m_bodySize = -1;
     }
 
     QByteArray Response::toByteArray()
     {
-        QByteArray response = "";
+        QByteArray response = headerToByteArray();
+
+        // Append the response body. A streamed body is sent separately.
+        if (!m_bodyDevice) {
+            response += m_body;
+        }
+        return response;
+    }
+
+    QByteArray Response::headerToByteArray()
+    {
+        // Let the client know where the body ends, so the connection can be
+        // reused for further requests. Chunked bodies end with their last chunk.
+        if (!isBodyless() && !m_headers.contains(ContentLength) && !m_headers.contains(TransferEncoding)) {
+            if (!m_bodyDevice) {
+                m_headers.setValue(ContentLength, QByteArray::number(m_body.size()));
+            } else if (m_bodySize >= 0) {
+                m_headers.setValue(ContentLength, QByteArray::number(m_bodySize));
+            }
+        }
+
+        QByteArray reason = Http::reasonPhrase(m_statusCode).toUtf8();
+
+        // Reserve enough space for the whole response up front.
+        qsizetype size = 32 + reason.size() + (m_bodyDevice ? 0 : m_body.size());
+        for (int i = 0; i < m_headers.count(); i++) {
+            size += m_headers.name(i).size() + m_headers.value(i).size() + 4;
+        }
+
+        QByteArray response;
+        response.reserve(size);
 
         // HTTP response header line.
-        response += QString("HTTP/1.1 %1 %2\r\n")
-                        .arg(m_statusCode)
-                        .arg(Http::reasonPhrase(m_statusCode))
-                        .toUtf8();
+        response += "HTTP/1.1 ";
+        response += QByteArray::number(m_statusCode);
+        response += ' ';
+        response += reason;
+        response += "\r\n";
 
         // Append HTTP headers.
-        QStringList headerNames = m_headers.keys();
-        foreach (QString headerName, headerNames) {
-            response += QString("%1: %2\r\n")
-                            .arg(headerName)
-                            .arg(m_headers.value(headerName))
-                            .toUtf8();
+        for (int i = 0; i < m_headers.count(); i++) {
+            response.append(m_headers.name(i));
+            response += ": ";
+            response.append(m_headers.value(i));
+            response += "\r\n";
         }
 
         // Add empty line to mark the end of the header.
         response += "\r\n";
 
-        // Append the response body.
-        response += m_body;
-
         return response;
     }
 
@@ -86,24 +121,76 @@ namespace Http {
         m_body = body;
     }
 
+    void Response::setBodyDevice(QIODevice* device, qint64 size)
+    {
+        m_body.clear();
+        if (device) {
+            // The device is owned by the response from now on.
+            device->setParent(0);
+            m_bodyDevice.reset(device, &deleteBodyDevice);
+        } else {
+            m_bodyDevice.reset();
+        }
+        m_bodySize = size;
+    }
+
+    void Response::discardBody()
+    {
+        if (!isBodyless() && !m_headers.contains(ContentLength) && !m_headers.contains(TransferEncoding)) {
+            if (!m_bodyDevice) {
+                m_headers.setValue(ContentLength, QByteArray::number(m_body.size()));
+            } else if (m_bodySize >= 0) {
+                m_headers.setValue(ContentLength, QByteArray::number(m_bodySize));
+            }
+        }
+
+        if (m_bodyDevice) {
+            m_bodyDevice.reset();
+            m_bodySize = -1;
+        }
+        m_body.clear();
+    }
+
+    bool Response::isBodyless() const
+    {
+        // Informational, 204 and 304 responses end with their header. A 304
+        // would announce the size of the cached representation otherwise.
+        return m_statusCode < 200 || m_statusCode == NoContent || m_statusCode == NotModified;
+    }
+
+    QIODevice* Response::bodyDevice() const
+    {
+        return m_bodyDevice.get();
+    }
+
+    qint64 Response::bodySize() const
+    {
+        return m_bodySize;
+    }
+
     void Response::setHeader(Header header, QString headerValue)
     {
-        setHeader(headerName(header), headerValue);
+        m_headers.setValue(header, headerValue.toUtf8());
     }
 
     void Response::setHeader(QString headerName, QString headerValue)
     {
-        m_headers.insert(headerName, headerValue);
+        m_headers.setValue(headerName.toUtf8(), headerValue.toUtf8());
     }
 
     QString Response::header(Header header) const
     {
-        return this->header(headerName(header));
+        return QString::fromUtf8(m_headers.value(header));
     }
 
     QString Response::header(QString headerName) const
     {
-        return m_headers.value(headerName);
+        return QString::fromUtf8(m_headers.value(headerName.toUtf8()));
+    }
+
+    const Headers& Response::headerFields() const
+    {
+        return m_headers;
     }
 
 } // namespace Http
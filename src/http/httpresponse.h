@@ -31,8 +31,12 @@
 
 // Qt includes
 #include <QByteArray>
+#include <QIODevice>
 #include <QNetworkReply>
 
+// Standard includes
+#include <memory>
+
 namespace QtWebServer {
 
 namespace Http {
@@ -42,6 +46,8 @@ namespace Http {
      * @date 23.11.2013
      */
     class Response : public Logger {
+        friend class ConnectionState;
+
     public:
         /**
          * @brief Constructor.
@@ -55,6 +61,13 @@ namespace Http {
          */
         QByteArray toByteArray();
 
+        /**
+         * @brief Converts the status line and the headers into a byte array,
+         * including the empty line that ends the header.
+         * @returns The resulting byte array.
+         */
+        QByteArray headerToByteArray();
+
         /**
          * @returns The status code of this response.
          */
@@ -78,6 +91,39 @@ namespace Http {
          */
         void setBody(QByteArray body);
 
+        /**
+         * @brief Streams the response body from a device instead of sending a
+         * body held in memory. The body is read from the device while it is
+         * being sent, as fast as the client receives it. If the size is known,
+         * it is sent as Content-Length, otherwise the body is sent with chunked
+         * transfer encoding and ends when the device has no more data.
+         * The response takes ownership of the device and shares it with its
+         * copies. The device is deleted with deleteLater() once the body has
+         * been sent, or once the last copy is dropped or its body replaced
+         * or discarded, so it must not be deleted by anyone else.
+         * @param device An open device to read the body from.
+         * @param size The size of the body, or -1 if it is not known yet.
+         */
+        void setBodyDevice(QIODevice* device, qint64 size = -1);
+
+        /**
+         * @returns The device the response body is streamed from, or 0 if the
+         * body is held in memory.
+         */
+        QIODevice* bodyDevice() const;
+
+        /**
+         * @returns The size of the streamed response body, or -1 if it is not
+         * known.
+         */
+        qint64 bodySize() const;
+
+        /**
+         * Drops the body while keeping its size in the Content-Length header,
+         * as a response to a HEAD request has to. A body device is deleted.
+         */
+        void discardBody();
+
         /**
          * Set header value.
          * @param header The HTTP header to be set.
@@ -98,10 +144,18 @@ namespace Http {
         /** @returns the value of the specified header. */
         QString header(QString headerName) const;
 
+        /** @returns all header fields of this response. */
+        const Headers& headerFields() const;
+
     private:
+        /** @returns true, if responses with the status code never have a body. */
+        bool isBodyless() const;
+
         Http::StatusCode m_statusCode;
-        QMap<QString, QString> m_headers;
+        Headers m_headers;
         QByteArray m_body;
+        std::shared_ptr<QIODevice> m_bodyDevice;
+        qint64 m_bodySize;
     };
 
 } // Http
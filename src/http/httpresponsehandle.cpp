@@ -0,0 +1,130 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpresponsehandle.h"
+#include "httpconnectionstate.h"
+
+// Qt includes
+#include <QMetaObject>
+#include <QMutexLocker>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    DeferredResponse::DeferredResponse(std::shared_ptr<ConnectionGuard> connectionGuard, Finisher finisher)
+        : m_connectionGuard(connectionGuard)
+        , m_thread(QThread::currentThread())
+        , m_finisher(finisher)
+        , m_completed(0)
+        , m_delivering(false)
+    {
+    }
+
+    DeferredResponse::~DeferredResponse()
+    {
+        // Otherwise the connection would wait for the response forever.
+        if (!isCompleted()) {
+            Response response;
+            response.setStatusCode(InternalServerError);
+            complete(response);
+        }
+    }
+
+    void DeferredResponse::setDelivering(bool delivering)
+    {
+        m_delivering = delivering;
+    }
+
+    bool DeferredResponse::complete(const Response& response)
+    {
+        if (!m_completed.testAndSetOrdered(0, 1)) {
+            return false;
+        }
+
+        // Completed while delivering, the usual case for synchronous resources.
+        if (QThread::currentThread() == m_thread && m_delivering) {
+            Response completedResponse = response;
+            m_finisher(completedResponse, false);
+            return true;
+        }
+
+        // The guard keeps the connection from being destroyed while the
+        // response is posted to it. Once posted, the response is dropped
+        // along with the connection, which releases its body device.
+        QMutexLocker mutexLocker(&m_connectionGuard->mutex);
+        ConnectionState* connection = m_connectionGuard->connection;
+        if (!connection) {
+            return false;
+        }
+
+        // Only the thread a device belongs to can move it to another thread.
+        QIODevice* bodyDevice = response.bodyDevice();
+        if (bodyDevice && bodyDevice->thread() != m_thread) {
+            bodyDevice->setParent(0);
+            bodyDevice->moveToThread(m_thread);
+        }
+
+        Finisher finisher = m_finisher;
+        QMetaObject::invokeMethod(
+            connection, [finisher, response]() {
+                Response completedResponse = response;
+                finisher(completedResponse, true);
+            },
+            Qt::QueuedConnection);
+        return true;
+    }
+
+    bool DeferredResponse::isCompleted() const
+    {
+        return m_completed.loadAcquire() != 0;
+    }
+
+    ResponseHandle::ResponseHandle()
+    {
+    }
+
+    ResponseHandle::ResponseHandle(std::shared_ptr<DeferredResponse> deferredResponse)
+        : m_deferredResponse(deferredResponse)
+    {
+    }
+
+    bool ResponseHandle::isValid() const
+    {
+        return m_deferredResponse != nullptr;
+    }
+
+    bool ResponseHandle::isCompleted() const
+    {
+        return m_deferredResponse && m_deferredResponse->isCompleted();
+    }
+
+    bool ResponseHandle::complete(const Response& response)
+    {
+        return m_deferredResponse && m_deferredResponse->complete(response);
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,125 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "httpresponse.h"
+
+// Qt includes
+#include <QAtomicInt>
+#include <QThread>
+
+// Standard includes
+#include <functional>
+#include <memory>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    struct ConnectionGuard;
+
+    /**
+     * @class DeferredResponse
+     * State shared by the handles of a response that may be completed after
+     * delivering has returned. Used by the web engine, resources use
+     * ResponseHandle.
+     */
+    class DeferredResponse {
+    public:
+        /**
+         * Called in the thread of the connection with the completed response.
+         * The second argument is true, if the response has been completed
+         * after delivering has returned.
+         */
+        typedef std::function<void(Response&, bool)> Finisher;
+
+        DeferredResponse(std::shared_ptr<ConnectionGuard> connectionGuard, Finisher finisher);
+
+        /** Completes the response with an error, if nobody has completed it. */
+        ~DeferredResponse();
+
+        /**
+         * Marks the response as being delivered. Completing it meanwhile in
+         * the thread of the connection finishes it right away.
+         */
+        void setDelivering(bool delivering);
+
+        /** @see ResponseHandle::complete() */
+        bool complete(const Response& response);
+
+        /** @returns true, if the response has been completed. */
+        bool isCompleted() const;
+
+    private:
+        Q_DISABLE_COPY(DeferredResponse)
+
+        std::shared_ptr<ConnectionGuard> m_connectionGuard;
+        QThread* m_thread;
+        Finisher m_finisher;
+        QAtomicInt m_completed;
+        bool m_delivering;
+    };
+
+    /**
+     * @class ResponseHandle
+     * Refers to a response that a resource completes when it is ready. The
+     * handle may be copied and completed from any thread. Meanwhile the
+     * connection waits without occupying its thread, and responses to later
+     * requests on the same connection are held back to keep them in order.
+     * If the last copy of a handle is destroyed without completing the
+     * response, the client gets an internal server error.
+     */
+    class ResponseHandle {
+    public:
+        /** Creates a handle that does not refer to a response. */
+        ResponseHandle();
+
+        /** @returns true, if the handle refers to a response. */
+        bool isValid() const;
+
+        /** @returns true, if the response has been completed. */
+        bool isCompleted() const;
+
+        /**
+         * Completes the response. Only the first call takes effect. A streamed
+         * body device must not have a parent, as it is moved to the thread of
+         * the connection.
+         * @param response The response to send.
+         * @returns true, if the response will be sent. Returns false, if it
+         * has been completed before or the client has gone away.
+         */
+        bool complete(const Response& response);
+
+    private:
+        friend class WebEngine;
+
+        explicit ResponseHandle(std::shared_ptr<DeferredResponse> deferredResponse);
+
+        std::shared_ptr<DeferredResponse> m_deferredResponse;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,143 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpresponsestream.h"
+
+// Standard includes
+#include <cstring>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    ResponseStream::ResponseStream(QObject* parent)
+        : QIODevice(parent)
+        , m_firstChunkOffset(0)
+        , m_pending(0)
+        , m_highWaterMark(1024 * 1024)
+        , m_full(false)
+        , m_finished(false)
+    {
+        // We keep our own buffer, so there is no need for QIODevice's.
+        open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    }
+
+    ResponseStream::~ResponseStream()
+    {
+    }
+
+    bool ResponseStream::isSequential() const
+    {
+        return true;
+    }
+
+    qint64 ResponseStream::bytesAvailable() const
+    {
+        return m_pending + QIODevice::bytesAvailable();
+    }
+
+    bool ResponseStream::atEnd() const
+    {
+        // A stream that is not finished may still receive data.
+        return m_finished && m_pending == 0;
+    }
+
+    void ResponseStream::finish()
+    {
+        if (m_finished) {
+            return;
+        }
+        m_finished = true;
+        emit readChannelFinished();
+    }
+
+    bool ResponseStream::isFinished() const
+    {
+        return m_finished;
+    }
+
+    bool ResponseStream::isFull() const
+    {
+        return m_pending >= m_highWaterMark;
+    }
+
+    qint64 ResponseStream::highWaterMark() const
+    {
+        return m_highWaterMark;
+    }
+
+    void ResponseStream::setHighWaterMark(qint64 highWaterMark)
+    {
+        m_highWaterMark = highWaterMark;
+    }
+
+    qint64 ResponseStream::readData(char* data, qint64 maxSize)
+    {
+        qint64 bytesRead = 0;
+        while (bytesRead < maxSize && !m_chunks.isEmpty()) {
+            const QByteArray& chunk = m_chunks.first();
+            qint64 count = qMin(maxSize - bytesRead, chunk.size() - m_firstChunkOffset);
+            memcpy(data + bytesRead, chunk.constData() + m_firstChunkOffset, count);
+            bytesRead += count;
+            m_firstChunkOffset += count;
+            if (m_firstChunkOffset == chunk.size()) {
+                m_chunks.removeFirst();
+                m_firstChunkOffset = 0;
+            }
+        }
+        m_pending -= bytesRead;
+
+        if (m_full && m_pending <= m_highWaterMark / 2) {
+            m_full = false;
+            emit readyForMore();
+        }
+
+        // Signal the end of the stream once it has been drained.
+        if (bytesRead == 0 && m_finished) {
+            return -1;
+        }
+        return bytesRead;
+    }
+
+    qint64 ResponseStream::writeData(const char* data, qint64 size)
+    {
+        if (m_finished) {
+            setErrorString("Cannot write to a finished response stream.");
+            return -1;
+        }
+
+        if (size > 0) {
+            m_chunks.append(QByteArray(data, size));
+            m_pending += size;
+            if (m_pending >= m_highWaterMark) {
+                m_full = true;
+            }
+            emit readyRead();
+        }
+        return size;
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
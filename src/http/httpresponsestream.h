@@ -0,0 +1,90 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QByteArray>
+#include <QIODevice>
+#include <QList>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * @class ResponseStream
+     * Sequential device for response bodies that are produced over time.
+     * A resource sets the stream as the body device of its response and keeps
+     * writing chunks to it after deliver() has returned, then calls finish().
+     * The stream lets the producer know when the client falls behind: it is
+     * full once more than the high water mark is pending, and readyForMore()
+     * is emitted as soon as enough data has been sent to the client.
+     * @attention The stream has to be written from the thread of the
+     * connection it is sent on.
+     */
+    class ResponseStream : public QIODevice {
+        Q_OBJECT
+    public:
+        ResponseStream(QObject* parent = 0);
+        ~ResponseStream();
+
+        bool isSequential() const;
+        qint64 bytesAvailable() const;
+        bool atEnd() const;
+
+        /** Marks the end of the body. No more data may be written afterwards. */
+        void finish();
+
+        /** @returns true, if finish() has been called. */
+        bool isFinished() const;
+
+        /** @returns true, if at least the high water mark is pending. */
+        bool isFull() const;
+
+        /** @returns the number of bytes pending before the stream is full. */
+        qint64 highWaterMark() const;
+
+        /** Sets the number of bytes pending before the stream is full. */
+        void setHighWaterMark(qint64 highWaterMark);
+
+    signals:
+        /** Emitted when a full stream has been drained to half its high water mark. */
+        void readyForMore();
+
+    protected:
+        qint64 readData(char* data, qint64 maxSize);
+        qint64 writeData(const char* data, qint64 size);
+
+    private:
+        QList<QByteArray> m_chunks;
+        qint64 m_firstChunkOffset;
+        qint64 m_pending;
+        qint64 m_highWaterMark;
+        bool m_full;
+        bool m_finished;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,232 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httprouter.h"
+#include "httpresource.h"
+
+// Standard includes
+#include <algorithm>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    Router::Node::Node()
+        : parameterChild(0)
+    {
+    }
+
+    Router::Node::~Node()
+    {
+        for (const StaticChild& staticChild : staticChildren) {
+            delete staticChild.node;
+        }
+        delete parameterChild;
+    }
+
+    Router::Node* Router::Node::staticChild(QStringView segment) const
+    {
+        auto child = std::lower_bound(staticChildren.constBegin(), staticChildren.constEnd(), segment,
+            [](const StaticChild& staticChild, QStringView segment) {
+                return QStringView(staticChild.segment) < segment;
+            });
+        if (child != staticChildren.constEnd() && QStringView(child->segment) == segment) {
+            return child->node;
+        }
+        return 0;
+    }
+
+    Router::Router()
+        : m_root(new Node())
+    {
+    }
+
+    Router::~Router()
+    {
+        delete m_root;
+    }
+
+    void Router::insert(Resource* resource)
+    {
+        QString uriTemplate = resource->uniqueIdentifier();
+        Segments templateSegments;
+        splitSegments(uriTemplate, templateSegments);
+
+        Route route;
+        route.resource = resource;
+
+        Node* node = m_root;
+        for (QStringView segment : templateSegments) {
+            if (isParameter(segment)) {
+                // Parameters share one child, their names belong to the route.
+                route.parameterNames.append(segment.mid(1, segment.size() - 2).toString());
+                if (!node->parameterChild) {
+                    node->parameterChild = new Node();
+                }
+                node = node->parameterChild;
+                continue;
+            }
+
+            Node* child = node->staticChild(segment);
+            if (!child) {
+                StaticChild staticChild;
+                staticChild.segment = segment.toString();
+                staticChild.node = child = new Node();
+                auto position = std::lower_bound(node->staticChildren.begin(), node->staticChildren.end(), segment,
+                    [](const StaticChild& staticChild, QStringView segment) {
+                        return QStringView(staticChild.segment) < segment;
+                    });
+                node->staticChildren.insert(position, staticChild);
+            }
+            node = child;
+        }
+
+        node->routes.append(route);
+        m_resources.append(resource);
+    }
+
+    void Router::remove(Resource* resource)
+    {
+        if (m_resources.removeAll(resource) > 0) {
+            removeFromNode(m_root, resource);
+        }
+    }
+
+    const QList<Resource*>& Router::resources() const
+    {
+        return m_resources;
+    }
+
+    Resource* Router::match(QStringView path, QMap<QString, QString>& parameters) const
+    {
+        Segments pathSegments;
+        splitSegments(path, pathSegments);
+
+        Segments captures;
+        const Route* route = matchNode(m_root, pathSegments, 0, captures);
+        if (!route) {
+            return 0;
+        }
+
+        for (int i = 0; i < route->parameterNames.size(); i++) {
+            parameters.insert(route->parameterNames.at(i), captures.at(i).toString());
+        }
+        return route->resource;
+    }
+
+    bool Router::matchTemplate(QStringView uriTemplate, QStringView path, QMap<QString, QString>* parameters)
+    {
+        Segments templateSegments;
+        Segments pathSegments;
+        splitSegments(uriTemplate, templateSegments);
+        splitSegments(path, pathSegments);
+
+        // In case we have a different depth, the unique identifiers cannot match.
+        if (templateSegments.size() != pathSegments.size()) {
+            return false;
+        }
+
+        for (int depth = 0; depth < templateSegments.size(); depth++) {
+            QStringView templateSegment = templateSegments.at(depth);
+            if (isParameter(templateSegment)) {
+                if (parameters) {
+                    parameters->insert(templateSegment.mid(1, templateSegment.size() - 2).toString(),
+                        pathSegments.at(depth).toString());
+                }
+            } else if (templateSegment != pathSegments.at(depth)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const Router::Route* Router::matchNode(const Node* node,
+        const Segments& segments,
+        int depth,
+        Segments& captures)
+    {
+        if (depth == segments.size()) {
+            return node->routes.isEmpty() ? 0 : &node->routes.first();
+        }
+
+        // Static segments take precedence over parameters. If the rest of the
+        // path does not match below the static segment, try the parameter.
+        Node* child = node->staticChild(segments.at(depth));
+        if (child) {
+            const Route* route = matchNode(child, segments, depth + 1, captures);
+            if (route) {
+                return route;
+            }
+        }
+
+        if (node->parameterChild) {
+            captures.append(segments.at(depth));
+            const Route* route = matchNode(node->parameterChild, segments, depth + 1, captures);
+            if (route) {
+                return route;
+            }
+            captures.removeLast();
+        }
+        return 0;
+    }
+
+    void Router::removeFromNode(Node* node, Resource* resource)
+    {
+        for (int i = node->routes.size() - 1; i >= 0; i--) {
+            if (node->routes.at(i).resource == resource) {
+                node->routes.removeAt(i);
+            }
+        }
+
+        for (const StaticChild& staticChild : node->staticChildren) {
+            removeFromNode(staticChild.node, resource);
+        }
+        if (node->parameterChild) {
+            removeFromNode(node->parameterChild, resource);
+        }
+    }
+
+    void Router::splitSegments(QStringView path, Segments& segments)
+    {
+        qsizetype segmentStart = 0;
+        for (qsizetype i = 0; i <= path.size(); i++) {
+            if (i == path.size() || path.at(i) == QLatin1Char('/')) {
+                if (i > segmentStart) {
+                    segments.append(path.mid(segmentStart, i - segmentStart));
+                }
+                segmentStart = i + 1;
+            }
+        }
+    }
+
+    bool Router::isParameter(QStringView segment)
+    {
+        return segment.size() >= 2
+            && segment.front() == QLatin1Char('{')
+            && segment.back() == QLatin1Char('}');
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,149 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QVarLengthArray>
+
+// Standard includes
+#include <memory>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    class Resource;
+
+    /**
+     * @class Router
+     * Segment trie compiled from the unique identifier templates of resources.
+     * A lookup walks the requested path once, segment by segment. Static
+     * segments take precedence over parameters, and among resources with the
+     * same template the one added first wins, so matching is deterministic.
+     * Parameters are captured while matching.
+     * @attention The router is not thread-safe. A resource has to be added
+     * again after its unique identifier has been changed.
+     */
+    class Router {
+    public:
+        Router();
+        ~Router();
+
+        /** Compiles the unique identifier template of a resource into the trie. */
+        void insert(Resource* resource);
+
+        /** Removes a resource from the trie. */
+        void remove(Resource* resource);
+
+        /** @returns all resources, in the order they have been added. */
+        const QList<Resource*>& resources() const;
+
+        /**
+         * Matches a path against the compiled templates.
+         * @param path The requested path.
+         * @param parameters Receives the captured parameters.
+         * @returns the matching resource, or 0 if no template matches.
+         */
+        Resource* match(QStringView path, QMap<QString, QString>& parameters) const;
+
+        /**
+         * Matches a path against a single template, without compiling it.
+         * @param uriTemplate The template, for example "/service/{account}/{id}".
+         * @param path The requested path.
+         * @param parameters Receives the captured parameters, if not 0.
+         * @returns true, if the path matches the template.
+         */
+        static bool matchTemplate(QStringView uriTemplate, QStringView path, QMap<QString, QString>* parameters);
+
+    private:
+        Q_DISABLE_COPY(Router)
+
+        struct Route {
+            Resource* resource;
+            QStringList parameterNames;
+        };
+
+        typedef QVarLengthArray<QStringView, 16> Segments;
+
+        struct Node;
+
+        struct StaticChild {
+            QString segment;
+            Node* node;
+        };
+
+        struct Node {
+            Node();
+            ~Node();
+
+            /** @returns the child for a static segment, or 0. */
+            Node* staticChild(QStringView segment) const;
+
+            /** Sorted by segment, so children are found by binary search. */
+            QList<StaticChild> staticChildren;
+            Node* parameterChild;
+            QList<Route> routes;
+        };
+
+        /** Walks the trie depth first, preferring static segments. */
+        static const Route* matchNode(const Node* node,
+            const Segments& segments,
+            int depth,
+            Segments& captures);
+
+        /** Removes a resource from a subtree. */
+        static void removeFromNode(Node* node, Resource* resource);
+
+        /** Splits a path into its non-empty segments, referring to the path. */
+        static void splitSegments(QStringView path, Segments& segments);
+
+        /** @returns true, if the template segment is a parameter. */
+        static bool isParameter(QStringView segment);
+
+        Node* m_root;
+        QList<Resource*> m_resources;
+    };
+
+    /**
+     * @struct RoutingTable
+     * Immutable snapshot of the registered resources. Changing the resources
+     * publishes a new snapshot, requests that have been routed with an older
+     * one keep it and the resources in it alive until they are done.
+     */
+    struct RoutingTable {
+        Router router;
+        QList<std::shared_ptr<Resource>> resources;
+        /** Resources whose match() is consulted, in the order they have been added. */
+        QList<Resource*> customMatchingResources;
+        quint64 version;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
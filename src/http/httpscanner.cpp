@@ -0,0 +1,345 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpscanner.h"
+
+// Standard includes
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QTWEBSERVER_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace QtWebServer {
+
+namespace Http {
+
+    namespace {
+        // A header block ends with an empty line, so we look at every '\n'
+        // and check whether another line ending follows right away.
+        inline int headerEndAt(const char* data, int size, int position)
+        {
+            if (position + 1 < size && data[position + 1] == '\n') {
+                return position + 2;
+            }
+            if (position + 2 < size && data[position + 1] == '\r' && data[position + 2] == '\n') {
+                return position + 3;
+            }
+            return -1;
+        }
+
+        int findByteScalar(const char* data, int size, char c)
+        {
+            const void* match = memchr(data, c, size);
+            return match ? (const char*)match - data : -1;
+        }
+
+        int findEitherByteScalar(const char* data, int size, char a, char b, int from = 0)
+        {
+            for (int i = from; i < size; i++) {
+                if (data[i] == a || data[i] == b) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        int findHeaderEndScalar(const char* data, int size, int from = 0)
+        {
+            for (int i = from; i < size; i++) {
+                if (data[i] == '\n') {
+                    int headerEnd = headerEndAt(data, size, i);
+                    if (headerEnd >= 0) {
+                        return headerEnd;
+                    }
+                }
+            }
+            return -1;
+        }
+
+        // Masks the tail that does not fill a vector. from has to be a
+        // multiple of four, so the key does not have to be rotated.
+        void applyMaskScalar(char* data, int size, const char* maskingKey, int from = 0)
+        {
+            for (int i = from; i < size; i++) {
+                data[i] ^= maskingKey[i & 3];
+            }
+        }
+
+        // Even without SIMD, eight bytes are masked at once.
+        void applyMaskWords(char* data, int size, const char* maskingKey)
+        {
+            uint32_t key32;
+            memcpy(&key32, maskingKey, 4);
+            const uint64_t key = (uint64_t(key32) << 32) | key32;
+            int i = 0;
+            for (; i + 8 <= size; i += 8) {
+                uint64_t word;
+                memcpy(&word, data + i, 8);
+                word ^= key;
+                memcpy(data + i, &word, 8);
+            }
+            applyMaskScalar(data, size, maskingKey, i);
+        }
+
+#ifdef QTWEBSERVER_X86_SIMD
+        __attribute__((target("sse2"))) int findByteSSE2(const char* data, int size, char c)
+        {
+            const __m128i needle = _mm_set1_epi8(c);
+            int i = 0;
+            for (; i + 16 <= size; i += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+                int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+                if (mask) {
+                    return i + __builtin_ctz(mask);
+                }
+            }
+            return findEitherByteScalar(data, size, c, c, i);
+        }
+
+        __attribute__((target("sse2"))) int findEitherByteSSE2(const char* data, int size, char a, char b)
+        {
+            const __m128i needleA = _mm_set1_epi8(a);
+            const __m128i needleB = _mm_set1_epi8(b);
+            int i = 0;
+            for (; i + 16 <= size; i += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+                __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(block, needleA),
+                    _mm_cmpeq_epi8(block, needleB));
+                int mask = _mm_movemask_epi8(matches);
+                if (mask) {
+                    return i + __builtin_ctz(mask);
+                }
+            }
+            return findEitherByteScalar(data, size, a, b, i);
+        }
+
+        __attribute__((target("sse2"))) int findHeaderEndSSE2(const char* data, int size)
+        {
+            const __m128i newline = _mm_set1_epi8('\n');
+            int i = 0;
+            for (; i + 16 <= size; i += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+                unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+                while (mask) {
+                    int headerEnd = headerEndAt(data, size, i + __builtin_ctz(mask));
+                    if (headerEnd >= 0) {
+                        return headerEnd;
+                    }
+                    mask &= mask - 1;
+                }
+            }
+            return findHeaderEndScalar(data, size, i);
+        }
+
+        __attribute__((target("avx2"))) int findByteAVX2(const char* data, int size, char c)
+        {
+            const __m256i needle = _mm256_set1_epi8(c);
+            int i = 0;
+            for (; i + 32 <= size; i += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+                unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+                if (mask) {
+                    return i + __builtin_ctz(mask);
+                }
+            }
+            return findEitherByteScalar(data, size, c, c, i);
+        }
+
+        __attribute__((target("avx2"))) int findEitherByteAVX2(const char* data, int size, char a, char b)
+        {
+            const __m256i needleA = _mm256_set1_epi8(a);
+            const __m256i needleB = _mm256_set1_epi8(b);
+            int i = 0;
+            for (; i + 32 <= size; i += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+                __m256i matches = _mm256_or_si256(_mm256_cmpeq_epi8(block, needleA),
+                    _mm256_cmpeq_epi8(block, needleB));
+                unsigned int mask = _mm256_movemask_epi8(matches);
+                if (mask) {
+                    return i + __builtin_ctz(mask);
+                }
+            }
+            return findEitherByteScalar(data, size, a, b, i);
+        }
+
+        __attribute__((target("avx2"))) int findHeaderEndAVX2(const char* data, int size)
+        {
+            const __m256i newline = _mm256_set1_epi8('\n');
+            int i = 0;
+            for (; i + 32 <= size; i += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+                unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+                while (mask) {
+                    int headerEnd = headerEndAt(data, size, i + __builtin_ctz(mask));
+                    if (headerEnd >= 0) {
+                        return headerEnd;
+                    }
+                    mask &= mask - 1;
+                }
+            }
+            return findHeaderEndScalar(data, size, i);
+        }
+
+        __attribute__((target("sse2"))) void applyMaskSSE2(char* data, int size, const char* maskingKey)
+        {
+            int key;
+            memcpy(&key, maskingKey, 4);
+            const __m128i mask = _mm_set1_epi32(key);
+            int i = 0;
+            for (; i + 16 <= size; i += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+                _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(block, mask));
+            }
+            applyMaskScalar(data, size, maskingKey, i);
+        }
+
+        __attribute__((target("avx2"))) void applyMaskAVX2(char* data, int size, const char* maskingKey)
+        {
+            int key;
+            memcpy(&key, maskingKey, 4);
+            const __m256i mask = _mm256_set1_epi32(key);
+            int i = 0;
+            for (; i + 32 <= size; i += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+                _mm256_storeu_si256((__m256i*)(data + i), _mm256_xor_si256(block, mask));
+            }
+            applyMaskScalar(data, size, maskingKey, i);
+        }
+#endif
+
+        int findEitherByteScalarKernel(const char* data, int size, char a, char b)
+        {
+            return findEitherByteScalar(data, size, a, b);
+        }
+
+        int findHeaderEndScalarKernel(const char* data, int size)
+        {
+            return findHeaderEndScalar(data, size);
+        }
+
+        typedef struct {
+            Scanner::Implementation implementation;
+            int (*findByte)(const char* data, int size, char c);
+            int (*findEitherByte)(const char* data, int size, char a, char b);
+            int (*findHeaderEnd)(const char* data, int size);
+            void (*applyMask)(char* data, int size, const char* maskingKey);
+        } Kernels;
+
+        const Kernels scalarKernels = {
+            Scanner::ScalarImplementation,
+            findByteScalar,
+            findEitherByteScalarKernel,
+            findHeaderEndScalarKernel,
+            applyMaskWords
+        };
+
+#ifdef QTWEBSERVER_X86_SIMD
+        const Kernels sse2Kernels = {
+            Scanner::SSE2Implementation,
+            findByteSSE2,
+            findEitherByteSSE2,
+            findHeaderEndSSE2,
+            applyMaskSSE2
+        };
+
+        const Kernels avx2Kernels = {
+            Scanner::AVX2Implementation,
+            findByteAVX2,
+            findEitherByteAVX2,
+            findHeaderEndAVX2,
+            applyMaskAVX2
+        };
+#endif
+
+        const Kernels* kernelsFor(Scanner::Implementation implementation)
+        {
+            switch (implementation) {
+#ifdef QTWEBSERVER_X86_SIMD
+            case Scanner::AVX2Implementation:
+                return &avx2Kernels;
+            case Scanner::SSE2Implementation:
+                return &sse2Kernels;
+#endif
+            default:
+                return &scalarKernels;
+            }
+        }
+
+        const Kernels* kernels = kernelsFor(Scanner::bestImplementation());
+    }
+
+    int Scanner::findByte(const char* data, int size, char c)
+    {
+        return kernels->findByte(data, size, c);
+    }
+
+    int Scanner::findEitherByte(const char* data, int size, char a, char b)
+    {
+        return kernels->findEitherByte(data, size, a, b);
+    }
+
+    int Scanner::findHeaderEnd(const char* data, int size)
+    {
+        return kernels->findHeaderEnd(data, size);
+    }
+
+    void Scanner::applyMask(char* data, int size, const char* maskingKey)
+    {
+        kernels->applyMask(data, size, maskingKey);
+    }
+
+    Scanner::Implementation Scanner::implementation()
+    {
+        return kernels->implementation;
+    }
+
+    bool Scanner::setImplementation(Implementation implementation)
+    {
+        if (implementation > bestImplementation()) {
+            return false;
+        }
+        kernels = kernelsFor(implementation);
+        return true;
+    }
+
+    Scanner::Implementation Scanner::bestImplementation()
+    {
+#ifdef QTWEBSERVER_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return AVX2Implementation;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return SSE2Implementation;
+        }
+#endif
+        return ScalarImplementation;
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
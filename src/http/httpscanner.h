@@ -0,0 +1,93 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * @class Scanner
+     * Delimiter scanning kernels for the HTTP parser and the masking kernel
+     * for WebSocket frames. The kernels are
+     * vectorised with SSE2 or AVX2 where available. The best implementation
+     * supported by the CPU is chosen at runtime, with a scalar fallback.
+     */
+    class Scanner {
+    public:
+        /**
+         * @brief The Implementation enum
+         */
+        enum Implementation {
+            ScalarImplementation,
+            SSE2Implementation,
+            AVX2Implementation
+        };
+
+        /**
+         * @returns the position of the first occurrence of c, or -1.
+         */
+        static int findByte(const char* data, int size, char c);
+
+        /**
+         * Finds the first occurrence of either of two bytes in one pass.
+         * @returns the position of the first occurrence of a or b, or -1.
+         */
+        static int findEitherByte(const char* data, int size, char a, char b);
+
+        /**
+         * Finds the end of a header block, ie. an empty line. Both "\r\n" and
+         * a bare "\n" are accepted as line endings.
+         * @returns the position right after the empty line, or -1.
+         */
+        static int findHeaderEnd(const char* data, int size);
+
+        /**
+         * XORs data in place with a repeating four byte masking key, as used
+         * by WebSocket frames. Masking twice restores the data.
+         * @param maskingKey The four byte masking key, starting at data[0].
+         */
+        static void applyMask(char* data, int size, const char* maskingKey);
+
+        /** @returns the implementation currently in use. */
+        static Implementation implementation();
+
+        /**
+         * Selects the implementation to be used, for example for benchmarks.
+         * @attention This method is not threadsafe, call it before serving.
+         * @returns false, if the CPU does not support the implementation.
+         */
+        static bool setImplementation(Implementation implementation);
+
+        /** @returns the best implementation supported by the CPU. */
+        static Implementation bestImplementation();
+
+    private:
+        Scanner();
+        ~Scanner();
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -67,6 +67,7 @@ namespace Http {
         { UnsupportedMediaType, "Unsupported Media Type" },
         { RequestedRangeNotSatisfiable, "Requested range not satisfiable" },
         { ExpectationFailed, "Expectation Failed" },
+        { UpgradeRequired, "Upgrade Required" },
 
         { InternalServerError, "Internal Server Error" },
         { NotImplemented, "Not Implemented" },
@@ -73,6 +73,7 @@ namespace Http {
         UnsupportedMediaType = 415,
         RequestedRangeNotSatisfiable = 416,
         ExpectationFailed = 417,
+        UpgradeRequired = 426,
 
         InternalServerError = 500,
         NotImplemented = 501,
@@ -90,7 +91,7 @@ namespace Http {
         const char* reasonPhrase;
     } ReasonPhrasePair;
 
-#define STATUS_CODE_COUNT 41
+#define STATUS_CODE_COUNT 42
 
     /**
      * @brief reasonPhrasePairMap
@@ -24,125 +24,593 @@
 // Own includes
 #include "httpwebengine.h"
 #include "httprequest.h"
+#include "httprequestparser.h"
+#include "httpeventstream.h"
+#include "httpeventstreamresource.h"
 #include "httpresponse.h"
+#include "httpwebsocket.h"
+#include "httpwebsocketresource.h"
+#include "misc/metrics.h"
 
 // Qt includes
+#include <QDateTime>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QString>
 #include <QStringList>
+#include <QThread>
 
 namespace QtWebServer {
 
 namespace Http {
 
+    namespace {
+
+        /** Versions are unique across engines, so caches never confuse them. */
+        QAtomicInteger<quint64> routingTableVersions(0);
+
+        /** The routing table last used by a thread. */
+        struct RoutingTableCache {
+            const WebEngine* webEngine = 0;
+            quint64 version = 0;
+            std::shared_ptr<const RoutingTable> routingTable;
+        };
+
+        thread_local RoutingTableCache routingTableCache;
+
+        /** Metric identifiers of a route, by status code for the counters. */
+        struct RouteMetrics {
+            int latencyHistogram = -1;
+            QHash<int, int> requestCounters;
+        };
+
+        /**
+         * Registering a series takes a lock, so every thread remembers the
+         * identifiers of the resources it has served. Resources stay alive as
+         * long as the thread's routing table refers to them, so the cache is
+         * dropped along with the routing table it has been filled for.
+         */
+        struct RouteMetricsCache {
+            quint64 routingTableVersion = 0;
+            QHash<const Resource*, RouteMetrics> routes;
+        };
+
+        thread_local RouteMetricsCache routeMetricsCache;
+
+        void recordRequest(Resource* resource, quint64 routingTableVersion, int statusCode, qint64 durationNanoseconds)
+        {
+            if (routeMetricsCache.routingTableVersion != routingTableCache.version) {
+                routeMetricsCache.routingTableVersion = routingTableCache.version;
+                routeMetricsCache.routes.clear();
+            }
+
+            // A response completed later may have been routed with an older
+            // table, the identifiers of its resource are looked up once more.
+            RouteMetrics uncachedRouteMetrics;
+            RouteMetrics& routeMetrics = routingTableVersion == routeMetricsCache.routingTableVersion
+                ? routeMetricsCache.routes[resource]
+                : uncachedRouteMetrics;
+
+            // Requests are counted by the template of their resource rather
+            // than their identifier, so the number of series stays bounded.
+            Metrics& metrics = Metrics::instance();
+            QByteArray route;
+            if (routeMetrics.latencyHistogram == -1) {
+                route = resource ? resource->uniqueIdentifier().toUtf8() : QByteArray();
+                routeMetrics.latencyHistogram = metrics.histogram("qtwebserver_http_request_duration_seconds",
+                    "Time spent routing and delivering requests.",
+                    Metrics::Labels() << qMakePair(QByteArray("route"), route));
+            }
+
+            QHash<int, int>::iterator requestCounter = routeMetrics.requestCounters.find(statusCode);
+            if (requestCounter == routeMetrics.requestCounters.end()) {
+                if (route.isNull() && resource) {
+                    route = resource->uniqueIdentifier().toUtf8();
+                }
+                requestCounter = routeMetrics.requestCounters.insert(statusCode,
+                    metrics.counter("qtwebserver_http_requests_total",
+                        "Requests served.",
+                        Metrics::Labels() << qMakePair(QByteArray("route"), route)
+                                          << qMakePair(QByteArray("status"), QByteArray::number(statusCode))));
+            }
+
+            metrics.increment(requestCounter.value());
+            metrics.observe(routeMetrics.latencyHistogram, durationNanoseconds / 1e9);
+        }
+
+        /**
+         * @returns the resource from the routing table it has been routed
+         * with, so connections taken over for it can keep it alive.
+         */
+        template <typename T>
+        std::shared_ptr<T> sharedResource(const RoutingTable* routingTable, T* resource)
+        {
+            for (const std::shared_ptr<Resource>& routedResource : routingTable->resources) {
+                if (routedResource.get() == resource) {
+                    return std::static_pointer_cast<T>(routedResource);
+                }
+            }
+            return std::shared_ptr<T>();
+        }
+
+        /**
+         * Deletes a resource once the last routing table referring to it has
+         * been released, which may happen in any thread.
+         */
+        void releaseResource(Resource* resource)
+        {
+            if (resource->thread() == QThread::currentThread()) {
+                delete resource;
+            } else {
+                resource->deleteLater();
+            }
+        }
+
+    } // namespace
+
     WebEngine::WebEngine(QObject* parent)
         : QObject(parent)
         , Responder()
         , m_notFoundPage(Q_NULLPTR)
+        , m_accessLog(0)
+    {
+        m_keepAliveTimeoutSeconds = 5;
+        m_maxRequestsPerConnection = 100;
+        m_maxRequestBodySize = 64 * 1024 * 1024;
+
+        MutexLocker mutexLocker(m_resourcesMutex);
+        Q_UNUSED(mutexLocker);
+        publishRoutingTable(QList<std::shared_ptr<Resource>>());
+    }
+
+    WebEngine::~WebEngine()
     {
+        // Resources are released along with the last routing table, threads
+        // that have served requests release theirs when routing for another
+        // engine or when they finish.
+        if (routingTableCache.webEngine == this) {
+            routingTableCache = RoutingTableCache();
+        }
+
+        delete m_accessLog.fetchAndStoreOrdered(0);
+        qDeleteAll(m_replacedAccessLogs);
     }
 
     void WebEngine::respond(QSslSocket* sslSocket)
     {
+        // Without a server thread keeping the state, it is kept with the socket.
+        ConnectionState* connection = sslSocket->findChild<ConnectionState*>(QString(), Qt::FindDirectChildrenOnly);
+        if (!connection) {
+            connection = createConnectionState(sslSocket);
+        }
+        respond(sslSocket, connection);
+    }
+
+    Tcp::ConnectionData* WebEngine::createConnectionData(QSslSocket* sslSocket)
+    {
+        return createConnectionState(sslSocket);
+    }
+
+    ConnectionState* WebEngine::createConnectionState(QSslSocket* sslSocket)
+    {
+        ConnectionState* connection = new ConnectionState(sslSocket);
+        connection->setMaxRequestBodySize(maxRequestBodySize());
+        return connection;
+    }
+
+    void WebEngine::respond(QSslSocket* sslSocket, Tcp::ConnectionData* connectionData)
+    {
+        // The connection state keeps the data of a partially received request
+        // and the state of a persistent connection across reads. It belongs
+        // to the thread serving the socket, so no locking is needed.
+        ConnectionState* connection = qobject_cast<ConnectionState*>(connectionData);
+        if (!connection) {
+            respond(sslSocket);
+            return;
+        }
+        connection->stopIdleTimer();
+
+        // Connections that have been taken over do not carry requests anymore.
+        if (connection->protocolHandler()) {
+            connection->receive(readFromSocket(sslSocket));
+            return;
+        }
+
         // Probe if the client awaits an SSL handshake first before reading any
-        // data.
-        if (probeAwaitsSslHandshake(sslSocket)) {
+        // data. This can only happen before the first request.
+        if (connection->servedRequests() == 0
+            && !connection->hasPendingRequest()
+            && probeAwaitsSslHandshake(sslSocket)) {
             // Do not change the following line for security reasons
             sslSocket->setProtocol(QSsl::TlsV1_2OrLater);
             sslSocket->startServerEncryption();
             return;
         }
 
-        // Acquire the socket so we remember it if we should receive more data for
-        // this request later.
-        Http::Request httpRequest = acquireSocket(sslSocket);
+        connection->receive(readFromSocket(sslSocket));
+
+        // Serve all complete requests in the order they have been received,
+        // a client may have pipelined several requests at once.
+        while (connection->hasCompleteRequest()) {
+            Http::Request httpRequest = connection->takeRequest();
+            quint64 responseId = connection->enqueueResponse();
+            connection->countServedRequest();
+
+            // Whether the connection is kept alive only depends on the
+            // request, so it is known before the response is complete.
+            bool persistent = keepAlive(connection, httpRequest);
+            deliver(sslSocket, connection, responseId, httpRequest, persistent);
+
+            // Data following an upgrade request belongs to the new protocol.
+            if (connection->protocolHandler()) {
+                break;
+            }
+
+            if (!persistent) {
+                // Requests after this one will not be answered anymore.
+                connection->resetRequest();
+                break;
+            }
+        }
 
-        // Check if the request is valid and complete.
-        if (httpRequest.isValid() && httpRequest.isComplete()) {
-            // Create a response object.
+        // Answer garbage with an error and give up on the connection, as we
+        // cannot tell where the next request would start.
+        if (connection->hasInvalidRequest()) {
             Http::Response httpResponse;
+            httpResponse.setStatusCode(BadRequest);
+            httpResponse.setHeader(Http::Connection, "close");
+            connection->completeResponse(connection->enqueueResponse(), httpResponse, true);
+            connection->resetRequest();
+        }
+
+        if (connection->writeResponses()) {
+            return;
+        }
 
-            // Match the unique resource identifier on a resource.
-            Resource* resource = matchResource(httpRequest.uniqueResourceIdentifier());
-            if (resource != 0) {
-                // If we found a resource, let it deliver the response.
-                resource->deliver(httpRequest, httpResponse);
+        // Wait for the next request or for the rest of the current one.
+        int timeout = keepAliveTimeoutSeconds();
+        if (timeout > 0 && sslSocket->state() == QAbstractSocket::ConnectedState) {
+            connection->startIdleTimer(timeout);
+        }
+    }
+
+    void WebEngine::deliver(QSslSocket* sslSocket,
+        ConnectionState* connection,
+        quint64 responseId,
+        Request& httpRequest,
+        bool persistent)
+    {
+        PendingResponse pendingResponse;
+        pendingResponse.responseId = responseId;
+        pendingResponse.persistent = persistent;
+        pendingResponse.http11 = httpRequest.version() == "HTTP/1.1";
+        pendingResponse.head = httpRequest.method() == HEAD;
+        pendingResponse.deliverTimer.start();
+
+        // Match the unique resource identifier on a resource. The routing
+        // table keeps the resource alive until the response is complete.
+        QMap<QString, QString> uriParameters;
+        Resource* resource = matchResource(httpRequest.uniqueResourceIdentifier(), uriParameters);
+        pendingResponse.resource = resource;
+        pendingResponse.routingTable = routingTableCache.routingTable;
+        pendingResponse.accessLogEntry.routeDuration = pendingResponse.deliverTimer.nsecsElapsed();
+        pendingResponse.deliverTimer.restart();
+
+        // The entry is written once the response has been written.
+        pendingResponse.accessLog = m_accessLog.loadAcquire();
+        if (pendingResponse.accessLog) {
+            AccessLogEntry& accessLogEntry = pendingResponse.accessLogEntry;
+            accessLogEntry.remoteAddress = sslSocket->peerAddress().toString();
+            accessLogEntry.method = httpRequest.method();
+            accessLogEntry.uniqueResourceIdentifier = httpRequest.uniqueResourceIdentifier();
+            accessLogEntry.version = httpRequest.version();
+            accessLogEntry.referer = QString::fromUtf8(httpRequest.rawHeader(Http::Referer));
+            accessLogEntry.userAgent = QString::fromUtf8(httpRequest.rawHeader(Http::UserAgent));
+            accessLogEntry.parseDuration = connection->parseDuration();
+        }
+
+        // Upgrade requests are answered here, the resource only decides
+        // whether to accept them.
+        if (resource != 0 && WebSocket::isUpgradeRequest(httpRequest)) {
+            WebSocketResource* webSocketResource = qobject_cast<WebSocketResource*>(resource);
+            if (webSocketResource) {
+                httpRequest.setUriParameters(uriParameters);
+                upgrade(connection, pendingResponse, httpRequest, webSocketResource);
+                return;
+            }
+        }
+
+        // Event streams are kept open by the engine as well.
+        if (resource != 0 && httpRequest.method() == GET) {
+            EventStreamResource* eventStreamResource = qobject_cast<EventStreamResource*>(resource);
+            if (eventStreamResource) {
+                httpRequest.setUriParameters(uriParameters);
+                openEventStream(connection, pendingResponse, httpRequest, eventStreamResource);
+                return;
+            }
+        }
+
+        std::shared_ptr<DeferredResponse> deferredResponse = std::make_shared<DeferredResponse>(connection->guard(),
+            [this, connection, pendingResponse](Response& httpResponse, bool deferred) {
+                finishResponse(connection, pendingResponse, httpResponse, deferred);
+            });
+        ResponseHandle responseHandle(deferredResponse);
+
+        deferredResponse->setDelivering(true);
+        if (resource != 0) {
+            httpRequest.setUriParameters(uriParameters);
+
+            // If we found a resource, let it deliver the response.
+            resource->deliverAsync(httpRequest, responseHandle);
+        } else {
+            // Otherwise generate a 404.
+            Http::Response httpResponse;
+            if (m_notFoundPage) {
+                m_notFoundPage->deliver(httpRequest, httpResponse);
             } else {
-                // Otherwise generate a 404.
-                if (m_notFoundPage) {
-                    m_notFoundPage->deliver(httpRequest, httpResponse);
-                } else {
-                    // if the 404 page was not set, generate simple HTML response
-                    httpResponse.setBody(QByteArray("<h1>404 Not found</h1>"));
-                    httpResponse.setHeader(ContentType, "text/html");
-                }
-                httpResponse.setStatusCode(NotFound);
+                // if the 404 page was not set, generate simple HTML response
+                httpResponse.setBody(QByteArray("<h1>404 Not found</h1>"));
+                httpResponse.setHeader(ContentType, "text/html");
             }
+            httpResponse.setStatusCode(NotFound);
+            responseHandle.complete(httpResponse);
+        }
+        deferredResponse->setDelivering(false);
+    }
+
+    void WebEngine::upgrade(ConnectionState* connection,
+        PendingResponse& pendingResponse,
+        const Request& httpRequest,
+        WebSocketResource* resource)
+    {
+        Response httpResponse;
+        if (!WebSocket::handshake(httpRequest, httpResponse)) {
+            finishResponse(connection, pendingResponse, httpResponse, false);
+            return;
+        }
+
+        if (!resource->acceptConnection(httpRequest, httpResponse)) {
+            Response refusedResponse;
+            refusedResponse.setStatusCode(Forbidden);
+            finishResponse(connection, pendingResponse, refusedResponse, false);
+            return;
+        }
 
-            // Write the complete response to the socket.
-            writeToSocket(sslSocket, httpResponse.toByteArray());
+        // The connection stays open regardless of the keep-alive limits.
+        pendingResponse.persistent = true;
+        finishResponse(connection, pendingResponse, httpResponse, false);
 
-            // This is kind of weird, but seems to perform a disconnect in
-            // opposition to close.
-            sslSocket->disconnectFromHost();
+        // Open WebSockets keep their resource alive, like pending responses.
+        connection->upgrade(new WebSocket(connection,
+            httpRequest,
+            sharedResource(pendingResponse.routingTable.get(), resource)));
+    }
+
+    void WebEngine::openEventStream(ConnectionState* connection,
+        PendingResponse& pendingResponse,
+        const Request& httpRequest,
+        EventStreamResource* resource)
+    {
+        // The body is sent in chunks, each event being one. HTTP/1.0 clients
+        // do not understand that, and browsers do not use HTTP/1.0 anymore.
+        if (!pendingResponse.http11) {
+            Response httpResponse;
+            httpResponse.setStatusCode(HTTPVersionNotSupported);
+            finishResponse(connection, pendingResponse, httpResponse, false);
+            return;
+        }
 
-            // We're done with this request, so release the corresponding socket.
-            releaseSocket(sslSocket);
+        Response httpResponse;
+        if (!resource->acceptConnection(httpRequest, httpResponse)) {
+            Response refusedResponse;
+            refusedResponse.setStatusCode(Forbidden);
+            finishResponse(connection, pendingResponse, refusedResponse, false);
+            return;
         }
+
+        httpResponse.setStatusCode(Ok);
+        httpResponse.setHeader(Http::ContentType, resource->contentType());
+        httpResponse.setHeader(Http::CacheControl, "no-cache");
+        httpResponse.setHeader(Http::TransferEncoding, "chunked");
+
+        // The stream stays open regardless of the keep-alive limits.
+        pendingResponse.persistent = true;
+        finishResponse(connection, pendingResponse, httpResponse, false);
+        connection->upgrade(new EventStream(connection,
+            httpRequest,
+            sharedResource(pendingResponse.routingTable.get(), resource)));
     }
 
-    Http::Request WebEngine::acquireSocket(QSslSocket* sslSocket)
+    void WebEngine::finishResponse(ConnectionState* connection,
+        const PendingResponse& pendingResponse,
+        Response& httpResponse,
+        bool deferred)
     {
-        // The list of pending requests may be accessed from multiple server
-        // threads, so we have to make sure to lock properly.
-        MutexLocker mutexLocker(m_pendingRequestsMutex);
-        Q_UNUSED(mutexLocker);
+        qint64 deliverDuration = pendingResponse.deliverTimer.nsecsElapsed();
+        recordRequest(pendingResponse.resource,
+            pendingResponse.routingTable->version,
+            httpResponse.statusCode(),
+            pendingResponse.accessLogEntry.routeDuration + deliverDuration);
+
+        // The response to a HEAD request ends with its header, whatever the
+        // resource has delivered. Otherwise the client would take the body
+        // for the next response on a persistent connection.
+        if (pendingResponse.head) {
+            httpResponse.discardBody();
+        }
+
+        // A streamed body of unknown size is sent in chunks. HTTP/1.0
+        // clients do not understand that, so the body ends with the
+        // connection instead.
+        bool persistent = pendingResponse.persistent;
+        if (httpResponse.bodyDevice() && httpResponse.bodySize() < 0
+            && httpResponse.header(Http::ContentLength).isEmpty()) {
+            if (pendingResponse.http11) {
+                httpResponse.setHeader(Http::TransferEncoding, "chunked");
+            } else {
+                persistent = false;
+            }
+        }
 
-        Http::Request httpRequest;
+        // Switching protocols has its own Connection header.
+        if (httpResponse.statusCode() != SwitchingProtocols) {
+            httpResponse.setHeader(Http::Connection, persistent ? "keep-alive" : "close");
+        }
 
-        // Check if we have acquired that socket already.
-        if (m_pendingRequests.contains(sslSocket)) {
-            // Get the current request in progress.
-            httpRequest = m_pendingRequests.value(sslSocket);
+        if (pendingResponse.accessLog) {
+            AccessLogEntry accessLogEntry = pendingResponse.accessLogEntry;
+            accessLogEntry.time = QDateTime::currentDateTimeUtc();
+            accessLogEntry.statusCode = httpResponse.statusCode();
+            accessLogEntry.deliverDuration = deliverDuration;
+            connection->logResponse(pendingResponse.responseId, pendingResponse.accessLog, accessLogEntry);
+        }
+        connection->completeResponse(pendingResponse.responseId, httpResponse, !persistent);
 
-            // Append the data from the socket.
-            httpRequest.appendBodyData(sslSocket->readAll());
+        // The connection has been waiting for this response, responses
+        // completed while delivering are written along with the others.
+        if (deferred) {
+            connection->writeResponses();
+        }
+    }
 
-            // Save back the request in case there is more data to come.
-            m_pendingRequests.insert(sslSocket, httpRequest);
-        } else {
-            // Create a completely new request object.
-            httpRequest = Http::Request(sslSocket->readAll());
+    bool WebEngine::keepAlive(const ConnectionState* connection, const Request& request)
+    {
+        int timeout = keepAliveTimeoutSeconds();
+        if (timeout <= 0) {
+            return false;
+        }
+
+        int maxRequests = maxRequestsPerConnection();
+        if (maxRequests > 0 && connection->servedRequests() >= maxRequests) {
+            return false;
+        }
 
-            // Save it in the list of pending requests.
-            m_pendingRequests.insert(sslSocket, httpRequest);
+        QByteArray connectionHeader = request.rawHeader(Http::Connection).toByteArray().toLower();
+        if (connectionHeader.contains("close")) {
+            return false;
         }
-        return httpRequest;
+
+        // HTTP/1.1 connections are persistent by default, HTTP/1.0 clients
+        // have to ask for it explicitly.
+        if (request.version() == "HTTP/1.1") {
+            return true;
+        }
+        return connectionHeader.contains("keep-alive");
+    }
+
+    AccessLog* WebEngine::accessLog()
+    {
+        return m_accessLog.loadAcquire();
     }
 
-    void WebEngine::releaseSocket(QSslSocket* sslSocket)
+    void WebEngine::setAccessLog(AccessLog* accessLog)
     {
-        // The list of pending requests may be accessed from multiple server
-        // threads, so we have to make sure to lock properly.
-        MutexLocker mutexLocker(m_pendingRequestsMutex);
+        // Connections may still refer to a replaced log, so it is only
+        // closed here and deleted along with the engine.
+        MutexLocker mutexLocker(m_accessLogMutex);
         Q_UNUSED(mutexLocker);
+        AccessLog* replacedAccessLog = m_accessLog.fetchAndStoreOrdered(accessLog);
+        if (replacedAccessLog) {
+            replacedAccessLog->close();
+            m_replacedAccessLogs.append(replacedAccessLog);
+        }
+    }
+
+    int WebEngine::keepAliveTimeoutSeconds()
+    {
+        return m_keepAliveTimeoutSeconds.r();
+    }
 
-        // Remove all requests concerning this socket.
-        m_pendingRequests.remove(sslSocket);
+    void WebEngine::setKeepAliveTimeoutSeconds(int seconds)
+    {
+        m_keepAliveTimeoutSeconds = seconds;
+    }
+
+    int WebEngine::maxRequestsPerConnection()
+    {
+        return m_maxRequestsPerConnection.r();
+    }
+
+    void WebEngine::setMaxRequestsPerConnection(int maxRequests)
+    {
+        m_maxRequestsPerConnection = maxRequests;
+    }
+
+    int WebEngine::maxRequestBodySize()
+    {
+        return m_maxRequestBodySize.r();
+    }
+
+    void WebEngine::setMaxRequestBodySize(int maxBodySize)
+    {
+        m_maxRequestBodySize = maxBodySize;
     }
 
     void WebEngine::addResource(Resource* resource)
     {
-        // The list of pending requests may be accessed from multiple server
-        // and other threads, so we have to make sure to lock properly.
+        // Changes are serialized, but do not block requests being routed.
         MutexLocker mutexLocker(m_resourcesMutex);
         Q_UNUSED(mutexLocker);
         if (resource == 0) {
             return;
         }
 
-        resource->setParent(this);
-        m_resources.insert(resource);
+        // The resource is owned by the routing tables referring to it.
+        resource->setParent(0);
+        QList<std::shared_ptr<Resource>> resources = m_routingTable->resources;
+        resources.append(std::shared_ptr<Resource>(resource, &releaseResource));
+        publishRoutingTable(resources);
+    }
+
+    void WebEngine::removeResource(Resource* resource)
+    {
+        MutexLocker mutexLocker(m_resourcesMutex);
+        Q_UNUSED(mutexLocker);
+
+        QList<std::shared_ptr<Resource>> resources = m_routingTable->resources;
+        for (int i = resources.size() - 1; i >= 0; i--) {
+            if (resources.at(i).get() == resource) {
+                resources.removeAt(i);
+            }
+        }
+
+        if (resources.size() != m_routingTable->resources.size()) {
+            publishRoutingTable(resources);
+        }
+    }
+
+    void WebEngine::publishRoutingTable(const QList<std::shared_ptr<Resource>>& resources)
+    {
+        std::shared_ptr<RoutingTable> routingTable = std::make_shared<RoutingTable>();
+        routingTable->resources = resources;
+        routingTable->version = routingTableVersions.fetchAndAddRelaxed(1) + 1;
+        for (const std::shared_ptr<Resource>& resource : resources) {
+            routingTable->router.insert(resource.get());
+            if (!resource->matchesTemplateOnly()) {
+                routingTable->customMatchingResources.append(resource.get());
+            }
+        }
+
+        // Requests load the table without taking the mutex.
+        std::atomic_store(&m_routingTable, std::shared_ptr<const RoutingTable>(routingTable));
+        m_routingTableVersion.storeRelease(routingTable->version);
+    }
+
+    const RoutingTable* WebEngine::routingTable()
+    {
+        // Only a single atomic load is needed as long as the table does not
+        // change. The previous table is released once the thread has moved on.
+        // A new table is loaded without the mutex, so requests are not held
+        // up while a change compiles the next one.
+        quint64 version = m_routingTableVersion.loadAcquire();
+        if (routingTableCache.webEngine != this || routingTableCache.version != version) {
+            std::shared_ptr<const RoutingTable> routingTable = std::atomic_load(&m_routingTable);
+            routingTableCache.webEngine = this;
+            routingTableCache.version = routingTable->version;
+            routingTableCache.routingTable = std::move(routingTable);
+        }
+        return routingTableCache.routingTable.get();
     }
 
     void WebEngine::addNotFoundPage(Resource* resource)
@@ -162,22 +630,31 @@ namespace Http {
         // from a client is unencrypted or not, we try to peek the data and
         // see whether we can successfully initiate an SSL handshake.
         // If that also fails, the request is probably broken anyways.
-        QByteArray peekBytes = sslSocket->peek(32768);
-        Http::Request request(peekBytes);
+        RequestParser requestParser;
+        requestParser.feed(sslSocket->peek(32768));
 
         // If the data is garbage, it is likely to be encrypted
-        return !request.isValid();
+        return requestParser.parse() == RequestParser::Error;
     }
 
-    Resource* WebEngine::matchResource(QString uniqueResourceIdentifier)
+    Resource* WebEngine::matchResource(const QString& uniqueResourceIdentifier, QMap<QString, QString>& uriParameters)
     {
-        // The list of pending requests may be accessed from multiple server
-        // and other threads, so we have to make sure to lock properly.
-        MutexLocker mutexLocker(m_resourcesMutex);
-        Q_UNUSED(mutexLocker);
+        // The routing table is immutable, so it can be used without a lock.
+        const RoutingTable* table = routingTable();
+        Resource* routedResource = table->router.match(uniqueResourceIdentifier, uriParameters);
+        if (routedResource) {
+            if (routedResource->matchesTemplateOnly() || routedResource->match(uniqueResourceIdentifier)) {
+                return routedResource;
+            }
+            uriParameters.clear();
+        }
 
-        foreach (Resource* resource, m_resources) {
+        // Resources may reimplement match() to accept identifiers their
+        // template does not describe, so ask all but those that route by
+        // template only, in the order they have been added.
+        for (Resource* resource : table->customMatchingResources) {
             if (resource->match(uniqueResourceIdentifier)) {
+                uriParameters = resource->uriParameters(uniqueResourceIdentifier);
                 return resource;
             }
         }
@@ -190,20 +667,6 @@ namespace Http {
         return sslSocket->readAll();
     }
 
-    void WebEngine::writeToSocket(QSslSocket* sslSocket, QByteArray raw)
-    {
-        int bytesWritten = 0;
-        int bytesRemaining = 0;
-        do {
-            bytesWritten = sslSocket->write(raw);
-            if (bytesWritten == -1) {
-                break;
-            }
-            raw = raw.right(raw.count() - bytesWritten);
-            bytesRemaining = raw.count();
-        } while (bytesRemaining > 0);
-    }
-
 } // namespace Http
 
 } // namespace QtWebServer
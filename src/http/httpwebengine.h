@@ -24,19 +24,32 @@
 #pragma once
 
 // Own includes
+#include "httpaccesslog.h"
+#include "httpconnectionstate.h"
 #include "httpresource.h"
+#include "httpresponsehandle.h"
+#include "httprouter.h"
 #include "misc/threadsafety.h"
 #include "tcp/tcpresponder.h"
 
 // Qt includes
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+#include <QList>
 #include <QMap>
 #include <QObject>
-#include <QSet>
+
+// Standard includes
+#include <memory>
 
 namespace QtWebServer {
 
 namespace Http {
 
+    class EventStreamResource;
+    class WebSocketResource;
+
     /**
      * @class WebEngine
      * @author Jacob Dawid
@@ -47,38 +60,170 @@ namespace Http {
         Q_OBJECT
     public:
         WebEngine(QObject* parent = 0);
+        ~WebEngine();
 
         /**
-         * Reads available data from sockets and responds properly.
+         * Reads available data from sockets and responds properly. The state
+         * of the connection is looked up among the socket's children.
          * @param sslSocket The socket that shall be responded to.
          */
         void respond(QSslSocket* sslSocket);
 
+        /** Creates the HTTP state for a new connection. */
+        Tcp::ConnectionData* createConnectionData(QSslSocket* sslSocket);
+
         /**
-         * Registers a new resource.
+         * Reads available data from sockets and responds properly.
+         * @param sslSocket The socket that shall be responded to.
+         * @param connectionData The state created by createConnectionData().
+         */
+        void respond(QSslSocket* sslSocket, Tcp::ConnectionData* connectionData);
+
+        /**
+         * Registers a new resource. The engine takes ownership of it. This
+         * may be done at any time, requests that are being served are not
+         * blocked by it.
          * @param resource The resource to be registered.
          */
         void addResource(Resource* resource);
 
+        /**
+         * Unregisters a resource. Requests that have been routed to it already
+         * are still delivered, the resource is deleted afterwards.
+         * @param resource The resource to be unregistered.
+         */
+        void removeResource(Resource* resource);
+
         /**
          * Registers error page themplate
          * @param resource The resource to be registered.
          */
         void addNotFoundPage(Resource* resource);
 
+        /** @returns the access log, or 0 if requests are not logged. */
+        AccessLog* accessLog();
+
+        /**
+         * Sets the log a line is written to for every served request, with the
+         * time spent parsing, routing, delivering and writing it. The engine
+         * takes ownership of the log, which has to be open already.
+         * @param accessLog The access log, or 0 to stop logging requests.
+         */
+        void setAccessLog(AccessLog* accessLog);
+
+        /** @returns the keep-alive idle timeout in seconds. */
+        int keepAliveTimeoutSeconds();
+
+        /**
+         * Sets the time in seconds an idle persistent connection is kept open
+         * while waiting for the next request. Set to 0 to close connections
+         * after every response.
+         */
+        void setKeepAliveTimeoutSeconds(int seconds);
+
+        /** @returns the maximum number of requests served per connection. */
+        int maxRequestsPerConnection();
+
+        /**
+         * Sets the maximum number of requests served on a persistent
+         * connection before it is closed. Set to 0 for no limit.
+         */
+        void setMaxRequestsPerConnection(int maxRequests);
+
+        /** @returns the maximum size of a request body in bytes. */
+        int maxRequestBodySize();
+
+        /**
+         * Sets the maximum size of a request body in bytes. Requests with a
+         * larger body are answered with 400 Bad Request and the connection
+         * is closed. Applies to connections accepted afterwards.
+         */
+        void setMaxRequestBodySize(int maxBodySize);
+
     private:
+        /** What is needed to send a response once it is complete. */
+        struct PendingResponse {
+            quint64 responseId;
+            bool persistent;
+            bool http11;
+            bool head;
+            Resource* resource;
+            std::shared_ptr<const RoutingTable> routingTable;
+            AccessLog* accessLog;
+            AccessLogEntry accessLogEntry;
+            QElapsedTimer deliverTimer;
+        };
+
+        /** Creates the state of a new connection with the configured limits. */
+        ConnectionState* createConnectionState(QSslSocket* sslSocket);
+
         /**
-         * Acquires a socket and keeps it in an internal list for pending reponses,
-         * if the list does not already contain it. This can be required due to
-         * several reasons, for example if not all data has been read from the
-         * socket yet.
-         * @param sslSocket The socket that shall be kept acquired.
-         * @returns the actual request.
+         * Determines whether the connection shall be kept open after the
+         * response, based on the HTTP version, the Connection header and the
+         * configured limits.
+         * @param connection The connection that is being served.
+         * @param request The request that has been served.
+         * @returns true, if the connection shall be kept alive.
          */
-        Http::Request acquireSocket(QSslSocket* sslSocket);
+        bool keepAlive(const ConnectionState* connection, const Request& request);
 
-        /** Releases a socket from the internal list. */
-        void releaseSocket(QSslSocket* sslSocket);
+        /**
+         * Matches the resource for a request and lets it deliver the response,
+         * which may be completed later.
+         * @param sslSocket The socket of the connection.
+         * @param connection The connection the request has been received on.
+         * @param responseId The place reserved for the response.
+         * @param httpRequest The request to respond to. Receives the parameters
+         * captured from the resource's unique identifier template.
+         * @param persistent Whether the connection is kept alive afterwards.
+         */
+        void deliver(QSslSocket* sslSocket,
+            ConnectionState* connection,
+            quint64 responseId,
+            Request& httpRequest,
+            bool persistent);
+
+        /**
+         * Answers a request to upgrade to the WebSocket protocol. If the
+         * handshake is valid and the resource accepts it, the connection is
+         * upgraded once the response has been written.
+         * @param connection The connection the request has been received on.
+         * @param pendingResponse The state gathered while routing.
+         * @param httpRequest The upgrade request.
+         * @param resource The resource the request has been routed to.
+         */
+        void upgrade(ConnectionState* connection,
+            PendingResponse& pendingResponse,
+            const Request& httpRequest,
+            WebSocketResource* resource);
+
+        /**
+         * Answers a request for server-sent events. If the resource accepts
+         * it, the response header is sent and the connection is kept open
+         * for the events.
+         * @param connection The connection the request has been received on.
+         * @param pendingResponse The state gathered while routing.
+         * @param httpRequest The request.
+         * @param resource The resource the request has been routed to.
+         */
+        void openEventStream(ConnectionState* connection,
+            PendingResponse& pendingResponse,
+            const Request& httpRequest,
+            EventStreamResource* resource);
+
+        /**
+         * Queues a completed response on its connection. Called in the thread
+         * of the connection.
+         * @param connection The connection to respond on.
+         * @param pendingResponse The state gathered while delivering.
+         * @param httpResponse The completed response.
+         * @param deferred Whether the response has been completed after
+         * delivering has returned, in which case it is written right away.
+         */
+        void finishResponse(ConnectionState* connection,
+            const PendingResponse& pendingResponse,
+            Response& httpResponse,
+            bool deferred);
 
         /**
          * Peeks (ie. reads, but does not remove data from the read buffer) the
@@ -89,12 +234,29 @@ namespace Http {
          */
         bool probeAwaitsSslHandshake(QSslSocket* sslSocket);
 
+        /**
+         * @returns the current routing table. The snapshot is cached per
+         * thread, so only threads that have not seen a changed table yet take
+         * a lock. The snapshot stays valid until this thread routes a request
+         * after the table has changed.
+         */
+        const RoutingTable* routingTable();
+
+        /**
+         * Publishes a new routing table with the given resources. Has to be
+         * called with the resources mutex locked.
+         */
+        void publishRoutingTable(const QList<std::shared_ptr<Resource>>& resources);
+
         /**
          * Tries to match a resource from the passed unique resource identifier.
+         * Static segments take precedence over parameters, and among equal
+         * templates the resource added first wins.
          * @param uniqueResourceIdentifier The identifier that shall be matched.
-         * @returns the first occurrence of a matched resource.
+         * @param uriParameters Receives the parameters captured from the template.
+         * @returns the matched resource, or 0.
          */
-        Resource* matchResource(QString uniqueResourceIdentifier);
+        Resource* matchResource(const QString& uniqueResourceIdentifier, QMap<QString, QString>& uriParameters);
 
         /**
          * Reads all available data from a socket.
@@ -104,18 +266,23 @@ namespace Http {
         QByteArray readFromSocket(QSslSocket* sslSocket);
 
         /**
-         * Writes all data to the given socket.
-         * @param sslSocket The socket to write to.
-         * @param raw The data that shall be written.
+         * Published with std::atomic_store() and loaded by requests with
+         * std::atomic_load(), changes read it under the mutex.
          */
-        void writeToSocket(QSslSocket* sslSocket, QByteArray raw);
+        std::shared_ptr<const RoutingTable> m_routingTable;
+        QAtomicInteger<quint64> m_routingTableVersion;
 
-        QMap<QSslSocket*, Request> m_pendingRequests;
-        QSet<Resource*> m_resources;
-
-        QMutex m_pendingRequestsMutex;
+        /** Serializes changes to the routing table, requests do not take it. */
         QMutex m_resourcesMutex;
         Resource* m_notFoundPage;
+
+        QAtomicPointer<AccessLog> m_accessLog;
+        QList<AccessLog*> m_replacedAccessLogs;
+        QMutex m_accessLogMutex;
+
+        ThreadGuard<int> m_keepAliveTimeoutSeconds;
+        ThreadGuard<int> m_maxRequestsPerConnection;
+        ThreadGuard<int> m_maxRequestBodySize;
     };
 
 }
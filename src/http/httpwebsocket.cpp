@@ -0,0 +1,427 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpwebsocket.h"
+#include "httpconnectionstate.h"
+#include "httpwebsocketresource.h"
+#include "misc/metrics.h"
+
+// Qt includes
+#include <QCryptographicHash>
+#include <QStringDecoder>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    namespace {
+
+        /** Appended to the client's key to compute the accept key, see RFC 6455. */
+        const char webSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+        /** Metrics shared by all WebSockets, registered on first use. */
+        struct WebSocketMetrics {
+            int openedConnections;
+            int closedConnections;
+            int receivedMessages;
+            int sentMessages;
+
+            WebSocketMetrics()
+            {
+                Metrics& metrics = Metrics::instance();
+                openedConnections = metrics.counter("qtwebserver_websocket_opened_connections_total",
+                    "WebSocket connections that have been opened.");
+                closedConnections = metrics.counter("qtwebserver_websocket_closed_connections_total",
+                    "WebSocket connections that have been closed or lost.");
+                receivedMessages = metrics.counter("qtwebserver_websocket_received_messages_total",
+                    "WebSocket data messages received from clients.");
+                sentMessages = metrics.counter("qtwebserver_websocket_sent_messages_total",
+                    "WebSocket data messages sent to clients.");
+
+                int opened = openedConnections;
+                int closed = closedConnections;
+                metrics.addGauge("qtwebserver_websocket_connections",
+                    "WebSocket connections that are open.",
+                    [opened, closed]() {
+                        Metrics& metrics = Metrics::instance();
+                        Metrics::GaugeSample sample;
+                        sample.value = double(metrics.counterValue(opened)) - double(metrics.counterValue(closed));
+                        return QList<Metrics::GaugeSample>() << sample;
+                    });
+            }
+        };
+
+        const WebSocketMetrics& webSocketMetrics()
+        {
+            static const WebSocketMetrics instance;
+            return instance;
+        }
+
+        /** @returns true, if a client may send the close code, see RFC 6455, section 7.4. */
+        bool isValidCloseCode(int closeCode)
+        {
+            return (closeCode >= 1000 && closeCode <= 1003)
+                || (closeCode >= 1007 && closeCode <= 1014)
+                || (closeCode >= 3000 && closeCode <= 4999);
+        }
+
+        /**
+         * Decodes UTF-8 text, which has to be valid in WebSocket messages.
+         * @returns false, if the data is not valid UTF-8.
+         */
+        bool decodeUtf8(const QByteArray& data, QString& text)
+        {
+            // A byte order mark is part of the message, rather than a hint.
+            QStringDecoder decoder(QStringDecoder::Utf8,
+                QStringDecoder::Flag::Stateless | QStringDecoder::Flag::ConvertInitialBom);
+            text = decoder.decode(data);
+            return !decoder.hasError();
+        }
+
+    } // namespace
+
+    WebSocket::WebSocket(ConnectionState* connection,
+        const Request& request,
+        std::shared_ptr<WebSocketResource> resource)
+        : ProtocolHandler(connection)
+        , m_connection(connection)
+        , m_sslSocket(connection->socket())
+        , m_request(request)
+        , m_resource(resource)
+        , m_state(StateConnecting)
+    {
+        m_closeTimer.setSingleShot(true);
+        connect(&m_closeTimer, &QTimer::timeout, this, &WebSocket::closeTimeout);
+        connect(m_sslSocket, &QAbstractSocket::disconnected, this, &WebSocket::socketDisconnected);
+    }
+
+    WebSocket::~WebSocket()
+    {
+        finish(AbnormalClosure, QString());
+    }
+
+    bool WebSocket::isUpgradeRequest(const Request& request)
+    {
+        if (!request.rawHeader(Http::Upgrade).toByteArray().toLower().contains("websocket")) {
+            return false;
+        }
+
+        // The Connection header is a list of tokens, for example "keep-alive, Upgrade".
+        QList<QByteArray> tokens = request.rawHeader(Http::Connection).toByteArray().split(',');
+        for (const QByteArray& token : tokens) {
+            if (token.trimmed().toLower() == "upgrade") {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool WebSocket::handshake(const Request& request, Response& response)
+    {
+        QByteArray key = request.rawHeader("Sec-WebSocket-Key").toByteArray().trimmed();
+        QByteArray::FromBase64Result decodedKey = QByteArray::fromBase64Encoding(key,
+            QByteArray::AbortOnBase64DecodingErrors);
+        if (request.method() != GET
+            || request.version() != "HTTP/1.1"
+            || !isUpgradeRequest(request)
+            || !decodedKey
+            || decodedKey.decoded.size() != 16) {
+            response.setStatusCode(BadRequest);
+            return false;
+        }
+
+        // Let the client know the version we speak, so it may retry with it.
+        if (request.rawHeader("Sec-WebSocket-Version").toByteArray().trimmed() != "13") {
+            response.setStatusCode(UpgradeRequired);
+            response.setHeader(Http::Upgrade, "websocket");
+            response.setHeader("Sec-WebSocket-Version", "13");
+            return false;
+        }
+
+        QByteArray accept = QCryptographicHash::hash(key + webSocketGuid, QCryptographicHash::Sha1).toBase64();
+        response.setStatusCode(SwitchingProtocols);
+        response.setHeader(Http::Upgrade, "websocket");
+        response.setHeader(Http::Connection, "Upgrade");
+        response.setHeader("Sec-WebSocket-Accept", QString::fromLatin1(accept));
+        return true;
+    }
+
+    const Request& WebSocket::request() const
+    {
+        return m_request;
+    }
+
+    bool WebSocket::isOpen() const
+    {
+        return m_state == StateOpen;
+    }
+
+    qint64 WebSocket::bytesToWrite() const
+    {
+        return m_sslSocket->bytesToWrite();
+    }
+
+    int WebSocket::maxMessageSize() const
+    {
+        return m_parser.maxMessageSize();
+    }
+
+    void WebSocket::setMaxMessageSize(int maxMessageSize)
+    {
+        m_parser.setMaxMessageSize(maxMessageSize);
+    }
+
+    void WebSocket::receive(const QByteArray& data)
+    {
+        if (m_state == StateClosed) {
+            return;
+        }
+
+        m_parser.feed(data);
+        if (m_state != StateConnecting) {
+            handleMessages();
+        }
+    }
+
+    void WebSocket::open()
+    {
+        if (m_state != StateConnecting) {
+            return;
+        }
+
+        m_state = StateOpen;
+        Metrics::instance().increment(webSocketMetrics().openedConnections);
+        m_resource->opened(this);
+        handleMessages();
+    }
+
+    void WebSocket::sendText(const QString& message)
+    {
+        if (m_state == StateOpen) {
+            sendFrame(WebSocketParser::TextFrame, message.toUtf8());
+            Metrics::instance().increment(webSocketMetrics().sentMessages);
+        }
+    }
+
+    void WebSocket::sendBinary(const QByteArray& message)
+    {
+        if (m_state == StateOpen) {
+            sendFrame(WebSocketParser::BinaryFrame, message);
+            Metrics::instance().increment(webSocketMetrics().sentMessages);
+        }
+    }
+
+    void WebSocket::ping(const QByteArray& payload)
+    {
+        if (m_state == StateOpen) {
+            sendFrame(WebSocketParser::PingFrame, payload.left(125));
+        }
+    }
+
+    void WebSocket::close(int closeCode, const QString& reason)
+    {
+        if (m_state != StateOpen) {
+            return;
+        }
+
+        // The code and the reason have to fit into a control frame. The
+        // reason is cut at a character boundary, so it stays valid UTF-8.
+        QString truncatedReason = reason;
+        QByteArray encodedReason = truncatedReason.toUtf8();
+        while (encodedReason.size() > 123) {
+            truncatedReason.chop(1);
+            encodedReason = truncatedReason.toUtf8();
+        }
+
+        sendClose(closeCode, encodedReason);
+        m_state = StateClosing;
+        m_closeTimer.start(CloseTimeoutMilliseconds);
+    }
+
+    void WebSocket::socketDisconnected()
+    {
+        finish(AbnormalClosure, QString());
+    }
+
+    void WebSocket::closeTimeout()
+    {
+        // The client did not answer the closing handshake.
+        finish(AbnormalClosure, QString());
+        m_sslSocket->abort();
+    }
+
+    void WebSocket::handleMessages()
+    {
+        WebSocketParser::Opcode opcode;
+        QByteArray payload;
+
+        // The resource may close the connection while handling a message,
+        // messages received after that are dropped.
+        while (m_state == StateOpen || m_state == StateClosing) {
+            WebSocketParser::Result result = m_parser.parse(opcode, payload);
+            if (result == WebSocketParser::NeedMoreData) {
+                return;
+            }
+
+            if (result == WebSocketParser::Error) {
+                fail(m_parser.closeCode());
+                return;
+            }
+
+            switch (opcode) {
+            case WebSocketParser::TextFrame: {
+                QString message;
+                if (!decodeUtf8(payload, message)) {
+                    fail(InvalidPayloadData);
+                    return;
+                }
+                if (m_state == StateOpen) {
+                    Metrics::instance().increment(webSocketMetrics().receivedMessages);
+                    m_resource->textMessageReceived(this, message);
+                    emit textMessageReceived(message);
+                }
+                break;
+            }
+
+            case WebSocketParser::BinaryFrame:
+                if (m_state == StateOpen) {
+                    Metrics::instance().increment(webSocketMetrics().receivedMessages);
+                    m_resource->binaryMessageReceived(this, payload);
+                    emit binaryMessageReceived(payload);
+                }
+                break;
+
+            case WebSocketParser::PingFrame:
+                if (m_state == StateOpen) {
+                    sendFrame(WebSocketParser::PongFrame, payload);
+                }
+                break;
+
+            case WebSocketParser::PongFrame:
+                emit pongReceived(payload);
+                break;
+
+            case WebSocketParser::CloseFrame:
+                handleClose(payload);
+                return;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    void WebSocket::handleClose(const QByteArray& payload)
+    {
+        int closeCode = NoStatusReceived;
+        QString reason;
+        if (payload.size() == 1) {
+            fail(ProtocolError);
+            return;
+        }
+
+        if (payload.size() >= 2) {
+            closeCode = (uchar(payload.at(0)) << 8) | uchar(payload.at(1));
+            if (!isValidCloseCode(closeCode)) {
+                fail(ProtocolError);
+                return;
+            }
+            if (!decodeUtf8(payload.mid(2), reason)) {
+                fail(InvalidPayloadData);
+                return;
+            }
+        }
+
+        // Answer the client's closing handshake with the same code, unless
+        // it is the answer to ours. The server closes the TCP connection.
+        if (m_state == StateOpen) {
+            sendClose(closeCode, QByteArray());
+        }
+        finish(closeCode, reason);
+        m_sslSocket->disconnectFromHost();
+    }
+
+    void WebSocket::sendFrame(WebSocketParser::Opcode opcode, const QByteArray& payload)
+    {
+        // Frames sent by the server are not masked and never fragmented.
+        quint64 size = payload.size();
+        QByteArray frame;
+        frame.reserve(10 + payload.size());
+        frame.append(char(0x80 | opcode));
+        if (size < 126) {
+            frame.append(char(size));
+        } else if (size <= 0xffff) {
+            frame.append(char(126));
+            frame.append(char(size >> 8));
+            frame.append(char(size & 0xff));
+        } else {
+            frame.append(char(127));
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                frame.append(char((size >> shift) & 0xff));
+            }
+        }
+        frame.append(payload);
+        m_connection->write(frame);
+    }
+
+    void WebSocket::sendClose(int closeCode, const QByteArray& reason)
+    {
+        QByteArray payload;
+        if (closeCode != NoStatusReceived) {
+            payload.append(char(closeCode >> 8));
+            payload.append(char(closeCode & 0xff));
+            payload.append(reason);
+        }
+        sendFrame(WebSocketParser::CloseFrame, payload);
+    }
+
+    void WebSocket::fail(WebSocketCloseCode closeCode)
+    {
+        if (m_state == StateOpen) {
+            sendClose(closeCode, QByteArray());
+        }
+        finish(closeCode, QString());
+        m_sslSocket->disconnectFromHost();
+    }
+
+    void WebSocket::finish(int closeCode, const QString& reason)
+    {
+        if (m_state == StateClosed) {
+            return;
+        }
+
+        // The resource only learns about connections that have been opened.
+        bool opened = m_state != StateConnecting;
+        m_state = StateClosed;
+        m_closeTimer.stop();
+        if (opened) {
+            Metrics::instance().increment(webSocketMetrics().closedConnections);
+            m_resource->closed(this, closeCode, reason);
+            emit closed(closeCode, reason);
+        }
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,193 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "httpprotocolhandler.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "httpwebsocketparser.h"
+
+// Qt includes
+#include <QByteArray>
+#include <QSslSocket>
+#include <QString>
+#include <QTimer>
+
+// Standard includes
+#include <memory>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    class ConnectionState;
+    class WebSocketResource;
+
+    /**
+     * @class WebSocket
+     * A connection that has been upgraded to the WebSocket protocol (RFC 6455).
+     * It stays in the server thread that has been serving the connection and
+     * is a child of the connection's state, so it is destroyed along with the
+     * connection. Messages are received in that thread and handed to the
+     * resource the connection has been upgraded for. The slots have to be
+     * called in that thread, too, other threads send messages by connecting
+     * signals to them.
+     */
+    class WebSocket : public ProtocolHandler {
+        Q_OBJECT
+    public:
+        /**
+         * Created by the web engine once the handshake has been accepted.
+         * @param connection The upgraded connection, which becomes the parent.
+         * @param request The handshake request.
+         * @param resource The resource the connection has been upgraded for.
+         */
+        WebSocket(ConnectionState* connection,
+            const Request& request,
+            std::shared_ptr<WebSocketResource> resource);
+        ~WebSocket();
+
+        /**
+         * @returns true, if the request asks for an upgrade to the WebSocket
+         * protocol, regardless of whether the handshake is valid.
+         */
+        static bool isUpgradeRequest(const Request& request);
+
+        /**
+         * Checks the handshake of an upgrade request and fills in the
+         * response to it.
+         * @param request The upgrade request.
+         * @param response Receives the response to the request.
+         * @returns true, if the response switches protocols. Otherwise the
+         * response describes why the handshake has been refused.
+         */
+        static bool handshake(const Request& request, Response& response);
+
+        /** @returns the handshake request, including its URI parameters. */
+        const Request& request() const;
+
+        /** @returns true, if messages can be sent and received. */
+        bool isOpen() const;
+
+        /**
+         * @returns the amount of data that has been sent, but not been taken
+         * by the network yet. Check this to avoid queueing up messages for a
+         * slow client.
+         */
+        qint64 bytesToWrite() const;
+
+        /** @returns the maximum size of a received message in bytes. */
+        int maxMessageSize() const;
+
+        /**
+         * Sets the maximum size of a received message in bytes. The
+         * connection is closed if a client sends a larger message.
+         */
+        void setMaxMessageSize(int maxMessageSize);
+
+        /**
+         * Feeds data received on the connection. Data received before the
+         * connection has been opened is handled when it is opened.
+         * @param data The data read from the socket.
+         */
+        virtual void receive(const QByteArray& data);
+
+        /**
+         * Opens the connection once the handshake response has been written
+         * and lets the resource know about it.
+         */
+        virtual void open();
+
+    public slots:
+        /** Sends a text message. Messages are dropped unless the connection is open. */
+        void sendText(const QString& message);
+
+        /** Sends a binary message. Messages are dropped unless the connection is open. */
+        void sendBinary(const QByteArray& message);
+
+        /** Sends a ping, the client answers with a pong carrying the same payload. */
+        void ping(const QByteArray& payload = QByteArray());
+
+        /**
+         * Starts the closing handshake. The connection is closed once the
+         * client has answered it, or after a timeout.
+         * @param closeCode The status code, see WebSocketCloseCode.
+         * @param reason The reason, truncated to fit in a control frame.
+         */
+        void close(int closeCode = NormalClosure, const QString& reason = QString());
+
+    signals:
+        void textMessageReceived(const QString& message);
+        void binaryMessageReceived(const QByteArray& message);
+        void pongReceived(const QByteArray& payload);
+
+        /**
+         * Emitted once, when the connection has been closed by either side or
+         * has been lost. The code is AbnormalClosure if it has been lost.
+         */
+        void closed(int closeCode, const QString& reason);
+
+    private slots:
+        void socketDisconnected();
+        void closeTimeout();
+
+    private:
+        enum State {
+            StateConnecting,
+            StateOpen,
+            StateClosing,
+            StateClosed
+        };
+
+        /** Handles all messages that have been received completely. */
+        void handleMessages();
+
+        /** Answers a close frame of the client and closes the connection. */
+        void handleClose(const QByteArray& payload);
+
+        void sendFrame(WebSocketParser::Opcode opcode, const QByteArray& payload);
+        void sendClose(int closeCode, const QByteArray& reason);
+
+        /** Fails the connection because the client has violated the protocol. */
+        void fail(WebSocketCloseCode closeCode);
+
+        /** Marks the connection as closed and lets the resource know once. */
+        void finish(int closeCode, const QString& reason);
+
+        /** Time the client has to answer the closing handshake. */
+        static constexpr int CloseTimeoutMilliseconds = 5000;
+
+        ConnectionState* m_connection;
+        QSslSocket* m_sslSocket;
+        Request m_request;
+        std::shared_ptr<WebSocketResource> m_resource;
+        WebSocketParser m_parser;
+        State m_state;
+        QTimer m_closeTimer;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
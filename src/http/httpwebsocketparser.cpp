@@ -0,0 +1,199 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpwebsocketparser.h"
+#include "httpscanner.h"
+
+namespace QtWebServer {
+
+namespace Http {
+
+    namespace {
+        /** Consumed data is dropped from the buffer once there is this much of it. */
+        const int compactThreshold = 64 * 1024;
+
+        /** Control frames must not be fragmented or carry more than this. */
+        const int maxControlPayloadSize = 125;
+    }
+
+    WebSocketParser::WebSocketParser()
+        : m_position(0)
+        , m_messageOpcode(TextFrame)
+        , m_fragmented(false)
+        , m_maxMessageSize(16 * 1024 * 1024)
+        , m_failed(false)
+        , m_closeCode(NormalClosure)
+    {
+    }
+
+    void WebSocketParser::feed(const QByteArray& data)
+    {
+        m_buffer.append(data);
+    }
+
+    WebSocketParser::Result WebSocketParser::parse(Opcode& opcode, QByteArray& payload)
+    {
+        if (m_failed) {
+            return Error;
+        }
+
+        for (;;) {
+            const uchar* data = reinterpret_cast<const uchar*>(m_buffer.constData()) + m_position;
+            int available = m_buffer.size() - m_position;
+            if (available < 2) {
+                break;
+            }
+
+            bool finalFrame = data[0] & 0x80;
+            int frameOpcode = data[0] & 0x0f;
+            int payloadLengthField = data[1] & 0x7f;
+
+            // No extensions are negotiated, so the reserved bits must be
+            // clear. Clients have to mask every frame.
+            if (data[0] & 0x70 || !(data[1] & 0x80)) {
+                return fail(ProtocolError);
+            }
+
+            bool control = frameOpcode & 0x08;
+            if (control) {
+                if (frameOpcode != CloseFrame && frameOpcode != PingFrame && frameOpcode != PongFrame) {
+                    return fail(ProtocolError);
+                }
+                if (!finalFrame || payloadLengthField > maxControlPayloadSize) {
+                    return fail(ProtocolError);
+                }
+            } else {
+                if (frameOpcode != ContinuationFrame && frameOpcode != TextFrame && frameOpcode != BinaryFrame) {
+                    return fail(ProtocolError);
+                }
+                // A continuation needs a message to continue, and a new
+                // message must not start before the last one is complete.
+                if ((frameOpcode == ContinuationFrame) != m_fragmented) {
+                    return fail(ProtocolError);
+                }
+            }
+
+            int headerSize = 2 + (payloadLengthField == 126 ? 2 : payloadLengthField == 127 ? 8 : 0) + 4;
+            if (available < headerSize) {
+                break;
+            }
+
+            quint64 payloadLength = payloadLengthField;
+            if (payloadLengthField == 126) {
+                payloadLength = (quint64(data[2]) << 8) | data[3];
+            } else if (payloadLengthField == 127) {
+                payloadLength = 0;
+                for (int i = 2; i < 10; i++) {
+                    payloadLength = (payloadLength << 8) | data[i];
+                }
+            }
+
+            // Refuse large messages before buffering them.
+            if (!control && payloadLength > quint64(m_maxMessageSize - m_message.size())) {
+                return fail(MessageTooBig);
+            }
+
+            if (quint64(available - headerSize) < payloadLength) {
+                if (m_position >= compactThreshold) {
+                    m_buffer.remove(0, m_position);
+                    m_position = 0;
+                }
+                break;
+            }
+
+            // The payload is unmasked in place, the frame is not looked at
+            // again afterwards.
+            int size = int(payloadLength);
+            char* frame = m_buffer.data() + m_position;
+            char* framePayload = frame + headerSize;
+            Scanner::applyMask(framePayload, size, frame + headerSize - 4);
+            m_position += headerSize + size;
+
+            if (control) {
+                opcode = Opcode(frameOpcode);
+                payload = QByteArray(framePayload, size);
+            } else if (finalFrame && !m_fragmented) {
+                // Unfragmented messages do not have to be reassembled.
+                opcode = Opcode(frameOpcode);
+                payload = QByteArray(framePayload, size);
+            } else {
+                if (!m_fragmented) {
+                    m_messageOpcode = Opcode(frameOpcode);
+                    m_fragmented = true;
+                }
+                m_message.append(framePayload, size);
+                if (!finalFrame) {
+                    continue;
+                }
+                opcode = m_messageOpcode;
+                payload = m_message;
+                m_message.clear();
+                m_fragmented = false;
+            }
+
+            if (m_position == m_buffer.size()) {
+                m_buffer.clear();
+                m_position = 0;
+            } else if (m_position >= compactThreshold) {
+                m_buffer.remove(0, m_position);
+                m_position = 0;
+            }
+            return Complete;
+        }
+
+        if (m_position == m_buffer.size()) {
+            m_buffer.clear();
+            m_position = 0;
+        }
+        return NeedMoreData;
+    }
+
+    WebSocketCloseCode WebSocketParser::closeCode() const
+    {
+        return m_closeCode;
+    }
+
+    int WebSocketParser::maxMessageSize() const
+    {
+        return m_maxMessageSize;
+    }
+
+    void WebSocketParser::setMaxMessageSize(int maxMessageSize)
+    {
+        m_maxMessageSize = maxMessageSize;
+    }
+
+    WebSocketParser::Result WebSocketParser::fail(WebSocketCloseCode closeCode)
+    {
+        m_buffer.clear();
+        m_position = 0;
+        m_message.clear();
+        m_failed = true;
+        m_closeCode = closeCode;
+        return Error;
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
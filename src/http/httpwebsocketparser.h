@@ -0,0 +1,126 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QByteArray>
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * @brief The WebSocketCloseCode enum
+     * Status codes sent with a close frame, see RFC 6455, section 7.4.
+     */
+    enum WebSocketCloseCode {
+        NormalClosure = 1000,
+        GoingAway = 1001,
+        ProtocolError = 1002,
+        UnsupportedData = 1003,
+        NoStatusReceived = 1005,
+        AbnormalClosure = 1006,
+        InvalidPayloadData = 1007,
+        PolicyViolation = 1008,
+        MessageTooBig = 1009,
+        InternalError = 1011
+    };
+
+    /**
+     * @class WebSocketParser
+     * Incremental parser for the WebSocket frames sent by clients. Data is
+     * appended to a single receive buffer, frames are unmasked in place once
+     * they are complete and fragmented messages are reassembled. Control
+     * frames may arrive between the fragments of a message and are handed
+     * out on their own.
+     */
+    class WebSocketParser {
+    public:
+        /**
+         * @brief The Result enum
+         */
+        enum Result {
+            NeedMoreData, /** No message is complete yet. */
+            Complete, /** A message or a control frame has been parsed. */
+            Error /** The data violates the protocol, see closeCode(). */
+        };
+
+        /**
+         * @brief The Opcode enum
+         */
+        enum Opcode {
+            ContinuationFrame = 0x0,
+            TextFrame = 0x1,
+            BinaryFrame = 0x2,
+            CloseFrame = 0x8,
+            PingFrame = 0x9,
+            PongFrame = 0xA
+        };
+
+        WebSocketParser();
+
+        /**
+         * Appends data to the receive buffer. Call parse() afterwards.
+         * @param data The data received.
+         */
+        void feed(const QByteArray& data);
+
+        /**
+         * Parses the next message. Call this until it does not return
+         * Complete anymore, as several messages may have been received.
+         * @param opcode Receives the opcode of the message, TextFrame or
+         * BinaryFrame for data messages.
+         * @param payload Receives the unmasked payload of the message.
+         * @returns the parse result.
+         */
+        Result parse(Opcode& opcode, QByteArray& payload);
+
+        /** @returns the status code to close the connection with after an error. */
+        WebSocketCloseCode closeCode() const;
+
+        /** @returns the maximum size of a message in bytes. */
+        int maxMessageSize() const;
+
+        /**
+         * Sets the maximum size of a message in bytes, fragmented messages
+         * are limited as a whole. Larger messages are an error.
+         */
+        void setMaxMessageSize(int maxMessageSize);
+
+    private:
+        Result fail(WebSocketCloseCode closeCode);
+
+        QByteArray m_buffer;
+        int m_position;
+        QByteArray m_message;
+        Opcode m_messageOpcode;
+        bool m_fragmented;
+        int m_maxMessageSize;
+        bool m_failed;
+        WebSocketCloseCode m_closeCode;
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
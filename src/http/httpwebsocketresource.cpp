@@ -0,0 +1,81 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "httpwebsocketresource.h"
+
+namespace QtWebServer {
+
+namespace Http {
+
+    WebSocketResource::WebSocketResource(QString uniqueIdentifier,
+        QObject* parent)
+        : Resource(uniqueIdentifier, parent)
+    {
+    }
+
+    WebSocketResource::~WebSocketResource()
+    {
+    }
+
+    void WebSocketResource::deliver(const Request& request, Response& response)
+    {
+        Q_UNUSED(request);
+        response.setStatusCode(UpgradeRequired);
+        response.setHeader(Http::Upgrade, "websocket");
+    }
+
+    bool WebSocketResource::acceptConnection(const Request& request, Response& response)
+    {
+        Q_UNUSED(request);
+        Q_UNUSED(response);
+        return true;
+    }
+
+    void WebSocketResource::opened(WebSocket* webSocket)
+    {
+        Q_UNUSED(webSocket);
+    }
+
+    void WebSocketResource::textMessageReceived(WebSocket* webSocket, const QString& message)
+    {
+        Q_UNUSED(webSocket);
+        Q_UNUSED(message);
+    }
+
+    void WebSocketResource::binaryMessageReceived(WebSocket* webSocket, const QByteArray& message)
+    {
+        Q_UNUSED(webSocket);
+        Q_UNUSED(message);
+    }
+
+    void WebSocketResource::closed(WebSocket* webSocket, int closeCode, const QString& reason)
+    {
+        Q_UNUSED(webSocket);
+        Q_UNUSED(closeCode);
+        Q_UNUSED(reason);
+    }
+
+} // namespace Http
+
+} // namespace QtWebServer
@@ -0,0 +1,82 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "httpresource.h"
+#include "httpwebsocket.h"
+
+namespace QtWebServer {
+
+namespace Http {
+
+    /**
+     * @class WebSocketResource
+     * Basic class for resources that clients connect to with the WebSocket
+     * protocol. Upgrade requests are answered by the web engine, the
+     * connections stay in the server thread that has accepted them. Subclass
+     * this and reimplement the notifications you are interested in.
+     *
+     * @attention: The notifications are called from the server threads of
+     * the connections, so they may be called from several threads at once.
+     * They are not delivered in a worker pool.
+     */
+    class WebSocketResource : public Resource {
+        Q_OBJECT
+    public:
+        WebSocketResource(QString uniqueIdentifier,
+            QObject* parent = 0);
+        ~WebSocketResource();
+
+        /** Answers requests that do not ask for an upgrade with 426 Upgrade Required. */
+        virtual void deliver(const Request& request, Response& response);
+
+        /**
+         * Decides whether an upgrade request is accepted, after its handshake
+         * has been checked. Headers may be added to the handshake response,
+         * for example to select a subprotocol. The default implementation
+         * accepts all requests.
+         * @returns false, to answer the request with 403 Forbidden instead.
+         */
+        virtual bool acceptConnection(const Request& request, Response& response);
+
+        /** Called when a connection has been opened and messages may be sent. */
+        virtual void opened(WebSocket* webSocket);
+
+        /** Called when a text message has been received. */
+        virtual void textMessageReceived(WebSocket* webSocket, const QString& message);
+
+        /** Called when a binary message has been received. */
+        virtual void binaryMessageReceived(WebSocket* webSocket, const QByteArray& message);
+
+        /**
+         * Called when a connection has been closed by either side or has been
+         * lost. The WebSocket is destroyed along with its connection later.
+         */
+        virtual void closed(WebSocket* webSocket, int closeCode, const QString& reason);
+    };
+
+} // namespace Http
+
+} // namespace QtWebServer
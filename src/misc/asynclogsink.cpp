@@ -0,0 +1,176 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "asynclogsink.h"
+
+namespace QtWebServer {
+
+AsyncLogSink::AsyncLogSink(QString fileName, int capacity, QObject* parent)
+    : QThread(parent)
+    , m_file(fileName)
+    , m_records(capacity)
+    , m_overflowPolicy(OverflowDrop)
+    , m_running(0)
+    , m_writerSleeping(0)
+    , m_queuedRecords(0)
+    , m_writtenRecords(0)
+    , m_droppedRecords(0)
+{
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+    close();
+}
+
+bool AsyncLogSink::open()
+{
+    if (m_running.loadAcquire()) {
+        return true;
+    }
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+
+    m_running.storeRelease(1);
+    start(QThread::LowPriority);
+    return true;
+}
+
+void AsyncLogSink::close()
+{
+    if (!m_running.testAndSetOrdered(1, 0)) {
+        return;
+    }
+
+    // The writer drains the buffer before it finishes.
+    wakeWriter();
+    wait();
+    m_file.close();
+}
+
+AsyncLogSink::OverflowPolicy AsyncLogSink::overflowPolicy() const
+{
+    return OverflowPolicy(m_overflowPolicy.loadRelaxed());
+}
+
+void AsyncLogSink::setOverflowPolicy(OverflowPolicy overflowPolicy)
+{
+    m_overflowPolicy.storeRelaxed(overflowPolicy);
+}
+
+void AsyncLogSink::write(QByteArray record)
+{
+    if (!m_running.loadAcquire()) {
+        return;
+    }
+
+    m_queuedRecords.ref();
+    while (!m_records.tryPush(record)) {
+        if (overflowPolicy() == OverflowDrop || !m_running.loadAcquire()) {
+            m_queuedRecords.deref();
+            m_droppedRecords.ref();
+            return;
+        }
+
+        // Let the writer catch up.
+        wakeWriter();
+        QThread::yieldCurrentThread();
+    }
+
+    if (m_writerSleeping.loadAcquire()) {
+        wakeWriter();
+    }
+}
+
+void AsyncLogSink::flush()
+{
+    quint64 queuedRecords = m_queuedRecords.loadAcquire();
+
+    QMutexLocker mutexLocker(&m_mutex);
+    while (m_running.loadAcquire() && m_writtenRecords.loadAcquire() < queuedRecords) {
+        m_recordsQueued.wakeOne();
+        m_recordsWritten.wait(&m_mutex, 100);
+    }
+}
+
+quint64 AsyncLogSink::droppedRecords() const
+{
+    return m_droppedRecords.loadRelaxed();
+}
+
+void AsyncLogSink::run()
+{
+    QByteArray batch;
+    QByteArray record;
+    quint64 batchRecords = 0;
+    forever {
+        // Collect as many records as are available into a single write.
+        while (batch.size() < 256 * 1024 && m_records.tryPop(record)) {
+            batch += record;
+            batchRecords++;
+        }
+
+        if (batchRecords > 0) {
+            m_file.write(batch);
+            batch.clear();
+            m_writtenRecords.fetchAndAddRelease(batchRecords);
+            batchRecords = 0;
+            continue;
+        }
+
+        // The buffer is empty, make sure everything has reached the file.
+        m_file.flush();
+        {
+            QMutexLocker mutexLocker(&m_mutex);
+            m_recordsWritten.wakeAll();
+        }
+
+        // Everything queued before close() has been written by now.
+        if (!m_running.loadAcquire()) {
+            break;
+        }
+
+        // Sleep until records arrive. A producer may miss that we are going
+        // to sleep, so do not sleep for too long.
+        QMutexLocker mutexLocker(&m_mutex);
+        m_writerSleeping.storeRelease(1);
+        if (m_records.tryPop(record)) {
+            batch += record;
+            batchRecords++;
+        } else {
+            m_recordsQueued.wait(&m_mutex, 50);
+        }
+        m_writerSleeping.storeRelease(0);
+    }
+}
+
+void AsyncLogSink::wakeWriter()
+{
+    QMutexLocker mutexLocker(&m_mutex);
+    m_recordsQueued.wakeOne();
+}
+
+} // namespace QtWebServer
@@ -0,0 +1,101 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Own includes
+#include "misc/mpscringbuffer.h"
+
+// Qt includes
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+namespace QtWebServer {
+
+/**
+ * Writes log records to a file from a background thread. Producers push
+ * formatted records into a lock-free ring buffer and return immediately,
+ * the writer thread keeps the file open and writes records in batches.
+ */
+class AsyncLogSink : public QThread {
+    Q_OBJECT
+public:
+    enum OverflowPolicy {
+        /** Records that do not fit into the buffer are dropped. */
+        OverflowDrop,
+        /** Producers wait until the writer has made room. */
+        OverflowBlock
+    };
+
+    AsyncLogSink(QString fileName, int capacity = 8192, QObject* parent = 0);
+    ~AsyncLogSink();
+
+    /**
+     * Opens the file for appending and starts the writer thread.
+     * @returns false, if the file could not be opened.
+     */
+    bool open();
+
+    /** Writes all pending records, closes the file and stops the writer thread. */
+    void close();
+
+    OverflowPolicy overflowPolicy() const;
+    void setOverflowPolicy(OverflowPolicy overflowPolicy);
+
+    /**
+     * Queues a record for writing. May be called from any thread.
+     * @param record The record, including its line break.
+     */
+    void write(QByteArray record);
+
+    /** Waits until all records queued so far have been written to the file. */
+    void flush();
+
+    /** @returns the number of records dropped because the buffer was full. */
+    quint64 droppedRecords() const;
+
+protected:
+    void run();
+
+private:
+    void wakeWriter();
+
+    QFile m_file;
+    MpscRingBuffer<QByteArray> m_records;
+    QAtomicInt m_overflowPolicy;
+    QAtomicInt m_running;
+    QAtomicInt m_writerSleeping;
+    QAtomicInteger<quint64> m_queuedRecords;
+    QAtomicInteger<quint64> m_writtenRecords;
+    QAtomicInteger<quint64> m_droppedRecords;
+
+    QMutex m_mutex;
+    QWaitCondition m_recordsQueued;
+    QWaitCondition m_recordsWritten;
+};
+
+} // namespace QtWebServer
@@ -27,9 +27,9 @@
 // Standard includes
 #include <iostream>
 
+#include <QCoreApplication>
 #include <QDateTime>
 #include <QDebug>
-#include <QFile>
 
 namespace QtWebServer {
 
@@ -45,30 +45,89 @@ Log* Log::instance()
 
 Log::LoggingMode Log::loggingMode()
 {
-    return m_loggingMode.r();
+    return LoggingMode(m_loggingMode.loadRelaxed());
 }
 
 void Log::setLoggingMode(Log::LoggingMode loggingMode)
 {
-    m_loggingMode = loggingMode;
+    m_loggingMode.storeRelaxed(loggingMode);
 }
 
-void Log::setLoggingFile(QString logfile)
+Log::EntryType Log::minimumEntryType()
+{
+    return EntryType(m_minimumEntryType.loadRelaxed());
+}
+
+void Log::setMinimumEntryType(Log::EntryType entryType)
 {
-    QFile file(logfile);
+    m_minimumEntryType.storeRelaxed(entryType);
+}
 
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+void Log::setLoggingFile(QString logfile)
+{
+    AsyncLogSink* logSink = new AsyncLogSink(logfile);
+    logSink->setOverflowPolicy(m_overflowPolicy.r());
+    if (!logSink->open()) {
         qDebug() << "Can`t log to file " << logfile;
         exit(EXIT_FAILURE);
     }
-    m_logFile = logfile;
+
+    MutexLocker mutexLocker(m_logSinksMutex);
+    Q_UNUSED(mutexLocker);
+    AsyncLogSink* replacedLogSink = m_logSink.fetchAndStoreOrdered(logSink);
+    if (replacedLogSink) {
+        replacedLogSink->close();
+        m_replacedLogSinks.append(replacedLogSink);
+    }
+}
+
+AsyncLogSink::OverflowPolicy Log::overflowPolicy()
+{
+    return m_overflowPolicy.r();
+}
+
+void Log::setOverflowPolicy(AsyncLogSink::OverflowPolicy overflowPolicy)
+{
+    m_overflowPolicy = overflowPolicy;
+
+    AsyncLogSink* logSink = m_logSink.loadAcquire();
+    if (logSink) {
+        logSink->setOverflowPolicy(overflowPolicy);
+    }
+}
+
+void Log::flush()
+{
+    AsyncLogSink* logSink = m_logSink.loadAcquire();
+    if (logSink) {
+        logSink->flush();
+    }
+}
+
+void Log::shutdown()
+{
+    Log* log = m_instance;
+    if (!log) {
+        return;
+    }
+
+    MutexLocker mutexLocker(log->m_logSinksMutex);
+    Q_UNUSED(mutexLocker);
+    AsyncLogSink* logSink = log->m_logSink.fetchAndStoreOrdered(0);
+    if (logSink) {
+        logSink->close();
+        log->m_replacedLogSinks.append(logSink);
+    }
+    qDeleteAll(log->m_replacedLogSinks);
+    log->m_replacedLogSinks.clear();
 }
 
 void Log::log(QString name, QString message, EntryType entryType)
 {
-    if (loggingMode() == LoggingModeNone) {
+    if (!isLogged(entryType)) {
         return;
     }
+    LoggingMode mode = loggingMode();
 
     QString logMessage;
 
@@ -87,30 +146,35 @@ void Log::log(QString name, QString message, EntryType entryType)
         break;
     }
 
-    if (loggingMode() == LoggingModeConsole) {
+    if (mode == LoggingModeConsole) {
         std::cout << logMessage.toStdString() << std::endl;
     }
 
-    if (loggingMode() == LoggingToDebug) {
+    if (mode == LoggingToDebug) {
         qDebug() << logMessage;
     }
 
-    if (loggingMode() == LoggingToFile) {
-        QFile logFile(m_logFile);
-        if (logFile.open(QIODevice::ReadWrite)) {
-            QTextStream stream(&logFile);
-            stream << QDateTime::currentDateTime().toString() << " " << logMessage << Qt::endl;
-            logFile.close();
-        } else {
-            qDebug() << "Can`t log to file " << m_logFile;
-            exit(EXIT_FAILURE);
+    if (mode == LoggingToFile) {
+        // The entry is formatted here, writing it is left to the sink's thread.
+        AsyncLogSink* logSink = m_logSink.loadAcquire();
+        if (logSink) {
+            QByteArray record = QDateTime::currentDateTime().toString().toUtf8();
+            record += ' ';
+            record += logMessage.toUtf8();
+            record += '\n';
+            logSink->write(record);
         }
     }
 }
 
 Log::Log()
 {
-    m_loggingMode = LoggingModeConsole;
+    m_loggingMode.storeRelaxed(LoggingModeConsole);
+    m_minimumEntryType.storeRelaxed(Verbose);
+    m_overflowPolicy = AsyncLogSink::OverflowDrop;
+
+    // Pending entries are written when the application shuts down.
+    qAddPostRoutine(&Log::shutdown);
 }
 
 } // namespace QtWebServer
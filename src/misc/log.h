@@ -24,9 +24,14 @@
 #pragma once
 
 // Own includes
+#include "misc/asynclogsink.h"
+#include "misc/logconfig.h"
 #include "misc/threadsafety.h"
 
 // Qt includes
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QList>
 #include <QString>
 
 namespace QtWebServer {
@@ -54,18 +59,59 @@ public:
 
     LoggingMode loggingMode();
     void setLoggingMode(LoggingMode loggingMode);
+
+    /** @returns the lowest type of entries that are logged. */
+    EntryType minimumEntryType();
+
+    /** Sets the lowest type of entries that are logged. */
+    void setMinimumEntryType(EntryType entryType);
+
+    /**
+     * @returns true, if entries of the given type are logged. This is cheap
+     * enough to be checked before formatting a message.
+     */
+    bool isLogged(EntryType entryType) const
+    {
+        return entryType >= QTWEBSERVER_MINIMUM_LOG_LEVEL
+            && entryType >= m_minimumEntryType.loadRelaxed()
+            && m_loggingMode.loadRelaxed() != LoggingModeNone;
+    }
+
+    /**
+     * Sets the file to log to. The file is kept open and written from a
+     * background thread, log calls only queue the formatted entry.
+     */
     void setLoggingFile(QString logfile);
 
+    /** @returns what happens to log entries when the log buffer is full. */
+    AsyncLogSink::OverflowPolicy overflowPolicy();
+
+    /** Sets what happens to log entries when the log buffer is full. */
+    void setOverflowPolicy(AsyncLogSink::OverflowPolicy overflowPolicy);
+
+    /** Waits until all entries logged so far have been written to the file. */
+    void flush();
+
 protected:
     void log(QString name, QString message, EntryType entryType);
 
 private:
     Log();
 
-    ThreadGuard<LoggingMode> m_loggingMode;
+    /** Writes all pending entries and closes the log file on shutdown. */
+    static void shutdown();
+
+    QAtomicInt m_loggingMode;
+    QAtomicInt m_minimumEntryType;
+    ThreadGuard<AsyncLogSink::OverflowPolicy> m_overflowPolicy;
 
     static Log* m_instance;
-    QString m_logFile;
+    QAtomicPointer<AsyncLogSink> m_logSink;
+
+    // Sinks that have been replaced may still be in use by other threads,
+    // so they are closed, but only deleted on shutdown.
+    QList<AsyncLogSink*> m_replacedLogSinks;
+    QMutex m_logSinksMutex;
 };
 
 } // namespace QtWebServer
@@ -29,6 +29,19 @@
 // Qt includes
 #include <QString>
 
+/**
+ * Logs a message through a Logger, but only builds the message if the entry
+ * is going to be logged. Entries below QTWEBSERVER_MINIMUM_LOG_LEVEL are
+ * removed at compile time, for example:
+ *   QTWEBSERVER_LOG(*this, Log::Verbose, QString("Read %1 bytes").arg(bytes));
+ */
+#define QTWEBSERVER_LOG(logger, entryType, message)                                   \
+    do {                                                                              \
+        if ((entryType) >= QTWEBSERVER_MINIMUM_LOG_LEVEL && (logger).isLogged(entryType)) { \
+            (logger).log((message), (entryType));                                     \
+        }                                                                             \
+    } while (0)
+
 namespace QtWebServer {
 
 class Logger {
@@ -38,6 +51,24 @@ public:
 
     void log(QString message, Log::EntryType entryType = Log::Verbose);
 
+    /** @returns true, if entries of the given type are logged. */
+    bool isLogged(Log::EntryType entryType) const
+    {
+        return Log::instance()->isLogged(entryType);
+    }
+
+    /**
+     * Logs a message built by the given function, which is only called if
+     * the entry is going to be logged.
+     */
+    template <typename Formatter>
+    void logLazily(Formatter formatter, Log::EntryType entryType = Log::Verbose)
+    {
+        if (entryType >= QTWEBSERVER_MINIMUM_LOG_LEVEL && isLogged(entryType)) {
+            log(formatter(), entryType);
+        }
+    }
+
 private:
     QString m_name;
 };
@@ -0,0 +1,436 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "metrics.h"
+
+// Qt includes
+#include <QLocale>
+
+// Standard includes
+#include <cmath>
+#include <cstring>
+
+namespace QtWebServer {
+
+/**
+ * Slots of a single thread. Only the owning thread writes to them, so
+ * updates are plain loads and stores, blocks are allocated on first use.
+ */
+class Metrics::Shard {
+public:
+    static const int BlockSize = 256;
+    static const int MaxBlocks = 4096;
+
+    struct Block {
+        QAtomicInteger<quint64> slots[BlockSize];
+    };
+
+    Shard()
+    {
+        for (int i = 0; i < MaxBlocks; i++) {
+            m_blocks[i].storeRelaxed(0);
+        }
+    }
+
+    ~Shard()
+    {
+        for (int i = 0; i < MaxBlocks; i++) {
+            delete m_blocks[i].loadRelaxed();
+        }
+    }
+
+    /** @returns a slot for writing, must only be called by the owning thread. */
+    QAtomicInteger<quint64>& slot(int index)
+    {
+        Block* block = m_blocks[index / BlockSize].loadRelaxed();
+        if (!block) {
+            block = new Block();
+            m_blocks[index / BlockSize].storeRelease(block);
+        }
+        return block->slots[index % BlockSize];
+    }
+
+    /** @returns the value of a slot, may be called from any thread. */
+    quint64 value(int index) const
+    {
+        Block* block = m_blocks[index / BlockSize].loadAcquire();
+        return block ? block->slots[index % BlockSize].loadRelaxed() : 0;
+    }
+
+private:
+    QAtomicPointer<Block> m_blocks[MaxBlocks];
+};
+
+/** Hands the shard of a finished thread back to the registry. */
+struct Metrics::LocalShard {
+    Shard* shard = 0;
+
+    ~LocalShard()
+    {
+        if (shard) {
+            Metrics::instance().retireShard(shard);
+            shard = 0;
+        }
+    }
+};
+
+namespace {
+
+    double toDouble(quint64 bits)
+    {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    quint64 fromDouble(double value)
+    {
+        quint64 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+} // namespace
+
+Metrics::Metrics()
+    : m_histogramCount(0)
+    , m_nextGaugeId(0)
+    , m_slotCount(0)
+{
+    for (int i = 0; i < MaxHistograms; i++) {
+        m_histograms[i].storeRelaxed(0);
+    }
+}
+
+Metrics::~Metrics()
+{
+    qDeleteAll(m_shards);
+    for (int i = 0; i < MaxHistograms; i++) {
+        delete m_histograms[i].loadRelaxed();
+    }
+}
+
+Metrics& Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+int Metrics::counter(const QByteArray& name, const QByteArray& help, const Labels& labels)
+{
+    return registerSeries(CounterType, name, help, labels, QList<double>());
+}
+
+int Metrics::histogram(const QByteArray& name,
+    const QByteArray& help,
+    const Labels& labels,
+    const QList<double>& bucketBounds)
+{
+    return registerSeries(HistogramType, name, help, labels, bucketBounds);
+}
+
+QList<double> Metrics::defaultBucketBounds()
+{
+    return QList<double>() << 0.0005 << 0.001 << 0.0025 << 0.005 << 0.01 << 0.025
+                           << 0.05 << 0.1 << 0.25 << 0.5 << 1 << 2.5 << 5 << 10;
+}
+
+int Metrics::addGauge(const QByteArray& name, const QByteArray& help, GaugeCallback callback)
+{
+    QMutexLocker mutexLocker(&m_gaugesMutex);
+    Gauge gauge;
+    gauge.name = name;
+    gauge.help = help;
+    gauge.callback = callback;
+    m_gauges.insert(m_nextGaugeId, gauge);
+    return m_nextGaugeId++;
+}
+
+void Metrics::removeGauge(int gaugeId)
+{
+    QMutexLocker mutexLocker(&m_gaugesMutex);
+    m_gauges.remove(gaugeId);
+}
+
+void Metrics::increment(int counterId, quint64 amount)
+{
+    if (counterId < 0) {
+        return;
+    }
+
+    QAtomicInteger<quint64>& slot = localShard()->slot(counterId);
+    slot.storeRelaxed(slot.loadRelaxed() + amount);
+}
+
+void Metrics::observe(int histogramId, double value)
+{
+    if (histogramId < 0 || histogramId >= MaxHistograms) {
+        return;
+    }
+
+    const HistogramLayout* layout = m_histograms[histogramId].loadAcquire();
+    if (!layout) {
+        return;
+    }
+
+    // Find the bucket, the last one takes values above all bounds.
+    int bucket = 0;
+    int bucketCount = layout->bucketBounds.size();
+    while (bucket < bucketCount && value > layout->bucketBounds.at(bucket)) {
+        bucket++;
+    }
+
+    Shard* shard = localShard();
+    QAtomicInteger<quint64>& bucketSlot = shard->slot(layout->firstSlot + bucket);
+    bucketSlot.storeRelaxed(bucketSlot.loadRelaxed() + 1);
+
+    QAtomicInteger<quint64>& sumSlot = shard->slot(layout->firstSlot + bucketCount + 1);
+    sumSlot.storeRelaxed(fromDouble(toDouble(sumSlot.loadRelaxed()) + value));
+}
+
+quint64 Metrics::counterValue(int counterId)
+{
+    if (counterId < 0) {
+        return 0;
+    }
+
+    QMutexLocker mutexLocker(&m_mutex);
+    quint64 value = counterId < m_retiredSlots.size() ? m_retiredSlots.at(counterId) : 0;
+    for (Shard* shard : m_shards) {
+        value += shard->value(counterId);
+    }
+    return value;
+}
+
+QByteArray Metrics::exposition()
+{
+    QMutexLocker mutexLocker(&m_mutex);
+    QVector<quint64> slots = mergedSlots();
+
+    QByteArray text;
+    for (const Family& family : m_families) {
+        text += "# HELP " + family.name + ' ' + family.help + '\n';
+        text += "# TYPE " + family.name + (family.type == CounterType ? " counter\n" : " histogram\n");
+
+        for (int seriesIndex : family.seriesIds) {
+            const Series& series = m_series.at(seriesIndex);
+            if (family.type == CounterType) {
+                text += series.name;
+                appendLabels(text, series.labels);
+                text += ' ' + QByteArray::number(slots.at(series.firstSlot)) + '\n';
+                continue;
+            }
+
+            // Buckets are exposed cumulatively.
+            quint64 count = 0;
+            int bucketCount = series.bucketBounds.size();
+            for (int bucket = 0; bucket <= bucketCount; bucket++) {
+                count += slots.at(series.firstSlot + bucket);
+                Labels labels = series.labels;
+                labels.append(qMakePair(QByteArray("le"),
+                    bucket < bucketCount ? formatValue(series.bucketBounds.at(bucket)) : QByteArray("+Inf")));
+                text += series.name + "_bucket";
+                appendLabels(text, labels);
+                text += ' ' + QByteArray::number(count) + '\n';
+            }
+            text += series.name + "_sum";
+            appendLabels(text, series.labels);
+            text += ' ' + formatValue(toDouble(slots.at(series.firstSlot + bucketCount + 1))) + '\n';
+            text += series.name + "_count";
+            appendLabels(text, series.labels);
+            text += ' ' + QByteArray::number(count) + '\n';
+        }
+    }
+
+    mutexLocker.unlock();
+
+    // Gauges may read counters, so they are called without holding the
+    // series locked.
+    QMutexLocker gaugesMutexLocker(&m_gaugesMutex);
+    QMap<QByteArray, QByteArray> gaugeTexts;
+    for (const Gauge& gauge : m_gauges) {
+        QByteArray& gaugeText = gaugeTexts[gauge.name];
+        if (gaugeText.isEmpty()) {
+            gaugeText += "# HELP " + gauge.name + ' ' + gauge.help + '\n';
+            gaugeText += "# TYPE " + gauge.name + " gauge\n";
+        }
+        for (const GaugeSample& sample : gauge.callback()) {
+            gaugeText += gauge.name;
+            appendLabels(gaugeText, sample.labels);
+            gaugeText += ' ' + formatValue(sample.value) + '\n';
+        }
+    }
+
+    for (const QByteArray& gaugeText : gaugeTexts) {
+        text += gaugeText;
+    }
+    return text;
+}
+
+int Metrics::registerSeries(Type type,
+    const QByteArray& name,
+    const QByteArray& help,
+    const Labels& labels,
+    const QList<double>& bucketBounds)
+{
+    QMutexLocker mutexLocker(&m_mutex);
+
+    Family& family = m_families[name];
+    if (family.name.isEmpty()) {
+        family.name = name;
+        family.help = help;
+        family.type = type;
+    } else if (family.type != type) {
+        return -1;
+    }
+
+    for (int seriesIndex : family.seriesIds) {
+        const Series& series = m_series.at(seriesIndex);
+        if (series.labels == labels) {
+            return type == CounterType ? series.firstSlot : series.histogramId;
+        }
+    }
+
+    int slotCount = type == CounterType ? 1 : bucketBounds.size() + 2;
+    if (m_slotCount + slotCount > Shard::BlockSize * Shard::MaxBlocks) {
+        return -1;
+    }
+
+    Series series;
+    series.name = name;
+    series.labels = labels;
+    series.firstSlot = m_slotCount;
+    series.histogramId = -1;
+
+    if (type == CounterType) {
+        m_slotCount++;
+        m_doubleSlots.append(false);
+    } else {
+        if (m_histogramCount == MaxHistograms) {
+            return -1;
+        }
+
+        // A slot per bucket, one for values above all bounds and one for the sum.
+        series.bucketBounds = bucketBounds;
+        series.histogramId = m_histogramCount++;
+        m_slotCount += slotCount;
+        for (int i = 0; i <= bucketBounds.size(); i++) {
+            m_doubleSlots.append(false);
+        }
+        m_doubleSlots.append(true);
+
+        HistogramLayout* layout = new HistogramLayout();
+        layout->firstSlot = series.firstSlot;
+        layout->bucketBounds = bucketBounds;
+        m_histograms[series.histogramId].storeRelease(layout);
+    }
+
+    family.seriesIds.append(m_series.size());
+    m_series.append(series);
+    return type == CounterType ? series.firstSlot : series.histogramId;
+}
+
+Metrics::Shard* Metrics::localShard()
+{
+    static thread_local LocalShard localShard;
+    if (!localShard.shard) {
+        localShard.shard = new Shard();
+        QMutexLocker mutexLocker(&m_mutex);
+        m_shards.append(localShard.shard);
+    }
+    return localShard.shard;
+}
+
+void Metrics::retireShard(Shard* shard)
+{
+    // Keep what the thread has recorded, the shard itself goes away.
+    QMutexLocker mutexLocker(&m_mutex);
+    m_shards.removeAll(shard);
+    m_retiredSlots.resize(m_slotCount);
+    for (int i = 0; i < m_slotCount; i++) {
+        if (m_doubleSlots.at(i)) {
+            m_retiredSlots[i] = fromDouble(toDouble(m_retiredSlots.at(i)) + toDouble(shard->value(i)));
+        } else {
+            m_retiredSlots[i] += shard->value(i);
+        }
+    }
+    delete shard;
+}
+
+QVector<quint64> Metrics::mergedSlots()
+{
+    QVector<quint64> slots = m_retiredSlots;
+    slots.resize(m_slotCount);
+    for (Shard* shard : m_shards) {
+        for (int i = 0; i < m_slotCount; i++) {
+            if (m_doubleSlots.at(i)) {
+                slots[i] = fromDouble(toDouble(slots.at(i)) + toDouble(shard->value(i)));
+            } else {
+                slots[i] += shard->value(i);
+            }
+        }
+    }
+    return slots;
+}
+
+void Metrics::appendLabels(QByteArray& line, const Labels& labels)
+{
+    if (labels.isEmpty()) {
+        return;
+    }
+
+    line += '{';
+    for (int i = 0; i < labels.size(); i++) {
+        if (i > 0) {
+            line += ',';
+        }
+        line += labels.at(i).first;
+        line += "=\"";
+        for (char c : labels.at(i).second) {
+            if (c == '\\' || c == '"') {
+                line += '\\';
+                line += c;
+            } else if (c == '\n') {
+                line += "\\n";
+            } else {
+                line += c;
+            }
+        }
+        line += '"';
+    }
+    line += '}';
+}
+
+QByteArray Metrics::formatValue(double value)
+{
+    if (std::isinf(value)) {
+        return value > 0 ? "+Inf" : "-Inf";
+    }
+    if (std::isnan(value)) {
+        return "NaN";
+    }
+    return QByteArray::number(value, 'g', QLocale::FloatingPointShortest);
+}
+
+} // namespace QtWebServer
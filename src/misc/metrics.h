@@ -0,0 +1,185 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QVector>
+
+// Standard includes
+#include <functional>
+
+namespace QtWebServer {
+
+/**
+ * Registry for counters, histograms and gauges, exposed in the Prometheus
+ * text format. Counters and histograms are recorded into shards owned by
+ * the recording thread, so recording does not contend with other threads.
+ * Shards are only merged when the metrics are exposed. Gauges are computed
+ * by callbacks at that time.
+ *
+ * Series are registered once, which takes a lock, and then recorded through
+ * their identifier:
+ *   static const int requests = Metrics::instance().counter("requests_total", "Requests served.");
+ *   Metrics::instance().increment(requests);
+ */
+class Metrics {
+public:
+    typedef QList<QPair<QByteArray, QByteArray>> Labels;
+
+    struct GaugeSample {
+        Labels labels;
+        double value;
+    };
+
+    typedef std::function<QList<GaugeSample>()> GaugeCallback;
+
+    static Metrics& instance();
+
+    /**
+     * Registers a counter series, or returns the one registered before with
+     * the same name and labels.
+     * @returns the identifier of the series, or -1 if the name has been
+     * registered as a histogram or the registry is full.
+     */
+    int counter(const QByteArray& name, const QByteArray& help, const Labels& labels = Labels());
+
+    /**
+     * Registers a histogram series, or returns the one registered before
+     * with the same name and labels.
+     * @param bucketBounds Ascending upper bounds of the buckets.
+     * @returns the identifier of the series, or -1 if the name has been
+     * registered as a counter or the registry is full.
+     */
+    int histogram(const QByteArray& name,
+        const QByteArray& help,
+        const Labels& labels = Labels(),
+        const QList<double>& bucketBounds = defaultBucketBounds());
+
+    /** @returns bucket bounds suitable for latencies in seconds. */
+    static QList<double> defaultBucketBounds();
+
+    /**
+     * Registers a gauge whose samples are computed when the metrics are
+     * exposed. The callback is called from the exposing thread and must not
+     * add or remove gauges. Gauges of the same name are exposed as one.
+     * @returns an identifier to remove the gauge with.
+     */
+    int addGauge(const QByteArray& name, const QByteArray& help, GaugeCallback callback);
+
+    /** Removes a gauge. Its callback is not called anymore once this returns. */
+    void removeGauge(int gaugeId);
+
+    /** Adds to a counter. Does not block or contend with other threads. */
+    void increment(int counterId, quint64 amount = 1);
+
+    /** Records a value in a histogram. Does not block or contend with other threads. */
+    void observe(int histogramId, double value);
+
+    /** @returns the current value of a counter, merged over all threads. */
+    quint64 counterValue(int counterId);
+
+    /** @returns all metrics in the Prometheus text exposition format. */
+    QByteArray exposition();
+
+private:
+    Metrics();
+    ~Metrics();
+
+    class Shard;
+    struct LocalShard;
+
+    /** Maximum number of histogram series. */
+    static const int MaxHistograms = 4096;
+
+    enum Type {
+        CounterType,
+        HistogramType
+    };
+
+    struct Series {
+        QByteArray name;
+        Labels labels;
+        QList<double> bucketBounds;
+        int firstSlot;
+        int histogramId;
+    };
+
+    /** What observe() needs to know about a histogram, immutable once published. */
+    struct HistogramLayout {
+        int firstSlot;
+        QList<double> bucketBounds;
+    };
+
+    struct Family {
+        QByteArray name;
+        QByteArray help;
+        Type type;
+        QList<int> seriesIds;
+    };
+
+    struct Gauge {
+        QByteArray name;
+        QByteArray help;
+        GaugeCallback callback;
+    };
+
+    int registerSeries(Type type,
+        const QByteArray& name,
+        const QByteArray& help,
+        const Labels& labels,
+        const QList<double>& bucketBounds);
+
+    Shard* localShard();
+    void retireShard(Shard* shard);
+
+    /** @returns the sum of all shards, including those of finished threads. */
+    QVector<quint64> mergedSlots();
+
+    static void appendLabels(QByteArray& line, const Labels& labels);
+    static QByteArray formatValue(double value);
+
+    QMutex m_mutex;
+    QList<Series> m_series;
+    QAtomicPointer<const HistogramLayout> m_histograms[MaxHistograms];
+    int m_histogramCount;
+    QMap<QByteArray, Family> m_families;
+
+    /** Held while gauge callbacks are called, separately from the series. */
+    QMutex m_gaugesMutex;
+    QMap<int, Gauge> m_gauges;
+    int m_nextGaugeId;
+    int m_slotCount;
+    QVector<bool> m_doubleSlots;
+    QList<Shard*> m_shards;
+    QVector<quint64> m_retiredSlots;
+};
+
+} // namespace QtWebServer
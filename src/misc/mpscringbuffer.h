@@ -0,0 +1,136 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QAtomicInteger>
+
+// Standard includes
+#include <utility>
+
+namespace QtWebServer {
+
+/**
+ * Bounded lock-free queue for many producers and a single consumer. Every
+ * cell carries a sequence number telling whether it is free to be written
+ * or ready to be read, so producers only contend on the enqueue position.
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class MpscRingBuffer {
+public:
+    MpscRingBuffer(int capacity)
+        : m_enqueuePosition(0)
+        , m_dequeuePosition(0)
+    {
+        quint64 size = 2;
+        while (size < quint64(capacity)) {
+            size *= 2;
+        }
+
+        m_mask = size - 1;
+        m_cells = new Cell[size];
+        for (quint64 i = 0; i < size; i++) {
+            m_cells[i].sequence.storeRelaxed(i);
+        }
+    }
+
+    ~MpscRingBuffer()
+    {
+        delete[] m_cells;
+    }
+
+    /** @returns the number of values the buffer holds. */
+    int capacity() const
+    {
+        return int(m_mask + 1);
+    }
+
+    /**
+     * Pushes a value. May be called from any thread.
+     * @param value The value to push. It is moved from only on success.
+     * @returns false, if the buffer is full.
+     */
+    bool tryPush(T& value)
+    {
+        quint64 position = m_enqueuePosition.loadRelaxed();
+        for (;;) {
+            Cell& cell = m_cells[position & m_mask];
+            qint64 difference = qint64(cell.sequence.loadAcquire()) - qint64(position);
+            if (difference == 0) {
+                // The cell is free, try to claim it.
+                if (m_enqueuePosition.testAndSetRelaxed(position, position + 1, position)) {
+                    cell.value = std::move(value);
+                    cell.sequence.storeRelease(position + 1);
+                    return true;
+                }
+            } else if (difference < 0) {
+                // The consumer has not read this cell yet.
+                return false;
+            } else {
+                // Another producer has claimed the cell in the meantime.
+                position = m_enqueuePosition.loadRelaxed();
+            }
+        }
+    }
+
+    /**
+     * Pops a value. Must only be called from the consuming thread.
+     * @param value Receives the value.
+     * @returns false, if the buffer is empty.
+     */
+    bool tryPop(T& value)
+    {
+        Cell& cell = m_cells[m_dequeuePosition & m_mask];
+        qint64 difference = qint64(cell.sequence.loadAcquire()) - qint64(m_dequeuePosition + 1);
+        if (difference < 0) {
+            return false;
+        }
+
+        value = std::move(cell.value);
+        cell.value = T();
+
+        // Hand the cell back to the producers for the next round.
+        cell.sequence.storeRelease(m_dequeuePosition + m_mask + 1);
+        m_dequeuePosition++;
+        return true;
+    }
+
+private:
+    MpscRingBuffer(const MpscRingBuffer&) { }
+
+    struct Cell {
+        QAtomicInteger<quint64> sequence;
+        T value;
+    };
+
+    Cell* m_cells;
+    quint64 m_mask;
+
+    // Producers and the consumer work on different cache lines.
+    alignas(64) QAtomicInteger<quint64> m_enqueuePosition;
+    alignas(64) quint64 m_dequeuePosition;
+};
+
+} // namespace QtWebServer
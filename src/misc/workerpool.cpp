@@ -0,0 +1,126 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "workerpool.h"
+#include "metrics.h"
+
+// Qt includes
+#include <QElapsedTimer>
+
+namespace QtWebServer {
+
+WorkerPool::WorkerPool(QString name, int threadCount, int maxQueued)
+    : m_name(name)
+    , m_threadCount(threadCount)
+    , m_maxQueued(maxQueued)
+    , m_rejectionPolicy(RejectWhenFull)
+    , m_pendingTasks(0)
+{
+    m_threadPool.setMaxThreadCount(threadCount);
+
+    Metrics& metrics = Metrics::instance();
+    Metrics::Labels labels;
+    labels << qMakePair(QByteArray("pool"), name.toUtf8());
+    m_queueWaitHistogram = metrics.histogram("qtwebserver_worker_queue_wait_seconds",
+        "Time tasks have waited for a worker thread.", labels);
+    m_rejectionCounter = metrics.counter("qtwebserver_worker_rejected_tasks_total",
+        "Tasks rejected because the worker queue was full.", labels);
+    m_pendingGaugeId = metrics.addGauge("qtwebserver_worker_pending_tasks",
+        "Tasks running or waiting on a worker pool.",
+        [this, labels]() {
+            Metrics::GaugeSample sample;
+            sample.labels = labels;
+            sample.value = pendingTasks();
+            return QList<Metrics::GaugeSample>() << sample;
+        });
+}
+
+WorkerPool::~WorkerPool()
+{
+    Metrics::instance().removeGauge(m_pendingGaugeId);
+    m_threadPool.waitForDone();
+}
+
+QString WorkerPool::name() const
+{
+    return m_name;
+}
+
+int WorkerPool::threadCount() const
+{
+    return m_threadCount.loadRelaxed();
+}
+
+void WorkerPool::setThreadCount(int threadCount)
+{
+    m_threadPool.setMaxThreadCount(threadCount);
+    m_threadCount.storeRelaxed(threadCount);
+}
+
+int WorkerPool::maxQueued() const
+{
+    return m_maxQueued.loadRelaxed();
+}
+
+void WorkerPool::setMaxQueued(int maxQueued)
+{
+    m_maxQueued.storeRelaxed(maxQueued);
+}
+
+WorkerPool::RejectionPolicy WorkerPool::rejectionPolicy() const
+{
+    return static_cast<RejectionPolicy>(m_rejectionPolicy.loadRelaxed());
+}
+
+void WorkerPool::setRejectionPolicy(RejectionPolicy rejectionPolicy)
+{
+    m_rejectionPolicy.storeRelaxed(rejectionPolicy);
+}
+
+bool WorkerPool::tryStart(std::function<void()> task)
+{
+    // Reserve a place first, so concurrent callers cannot exceed the limit.
+    int pendingTasks = m_pendingTasks.fetchAndAddRelaxed(1);
+    if (pendingTasks >= threadCount() + maxQueued()) {
+        m_pendingTasks.fetchAndAddRelaxed(-1);
+        Metrics::instance().increment(m_rejectionCounter);
+        return false;
+    }
+
+    QElapsedTimer queueTimer;
+    queueTimer.start();
+    m_threadPool.start([this, task, queueTimer]() {
+        Metrics::instance().observe(m_queueWaitHistogram, queueTimer.nsecsElapsed() / 1e9);
+        task();
+        m_pendingTasks.fetchAndAddRelaxed(-1);
+    });
+    return true;
+}
+
+int WorkerPool::pendingTasks() const
+{
+    return m_pendingTasks.loadRelaxed();
+}
+
+} // namespace QtWebServer
@@ -0,0 +1,111 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QAtomicInt>
+#include <QString>
+#include <QThreadPool>
+
+// Standard includes
+#include <functional>
+
+namespace QtWebServer {
+
+/**
+ * @class WorkerPool
+ * Bounded pool of threads for CPU-heavy work, kept apart from the threads
+ * doing network I/O. Tasks wait in a queue of limited length while all
+ * threads are busy. Once the queue is full, new tasks are rejected, so an
+ * overloaded pool sheds load instead of building up latency.
+ */
+class WorkerPool {
+public:
+    /** What the caller is supposed to do with a rejected task. */
+    enum RejectionPolicy {
+        /** Give up on the task, for example by answering 503 Service Unavailable. */
+        RejectWhenFull,
+        /** Run the task in the calling thread. */
+        RunInCallerWhenFull
+    };
+
+    /**
+     * @param name The name the pool is reported by in the metrics.
+     * @param threadCount The number of threads running tasks.
+     * @param maxQueued The number of tasks waiting for a thread at most.
+     */
+    WorkerPool(QString name,
+        int threadCount = QThread::idealThreadCount(),
+        int maxQueued = 64);
+
+    /** Waits for all tasks to be done. */
+    ~WorkerPool();
+
+    /** @returns the name of the pool. */
+    QString name() const;
+
+    /** @returns the number of threads running tasks. */
+    int threadCount() const;
+
+    /** Sets the number of threads running tasks. */
+    void setThreadCount(int threadCount);
+
+    /** @returns the number of tasks waiting for a thread at most. */
+    int maxQueued() const;
+
+    /** Sets the number of tasks waiting for a thread at most. */
+    void setMaxQueued(int maxQueued);
+
+    /** @returns the rejection policy. */
+    RejectionPolicy rejectionPolicy() const;
+
+    /** Sets the rejection policy, which is RejectWhenFull by default. */
+    void setRejectionPolicy(RejectionPolicy rejectionPolicy);
+
+    /**
+     * Runs a task on a thread of the pool, unless the queue is full.
+     * @param task The task to run.
+     * @returns true, if the task has been queued.
+     */
+    bool tryStart(std::function<void()> task);
+
+    /** @returns the number of tasks running or waiting. */
+    int pendingTasks() const;
+
+private:
+    Q_DISABLE_COPY(WorkerPool)
+
+    QString m_name;
+    QThreadPool m_threadPool;
+    QAtomicInt m_threadCount;
+    QAtomicInt m_maxQueued;
+    QAtomicInt m_rejectionPolicy;
+    QAtomicInt m_pendingTasks;
+
+    int m_queueWaitHistogram;
+    int m_rejectionCounter;
+    int m_pendingGaugeId;
+};
+
+} // namespace QtWebServer
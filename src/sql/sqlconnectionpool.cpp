@@ -23,20 +23,195 @@
 
 // Own includes
 #include "sqlconnectionpool.h"
+#include "misc/metrics.h"
 
 // Qt includes
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QPromise>
+#include <QSqlError>
 #include <QStringList>
 
+// Standard includes
+#include <memory>
+#include <utility>
+
 namespace QtWebServer {
 
 namespace Sql {
 
+    ConnectionLease::ConnectionLease()
+        : m_pool(0)
+        , m_connection(-1)
+        , m_generation(0)
+    {
+    }
+
+    ConnectionLease::ConnectionLease(ConnectionPool* pool,
+        int connection,
+        int generation,
+        QSqlDatabase database,
+        SharedStatementCache statements)
+        : m_pool(pool)
+        , m_connection(connection)
+        , m_generation(generation)
+        , m_database(database)
+        , m_statements(std::move(statements))
+    {
+    }
+
+    ConnectionLease::ConnectionLease(ConnectionLease&& other)
+        : m_pool(other.m_pool)
+        , m_connection(other.m_connection)
+        , m_generation(other.m_generation)
+        , m_database(other.m_database)
+        , m_statements(std::move(other.m_statements))
+        , m_uncachedStatement(std::move(other.m_uncachedStatement))
+    {
+        other.m_pool = 0;
+        other.m_database = QSqlDatabase();
+    }
+
+    ConnectionLease::~ConnectionLease()
+    {
+        release();
+    }
+
+    ConnectionLease& ConnectionLease::operator=(ConnectionLease&& other)
+    {
+        if (this != &other) {
+            release();
+            m_pool = other.m_pool;
+            m_connection = other.m_connection;
+            m_generation = other.m_generation;
+            m_database = other.m_database;
+            m_statements = std::move(other.m_statements);
+            m_uncachedStatement = std::move(other.m_uncachedStatement);
+            other.m_pool = 0;
+            other.m_database = QSqlDatabase();
+        }
+        return *this;
+    }
+
+    bool ConnectionLease::isValid() const
+    {
+        return m_pool != 0;
+    }
+
+    QSqlDatabase ConnectionLease::database() const
+    {
+        return m_database;
+    }
+
+    QSqlQuery ConnectionLease::exec(const QString& query)
+    {
+        if (!m_pool) {
+            return QSqlQuery();
+        }
+
+        QElapsedTimer queryTimer;
+        queryTimer.start();
+        QSqlQuery sqlQuery = m_database.exec(query);
+        Metrics::instance().observe(m_pool->m_queryDurationHistogram, queryTimer.nsecsElapsed() / 1e9);
+        return sqlQuery;
+    }
+
+    QSqlQuery& ConnectionLease::prepare(const QString& query)
+    {
+        if (!m_pool) {
+            m_uncachedStatement = QSqlQuery();
+            return m_uncachedStatement;
+        }
+
+        // The cache is only used by the thread leasing the connection, so it
+        // does not need a lock.
+        QSqlQuery* statement = m_statements->object(query);
+        if (statement) {
+            Metrics::instance().increment(m_pool->m_statementCacheHitCounter);
+            statement->finish();
+            return *statement;
+        }
+
+        Metrics::instance().increment(m_pool->m_statementCacheMissCounter);
+        statement = new QSqlQuery(m_database);
+        if (!statement->prepare(query) || m_statements->maxCost() == 0) {
+            m_uncachedStatement = std::move(*statement);
+            delete statement;
+            return m_uncachedStatement;
+        }
+
+        // The statement inserted last is the last one to be dropped.
+        m_statements->insert(query, statement);
+        return *statement;
+    }
+
+    QSqlQuery& ConnectionLease::exec(const QString& query, const QVariantList& boundValues)
+    {
+        QSqlQuery& sqlQuery = prepare(query);
+        if (sqlQuery.lastError().isValid()) {
+            return sqlQuery;
+        }
+
+        for (int i = 0; i < boundValues.size(); i++) {
+            sqlQuery.bindValue(i, boundValues.at(i));
+        }
+        execPrepared(sqlQuery);
+        return sqlQuery;
+    }
+
+    QSqlQuery& ConnectionLease::exec(const QString& query, const QVariantMap& boundValues)
+    {
+        QSqlQuery& sqlQuery = prepare(query);
+        if (sqlQuery.lastError().isValid()) {
+            return sqlQuery;
+        }
+
+        for (QVariantMap::const_iterator i = boundValues.constBegin(); i != boundValues.constEnd(); ++i) {
+            sqlQuery.bindValue(i.key(), i.value());
+        }
+        execPrepared(sqlQuery);
+        return sqlQuery;
+    }
+
+    void ConnectionLease::execPrepared(QSqlQuery& sqlQuery)
+    {
+        QElapsedTimer queryTimer;
+        queryTimer.start();
+        sqlQuery.exec();
+        Metrics::instance().observe(m_pool->m_queryDurationHistogram, queryTimer.nsecsElapsed() / 1e9);
+    }
+
+    void ConnectionLease::release()
+    {
+        if (!m_pool) {
+            return;
+        }
+
+        ConnectionPool* pool = m_pool;
+        QSqlDatabase database = m_database;
+        m_pool = 0;
+        m_database = QSqlDatabase();
+        // Frees the statements in this thread, if the pool has been closed
+        // in the meantime.
+        m_statements.reset();
+        m_uncachedStatement = QSqlQuery();
+        pool->release(m_connection, m_generation, database);
+    }
+
     ConnectionPool::ConnectionPool(QObject* parent)
         : QObject(parent)
+        , m_generation(0)
+        , m_nextConnectionName(0)
     {
         QStringList drivers = QSqlDatabase::drivers();
 
         m_count = 32;
+        m_waitTimeoutMilliseconds = 5000;
+        m_maxWaiters = 64;
+        m_statementCacheSize = 64;
+
+        m_asyncThreads.setMaxThreadCount(QThread::idealThreadCount());
+        m_asyncThreads.setExpiryTimeout(-1);
 
         m_open = false;
         m_hostName = "localhost";
@@ -47,10 +222,52 @@ namespace Sql {
         m_databaseName = "";
         m_userName = "";
         m_password = "";
+
+        Metrics& metrics = Metrics::instance();
+        m_queryDurationHistogram = metrics.histogram("qtwebserver_sql_query_duration_seconds",
+            "Time spent executing queries through the connection pool.");
+        m_waitDurationHistogram = metrics.histogram("qtwebserver_sql_lease_wait_seconds",
+            "Time spent waiting for a pooled connection.");
+        m_timeoutCounter = metrics.counter("qtwebserver_sql_lease_failures_total",
+            "Connections that could not be leased.",
+            Metrics::Labels() << qMakePair(QByteArray("reason"), QByteArray("timeout")));
+        m_rejectionCounter = metrics.counter("qtwebserver_sql_lease_failures_total",
+            "Connections that could not be leased.",
+            Metrics::Labels() << qMakePair(QByteArray("reason"), QByteArray("queue_full")));
+        m_statementCacheHitCounter = metrics.counter("qtwebserver_sql_statement_cache_total",
+            "Prepared statements looked up in the per connection cache.",
+            Metrics::Labels() << qMakePair(QByteArray("result"), QByteArray("hit")));
+        m_statementCacheMissCounter = metrics.counter("qtwebserver_sql_statement_cache_total",
+            "Prepared statements looked up in the per connection cache.",
+            Metrics::Labels() << qMakePair(QByteArray("result"), QByteArray("miss")));
+        m_connectionsGaugeId = metrics.addGauge("qtwebserver_sql_connections",
+            "Connections of the pool, by whether they are leased, and threads waiting for one.",
+            [this]() {
+                QMutexLocker mutexLocker(&m_poolMutex);
+                int leased = 0;
+                for (const PooledConnection& pooledConnection : m_connections) {
+                    if (pooledConnection.leased) {
+                        leased++;
+                    }
+                }
+
+                Metrics::GaugeSample leasedSample;
+                leasedSample.labels << qMakePair(QByteArray("state"), QByteArray("leased"));
+                leasedSample.value = leased;
+                Metrics::GaugeSample idleSample;
+                idleSample.labels << qMakePair(QByteArray("state"), QByteArray("idle"));
+                idleSample.value = m_connections.size() - leased;
+                Metrics::GaugeSample waitingSample;
+                waitingSample.labels << qMakePair(QByteArray("state"), QByteArray("waiting"));
+                waitingSample.value = m_waiters.size();
+                return QList<Metrics::GaugeSample>() << leasedSample << idleSample << waitingSample;
+            });
     }
 
     ConnectionPool::~ConnectionPool()
     {
+        m_asyncThreads.waitForDone();
+        Metrics::instance().removeGauge(m_connectionsGaugeId);
     }
 
     ConnectionPool& ConnectionPool::instance()
@@ -72,22 +289,34 @@ namespace Sql {
     bool ConnectionPool::open()
     {
         close();
+        QList<PooledConnection> connections;
         int c = count();
         for (int i = 0; i < c; i++) {
-            QSqlDatabase db = QSqlDatabase::addDatabase(driverName(), QString("sql%1").arg(i));
-            db.setHostName(hostName());
-            db.setPort(port());
-            db.setConnectOptions(connectOptions());
-            db.setDatabaseName(databaseName());
-            db.setUserName(userName());
-            db.setPassword(password());
-
+            QSqlDatabase db = addDatabase();
             if (!db.open()) {
+                connections.clear();
+                db = QSqlDatabase();
                 close();
                 return false;
             }
+
+            PooledConnection pooledConnection;
+            pooledConnection.database = db;
+            pooledConnection.statements = std::make_shared<StatementCache>();
+            pooledConnection.leased = false;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
+            // Idle connections belong to no thread, so any thread leasing
+            // them can take them over.
+            db.moveToThread(0);
+            pooledConnection.lastThread = 0;
+#else
+            pooledConnection.lastThread = QThread::currentThread();
+#endif
+            connections.append(pooledConnection);
         }
-        reset();
+
+        QMutexLocker mutexLocker(&m_poolMutex);
+        m_connections = connections;
         m_open = true;
         return true;
     }
@@ -106,6 +335,22 @@ namespace Sql {
 
     void ConnectionPool::close()
     {
+        // Asynchronous queries still use the connections.
+        m_asyncThreads.waitForDone();
+
+        {
+            // Leases that are still held belong to the old generation and
+            // are ignored when released, waiting threads give up. They keep
+            // the statements of their connections until then.
+            QMutexLocker mutexLocker(&m_poolMutex);
+            m_generation++;
+            m_connections.clear();
+            m_retiredConnections.clear();
+            for (Waiter* waiter : m_waiters) {
+                waiter->connectionHandedOver.wakeOne();
+            }
+        }
+
         QStringList connectionNames = QSqlDatabase::connectionNames();
         foreach (QString connectionName, connectionNames) {
             QSqlDatabase::removeDatabase(connectionName);
@@ -148,10 +393,186 @@ namespace Sql {
         return m_password.r();
     }
 
+    ConnectionLease ConnectionPool::lease(int timeoutMilliseconds)
+    {
+        if (timeoutMilliseconds < 0) {
+            timeoutMilliseconds = waitTimeoutMilliseconds();
+        }
+        int maxWaitingThreads = maxWaiters();
+
+        QThread* thread = QThread::currentThread();
+        QElapsedTimer waitTimer;
+        waitTimer.start();
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 8, 0)
+        removeRetiredConnections(thread);
+#endif
+
+        QMutexLocker mutexLocker(&m_poolMutex);
+        if (m_connections.isEmpty()) {
+            return ConnectionLease();
+        }
+
+        int generation = m_generation;
+        int connection = takeIdleConnection(thread);
+        if (connection == -1) {
+            if (m_waiters.size() >= maxWaitingThreads) {
+                Metrics::instance().increment(m_rejectionCounter);
+                return ConnectionLease();
+            }
+
+            // Released connections are handed over to the longest waiting
+            // thread directly, so threads arriving later cannot overtake it.
+            Waiter waiter;
+            waiter.connection = -1;
+            m_waiters.append(&waiter);
+
+            QDeadlineTimer deadline(timeoutMilliseconds);
+            while (waiter.connection == -1 && generation == m_generation) {
+                if (!waiter.connectionHandedOver.wait(&m_poolMutex, deadline)) {
+                    break;
+                }
+            }
+            m_waiters.removeOne(&waiter);
+
+            if (generation != m_generation) {
+                return ConnectionLease();
+            }
+
+            connection = waiter.connection;
+            if (connection == -1) {
+                Metrics::instance().increment(m_timeoutCounter);
+                return ConnectionLease();
+            }
+        }
+
+        PooledConnection& pooledConnection = m_connections[connection];
+        pooledConnection.leased = true;
+        QThread* previousThread = pooledConnection.lastThread;
+        pooledConnection.lastThread = thread;
+        QSqlDatabase database = pooledConnection.database;
+        SharedStatementCache statements = pooledConnection.statements;
+        mutexLocker.unlock();
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
+        // Take over the connection, it does not belong to any thread while
+        // it is idle.
+        Q_UNUSED(previousThread);
+        database.moveToThread(thread);
+#else
+        if (previousThread != thread
+            && !rebindConnection(connection, generation, previousThread, database, statements)) {
+            return ConnectionLease();
+        }
+#endif
+        statements->setMaxCost(qMax(0, statementCacheSize()));
+        Metrics::instance().observe(m_waitDurationHistogram, waitTimer.nsecsElapsed() / 1e9);
+        return ConnectionLease(this, connection, generation, database, std::move(statements));
+    }
+
     QSqlQuery ConnectionPool::exec(const QString& query)
     {
-        QSqlDatabase db = QSqlDatabase::database(nextConnectionName());
-        return db.exec(query);
+        return threadLease().exec(query);
+    }
+
+    QSqlQuery& ConnectionPool::exec(const QString& query, const QVariantList& boundValues)
+    {
+        return threadLease().exec(query, boundValues);
+    }
+
+    QFuture<QueryResult> ConnectionPool::execAsync(const QString& query, const QVariantList& boundValues)
+    {
+        return execAsync([query, boundValues](ConnectionLease& connectionLease) {
+            return QueryResult(connectionLease.exec(query, boundValues));
+        });
+    }
+
+    QFuture<QueryResult> ConnectionPool::execAsync(const QString& query, const QVariantMap& boundValues)
+    {
+        return execAsync([query, boundValues](ConnectionLease& connectionLease) {
+            return QueryResult(connectionLease.exec(query, boundValues));
+        });
+    }
+
+    QFuture<QueryResult> ConnectionPool::execAsync(std::function<QueryResult(ConnectionLease&)> execute)
+    {
+        // The thread pool only takes copyable functions.
+        std::shared_ptr<QPromise<QueryResult>> promise = std::make_shared<QPromise<QueryResult>>();
+        QFuture<QueryResult> future = promise->future();
+        promise->start();
+
+        m_asyncThreads.start([this, promise, execute]() {
+            // Database threads get the connection they have used before, so
+            // connections rarely move between threads.
+            ConnectionLease connectionLease = lease();
+            if (connectionLease.isValid()) {
+                promise->addResult(execute(connectionLease));
+            } else {
+                promise->addResult(QueryResult(QSqlError(QString(),
+                    "No connection available.",
+                    QSqlError::ConnectionError)));
+            }
+            promise->finish();
+        });
+        return future;
+    }
+
+    int ConnectionPool::asyncThreadCount()
+    {
+        return m_asyncThreads.maxThreadCount();
+    }
+
+    void ConnectionPool::setAsyncThreadCount(int threadCount)
+    {
+        m_asyncThreads.setMaxThreadCount(threadCount);
+    }
+
+    int ConnectionPool::statementCacheSize()
+    {
+        return m_statementCacheSize.r();
+    }
+
+    void ConnectionPool::setStatementCacheSize(int size)
+    {
+        m_statementCacheSize = size;
+    }
+
+    int ConnectionPool::waitTimeoutMilliseconds()
+    {
+        return m_waitTimeoutMilliseconds.r();
+    }
+
+    void ConnectionPool::setWaitTimeoutMilliseconds(int milliseconds)
+    {
+        m_waitTimeoutMilliseconds = milliseconds;
+    }
+
+    int ConnectionPool::maxWaiters()
+    {
+        return m_maxWaiters.r();
+    }
+
+    void ConnectionPool::setMaxWaiters(int maxWaiters)
+    {
+        m_maxWaiters = maxWaiters;
+    }
+
+    int ConnectionPool::leasedCount()
+    {
+        QMutexLocker mutexLocker(&m_poolMutex);
+        int leased = 0;
+        for (const PooledConnection& pooledConnection : m_connections) {
+            if (pooledConnection.leased) {
+                leased++;
+            }
+        }
+        return leased;
+    }
+
+    int ConnectionPool::waiterCount()
+    {
+        QMutexLocker mutexLocker(&m_poolMutex);
+        return m_waiters.size();
     }
 
     void ConnectionPool::setHostName(QString hostName)
@@ -189,23 +610,138 @@ namespace Sql {
         m_password = password;
     }
 
-    void ConnectionPool::reset()
+    void ConnectionPool::release(int connection, int generation, QSqlDatabase database)
     {
-        m_nextConnectionNameMutex.lock();
-        m_next = 0;
-        m_nextConnectionNameMutex.unlock();
+        QMutexLocker mutexLocker(&m_poolMutex);
+        if (generation != m_generation) {
+            return;
+        }
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
+        // Only the thread a connection belongs to can give it away.
+        database.moveToThread(0);
+#else
+        Q_UNUSED(database);
+#endif
+
+        if (!m_waiters.isEmpty()) {
+            Waiter* waiter = m_waiters.takeFirst();
+            waiter->connection = connection;
+            waiter->connectionHandedOver.wakeOne();
+            return;
+        }
+        m_connections[connection].leased = false;
+    }
+
+    QSqlDatabase ConnectionPool::addDatabase()
+    {
+        // Connections replaced in a thread are only removed later by the
+        // thread they belong to, so names are never reused.
+        QSqlDatabase db = QSqlDatabase::addDatabase(driverName(),
+            QString("sql%1").arg(m_nextConnectionName.fetchAndAddRelaxed(1)));
+        db.setHostName(hostName());
+        db.setPort(port());
+        db.setConnectOptions(connectOptions());
+        db.setDatabaseName(databaseName());
+        db.setUserName(userName());
+        db.setPassword(password());
+        return db;
     }
 
-    QString ConnectionPool::nextConnectionName()
+#if QT_VERSION < QT_VERSION_CHECK(6, 8, 0)
+    bool ConnectionPool::rebindConnection(int connection,
+        int generation,
+        QThread* previousThread,
+        QSqlDatabase& database,
+        SharedStatementCache& statements)
     {
-        m_nextConnectionNameMutex.lock();
-        m_next++;
-        if (m_next >= count()) {
-            m_next = 0;
+        // The connection has to be opened again in this thread. Opening
+        // takes a while, so the pool is not locked meanwhile.
+        QSqlDatabase reboundDatabase = addDatabase();
+        bool opened = reboundDatabase.open();
+        QString reboundConnectionName = reboundDatabase.connectionName();
+
+        QMutexLocker mutexLocker(&m_poolMutex);
+        if (generation != m_generation) {
+            // The pool has been closed, which has removed all connections.
+            return false;
+        }
+
+        PooledConnection& pooledConnection = m_connections[connection];
+        if (!opened) {
+            // Leave the connection to the thread it belongs to.
+            pooledConnection.lastThread = previousThread;
+            mutexLocker.unlock();
+            release(connection, generation, database);
+            reboundDatabase = QSqlDatabase();
+            QSqlDatabase::removeDatabase(reboundConnectionName);
+            return false;
+        }
+
+        // The previous connection and its statements are idle, they are
+        // closed by their thread the next time it leases a connection.
+        RetiredConnection retiredConnection;
+        retiredConnection.database = pooledConnection.database;
+        retiredConnection.statements = pooledConnection.statements;
+        retiredConnection.thread = previousThread;
+        m_retiredConnections.append(retiredConnection);
+
+        pooledConnection.database = reboundDatabase;
+        pooledConnection.statements = std::make_shared<StatementCache>();
+        database = pooledConnection.database;
+        statements = pooledConnection.statements;
+        return true;
+    }
+
+    void ConnectionPool::removeRetiredConnections(QThread* thread)
+    {
+        QList<RetiredConnection> retiredConnections;
+        {
+            QMutexLocker mutexLocker(&m_poolMutex);
+            for (int i = m_retiredConnections.size() - 1; i >= 0; i--) {
+                if (m_retiredConnections.at(i).thread == thread) {
+                    retiredConnections.append(m_retiredConnections.takeAt(i));
+                }
+            }
+        }
+
+        for (RetiredConnection& retiredConnection : retiredConnections) {
+            QString connectionName = retiredConnection.database.connectionName();
+            retiredConnection.statements.reset();
+            retiredConnection.database = QSqlDatabase();
+            QSqlDatabase::removeDatabase(connectionName);
+        }
+    }
+#endif
+
+    ConnectionLease& ConnectionPool::threadLease()
+    {
+        // The previous query of this thread is done with once the next one
+        // is executed.
+        static thread_local ConnectionLease threadLease;
+        threadLease.release();
+        threadLease = lease();
+        return threadLease;
+    }
+
+    int ConnectionPool::takeIdleConnection(QThread* thread)
+    {
+        int idleConnection = -1;
+        for (int i = 0; i < m_connections.size(); i++) {
+            if (m_connections.at(i).leased) {
+                continue;
+            }
+
+            // A connection the thread has used before may still have its
+            // statements prepared and its pages cached.
+            if (m_connections.at(i).lastThread == thread) {
+                return i;
+            }
+            if (idleConnection == -1) {
+                idleConnection = i;
+            }
         }
-        QString connectionName = QString("sql%1").arg(m_next);
-        m_nextConnectionNameMutex.unlock();
-        return connectionName;
+        return idleConnection;
     }
 
 } // namespace Sql
@@ -24,22 +24,148 @@
 #pragma once
 
 // Own includes
+#include "sqlqueryresult.h"
 #include "misc/threadsafety.h"
 
 // Qt includes
+#include <QAtomicInt>
+#include <QCache>
+#include <QFuture>
 #include <QList>
+#include <QMutex>
 #include <QObject>
 #include <QSqlDatabase>
 #include <QSqlQuery>
+#include <QThread>
+#include <QThreadPool>
+#include <QVariantList>
+#include <QVariantMap>
+#include <QWaitCondition>
+
+// Standard includes
+#include <functional>
+#include <memory>
 
 namespace QtWebServer {
 
 namespace Sql {
 
+    class ConnectionPool;
+
+    /** Prepared statements of a connection by query text, least recently used first to go. */
+    typedef QCache<QString, QSqlQuery> StatementCache;
+
+    /**
+     * Shared by the pool and the lease of a connection, so a lease still
+     * held when the pool is closed keeps using its statements and frees
+     * them in its own thread on release.
+     */
+    typedef std::shared_ptr<StatementCache> SharedStatementCache;
+
+    /**
+     * @class ConnectionLease
+     * Exclusive use of a pooled connection. The connection is bound to the
+     * thread that has leased it and returned to the pool when the lease is
+     * released or destroyed, which has to happen in the same thread. Queries
+     * created on the connection must not outlive the lease.
+     */
+    class ConnectionLease {
+    public:
+        /** Creates an invalid lease. */
+        ConnectionLease();
+        ConnectionLease(ConnectionLease&& other);
+        ~ConnectionLease();
+
+        ConnectionLease& operator=(ConnectionLease&& other);
+
+        /** @returns true, if a connection has been leased. */
+        bool isValid() const;
+
+        /** @returns the leased connection. */
+        QSqlDatabase database() const;
+
+        /**
+         * Executes the query on the leased connection.
+         * @param query The SQL query to be executed.
+         * @returns the according QSqlQuery object.
+         */
+        QSqlQuery exec(const QString& query = QString());
+
+        /**
+         * Prepares a query on the leased connection. Statements are cached
+         * per connection by their text, so a statement is prepared only once
+         * as long as it is used often enough to stay in the cache. A cached
+         * statement is finished before it is returned again.
+         * @param query The SQL query with placeholders for bound values.
+         * @returns the prepared query, ready for binding values and exec().
+         * If preparing has failed, the query carries the error. It stays
+         * valid until the lease prepares another statement or is released.
+         */
+        QSqlQuery& prepare(const QString& query);
+
+        /**
+         * Executes a prepared query with values bound to its positional
+         * placeholders.
+         * @param query The SQL query with placeholders.
+         * @param boundValues The values in the order of the placeholders.
+         * @returns the executed query, valid as long as the one returned by
+         * prepare().
+         */
+        QSqlQuery& exec(const QString& query, const QVariantList& boundValues);
+
+        /**
+         * Executes a prepared query with values bound to its named
+         * placeholders.
+         * @param query The SQL query with placeholders.
+         * @param boundValues The values by placeholder, for example ":id".
+         * @returns the executed query, valid as long as the one returned by
+         * prepare().
+         */
+        QSqlQuery& exec(const QString& query, const QVariantMap& boundValues);
+
+        /** Returns the connection to the pool. */
+        void release();
+
+    private:
+        Q_DISABLE_COPY(ConnectionLease)
+        friend class ConnectionPool;
+
+        /** Executes a prepared query with its values bound. */
+        void execPrepared(QSqlQuery& sqlQuery);
+
+        ConnectionLease(ConnectionPool* pool,
+            int connection,
+            int generation,
+            QSqlDatabase database,
+            SharedStatementCache statements);
+
+        ConnectionPool* m_pool;
+        int m_connection;
+        int m_generation;
+        QAtomicInt m_nextConnectionName;
+        QSqlDatabase m_database;
+        SharedStatementCache m_statements;
+        /** Holds a statement that has not been cached. */
+        QSqlQuery m_uncachedStatement;
+    };
+
     /**
      * @class ConnectionPool
      * @author Jacob Dawid
-     * Connection pooling.
+     * Connection pooling. Connections are leased exclusively and bound to
+     * the leasing thread while leased. A thread gets the connection it has
+     * used before if that is idle. Otherwise an idle connection moves to the
+     * thread, which needs Qt 6.8. With older versions, the connection is
+     * opened again in the leasing thread instead, and the thread that used
+     * it before closes the old one the next time it leases. When all connections are
+     * leased, threads wait in a bounded queue and are handed connections in
+     * the order they have started waiting.
+     *
+     * Queries can also be run asynchronously on dedicated database threads,
+     * which keep using the same connections:
+     *   ConnectionPool::instance().execAsync("SELECT name FROM users WHERE id = ?", { id })
+     *       .then(context, [](const QueryResult& result) { ... });
+     * The continuation runs in the thread of the context object.
      */
     class ConnectionPool : public QObject {
         Q_OBJECT
@@ -101,12 +227,98 @@ namespace Sql {
         QString password() const;
 
         /**
-         * Executes the query and returns a query object.
+         * Leases a connection for exclusive use by the calling thread.
+         * @param timeoutMilliseconds The time to wait for a connection if all
+         * are leased, or -1 to use the wait timeout of the pool.
+         * @returns the lease, which is invalid if the pool is not open, the
+         * wait queue is full or no connection became available in time.
+         */
+        ConnectionLease lease(int timeoutMilliseconds = -1);
+
+        /**
+         * Executes the query and returns a query object. The returned query
+         * is bound to its connection, so the calling thread keeps the
+         * connection leased until it executes the next query this way or
+         * finishes. This pins one connection to every thread using exec(),
+         * so with more such threads than count(), the others wait up to
+         * waitTimeoutMilliseconds() and get an invalid query.
+         * @deprecated Use lease() to control how long a connection is used.
          * @param query The SQL query to be executed.
-         * @returns the according QSqlQuery object.
+         * @returns the according QSqlQuery object, which is invalid if no
+         * connection could be leased.
          */
         QSqlQuery exec(const QString& query = QString());
 
+        /**
+         * Executes a prepared query with values bound to its positional
+         * placeholders, on the connection leased by the calling thread.
+         * @deprecated Use lease() to control how long a connection is used.
+         * @see ConnectionLease::exec()
+         */
+        QSqlQuery& exec(const QString& query, const QVariantList& boundValues);
+
+        /**
+         * Executes a query on a database thread, so the calling thread does
+         * not block. The query is prepared with the statement cache of the
+         * connection used and the values are bound to its positional
+         * placeholders.
+         * @param query The SQL query, with placeholders.
+         * @param boundValues The values in the order of the placeholders.
+         * @returns a future for the result. A continuation attached with a
+         * context object, as in then(context, function), is called in the
+         * thread of the context object.
+         */
+        QFuture<QueryResult> execAsync(const QString& query,
+            const QVariantList& boundValues = QVariantList());
+
+        /**
+         * Executes a query on a database thread, with values bound to its
+         * named placeholders.
+         * @see execAsync()
+         */
+        QFuture<QueryResult> execAsync(const QString& query, const QVariantMap& boundValues);
+
+        /** @returns the number of threads executing asynchronous queries. */
+        int asyncThreadCount();
+
+        /**
+         * Sets the number of threads executing asynchronous queries. There
+         * should not be more of them than connections in the pool, as they
+         * would only wait for connections.
+         */
+        void setAsyncThreadCount(int threadCount);
+
+        /** @returns the number of prepared statements cached per connection. */
+        int statementCacheSize();
+
+        /**
+         * Sets the number of prepared statements cached per connection. The
+         * least recently used statement is dropped when the cache is full.
+         * Set to 0 to prepare statements every time.
+         */
+        void setStatementCacheSize(int size);
+
+        /** @returns the time to wait for a connection in milliseconds. */
+        int waitTimeoutMilliseconds();
+
+        /** Sets the time to wait for a connection in milliseconds. */
+        void setWaitTimeoutMilliseconds(int milliseconds);
+
+        /** @returns the maximum number of threads waiting for a connection. */
+        int maxWaiters();
+
+        /**
+         * Sets the maximum number of threads waiting for a connection. When
+         * the wait queue is full, leasing fails right away.
+         */
+        void setMaxWaiters(int maxWaiters);
+
+        /** @returns the number of connections currently leased. */
+        int leasedCount();
+
+        /** @returns the number of threads waiting for a connection. */
+        int waiterCount();
+
         /** Sets the database host name. */
         void setHostName(QString hostName);
 
@@ -129,10 +341,76 @@ namespace Sql {
         void setPassword(QString password);
 
     private:
+        friend class ConnectionLease;
+
         explicit ConnectionPool(QObject* parent = 0);
 
-        void reset();
-        QString nextConnectionName();
+        struct PooledConnection {
+            QSqlDatabase database;
+            /** Only used by the thread leasing the connection. */
+            SharedStatementCache statements;
+            /** The thread that has leased the connection last. */
+            QThread* lastThread;
+            bool leased;
+        };
+
+        /** A connection replaced in another thread, see rebindConnection(). */
+        struct RetiredConnection {
+            QSqlDatabase database;
+            SharedStatementCache statements;
+            /** The thread the connection belongs to, which has to remove it. */
+            QThread* thread;
+        };
+
+        struct Waiter {
+            QWaitCondition connectionHandedOver;
+            /** The connection handed over, or -1. */
+            int connection;
+        };
+
+        /**
+         * Returns a connection from a lease. Hands it over to the longest
+         * waiting thread, if any.
+         */
+        void release(int connection, int generation, QSqlDatabase database);
+
+        /**
+         * Looks for an idle connection, preferring one that has been used by
+         * the thread before.
+         * @returns the connection, or -1 if none is idle.
+         */
+        int takeIdleConnection(QThread* thread);
+
+        /** Adds a database connection with the settings of the pool, under a new name. */
+        QSqlDatabase addDatabase();
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 8, 0)
+        /**
+         * Opens a leased connection again in the calling thread, because it
+         * belongs to the thread that has used it before. Releases the
+         * connection if that fails.
+         * @param database Receives the connection opened in this thread.
+         * @param statements Receives the statement cache of that connection.
+         * @returns true, if the connection can be used by the calling thread.
+         */
+        bool rebindConnection(int connection,
+            int generation,
+            QThread* previousThread,
+            QSqlDatabase& database,
+            SharedStatementCache& statements);
+
+        /** Closes the connections that have been replaced in other threads. */
+        void removeRetiredConnections(QThread* thread);
+#endif
+
+        /** @returns the lease of the calling thread used by exec(). */
+        ConnectionLease& threadLease();
+
+        /**
+         * Runs a query on a database thread.
+         * @param execute Executes the query on a leased connection.
+         */
+        QFuture<QueryResult> execAsync(std::function<QueryResult(ConnectionLease&)> execute);
 
         ThreadGuard<bool> m_open;
 
@@ -146,8 +424,29 @@ namespace Sql {
         ThreadGuard<QString> m_password;
 
         ThreadGuard<int> m_count;
-        QMutex m_nextConnectionNameMutex;
-        int m_next;
+        ThreadGuard<int> m_waitTimeoutMilliseconds;
+        ThreadGuard<int> m_maxWaiters;
+        ThreadGuard<int> m_statementCacheSize;
+
+        QMutex m_poolMutex;
+        QList<PooledConnection> m_connections;
+        QList<Waiter*> m_waiters;
+        QList<RetiredConnection> m_retiredConnections;
+        /** Changes whenever the pool is closed, so stale leases are ignored. */
+        int m_generation;
+        QAtomicInt m_nextConnectionName;
+
+        /** Threads running asynchronous queries, they are kept alive to keep their connections. */
+        QThreadPool m_asyncThreads;
+
+        // Metrics
+        int m_queryDurationHistogram;
+        int m_waitDurationHistogram;
+        int m_timeoutCounter;
+        int m_rejectionCounter;
+        int m_statementCacheHitCounter;
+        int m_statementCacheMissCounter;
+        int m_connectionsGaugeId;
     };
 
 } // namespace Sql
@@ -0,0 +1,126 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "sqlqueryresult.h"
+
+// Qt includes
+#include <QSqlRecord>
+
+namespace QtWebServer {
+
+namespace Sql {
+
+    QueryResult::QueryResult()
+        : m_numRowsAffected(-1)
+    {
+    }
+
+    QueryResult::QueryResult(QSqlQuery& sqlQuery)
+        : m_error(sqlQuery.lastError())
+        , m_numRowsAffected(-1)
+    {
+        if (m_error.isValid()) {
+            return;
+        }
+
+        QSqlRecord record = sqlQuery.record();
+        for (int column = 0; column < record.count(); column++) {
+            m_columnNames.append(record.fieldName(column));
+        }
+
+        if (sqlQuery.isSelect()) {
+            while (sqlQuery.next()) {
+                QVariantList row;
+                row.reserve(m_columnNames.size());
+                for (int column = 0; column < m_columnNames.size(); column++) {
+                    row.append(sqlQuery.value(column));
+                }
+                m_rows.append(row);
+            }
+        } else {
+            m_numRowsAffected = sqlQuery.numRowsAffected();
+            m_lastInsertId = sqlQuery.lastInsertId();
+        }
+
+        // Release the result set, the statement may be cached.
+        sqlQuery.finish();
+    }
+
+    QueryResult::QueryResult(const QSqlError& error)
+        : m_error(error)
+        , m_numRowsAffected(-1)
+    {
+    }
+
+    bool QueryResult::hasError() const
+    {
+        return m_error.isValid();
+    }
+
+    QSqlError QueryResult::error() const
+    {
+        return m_error;
+    }
+
+    QStringList QueryResult::columnNames() const
+    {
+        return m_columnNames;
+    }
+
+    const QList<QVariantList>& QueryResult::rows() const
+    {
+        return m_rows;
+    }
+
+    int QueryResult::size() const
+    {
+        return m_rows.size();
+    }
+
+    QVariant QueryResult::value(int row, int column) const
+    {
+        if (row < 0 || row >= m_rows.size()) {
+            return QVariant();
+        }
+        return m_rows.at(row).value(column);
+    }
+
+    QVariant QueryResult::value(int row, const QString& columnName) const
+    {
+        return value(row, m_columnNames.indexOf(columnName));
+    }
+
+    int QueryResult::numRowsAffected() const
+    {
+        return m_numRowsAffected;
+    }
+
+    QVariant QueryResult::lastInsertId() const
+    {
+        return m_lastInsertId;
+    }
+
+} // namespace Sql
+
+} // namespace QtWebServer
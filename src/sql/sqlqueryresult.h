@@ -0,0 +1,94 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+#pragma once
+
+// Qt includes
+#include <QList>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+#include <QVariantList>
+
+namespace QtWebServer {
+
+namespace Sql {
+
+    /**
+     * @class QueryResult
+     * The complete result of an executed query, detached from its
+     * connection. Unlike a QSqlQuery it can be passed between threads.
+     */
+    class QueryResult {
+    public:
+        /** Creates an empty result. */
+        QueryResult();
+
+        /**
+         * Reads all rows of an executed query.
+         * @param sqlQuery The executed query. It is finished afterwards.
+         */
+        explicit QueryResult(QSqlQuery& sqlQuery);
+
+        /** Creates a result for a query that could not be executed. */
+        explicit QueryResult(const QSqlError& error);
+
+        /** @returns true, if the query has failed. */
+        bool hasError() const;
+
+        /** @returns the error of the query, if it has failed. */
+        QSqlError error() const;
+
+        /** @returns the names of the columns. */
+        QStringList columnNames() const;
+
+        /** @returns all rows, each with a value per column. */
+        const QList<QVariantList>& rows() const;
+
+        /** @returns the number of rows. */
+        int size() const;
+
+        /** @returns a value by row and column, or an invalid value. */
+        QVariant value(int row, int column) const;
+
+        /** @returns a value by row and column name, or an invalid value. */
+        QVariant value(int row, const QString& columnName) const;
+
+        /** @returns the number of rows affected by a modifying query, or -1. */
+        int numRowsAffected() const;
+
+        /** @returns the identifier of the row inserted by the query, if supported. */
+        QVariant lastInsertId() const;
+
+    private:
+        QSqlError m_error;
+        QStringList m_columnNames;
+        QList<QVariantList> m_rows;
+        int m_numRowsAffected;
+        QVariant m_lastInsertId;
+    };
+
+} // namespace Sql
+
+} // namespace QtWebServer
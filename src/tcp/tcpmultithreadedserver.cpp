@@ -25,11 +25,11 @@
 #include <QMetaObject>
 #include <QSettings>
 #include <QSslKey>
-#include <QTimer>
 
 // Own includes
 #include "tcpmultithreadedserver.h"
 #include "tcpserverthread.h"
+#include "misc/metrics.h"
 
 namespace QtWebServer {
 
@@ -38,9 +38,12 @@ namespace Tcp {
     MultithreadedServer::MultithreadedServer()
         : QTcpServer()
         , Logger("WebServer::WebService")
+        , m_connectionsGaugeId(-1)
+        , m_busyGaugeId(-1)
     {
         setDefaultSslConfiguration();
         m_serverTimeoutSeconds = 60;
+        m_listenMode = ListenModeShared;
     }
 
     MultithreadedServer::~MultithreadedServer()
@@ -50,17 +53,11 @@ namespace Tcp {
 
     bool MultithreadedServer::close()
     {
-        if (isListening()) {
+        if (QTcpServer::isListening()) {
             QTcpServer::close();
-
-            // Mark all active threads for deletion if already running
-            foreach (ServerThread* networkServiceThread, m_serverThreads) {
-                if (networkServiceThread) {
-                    networkServiceThread->deleteLater();
-                }
-            }
-            m_serverThreads.clear();
         }
+
+        stopServerThreads();
         return true;
     }
 
@@ -68,23 +65,27 @@ namespace Tcp {
         quint16 port,
         int numberOfThreads)
     {
-        if (isListening()) {
+        if (isServing()) {
             return false;
         }
 
-        // Create the specified number of threads and store them in a vector
-        int thread = numberOfThreads;
-        while (thread > 0) {
-            ServerThread* networkServiceThread = new ServerThread(*this);
-            networkServiceThread->start();
-            m_serverThreads.append(networkServiceThread);
-            thread--;
-        }
-
+        startServerThreads(numberOfThreads);
         m_nextRequestDelegatedTo = 0;
 
+        if (listenMode() == ListenModeReusePort) {
+            if (listenReusePort(address, port)) {
+                return true;
+            }
+            stopServerThreads();
+            return false;
+        }
+
         // Listen
-        return QTcpServer::listen(address, port);
+        if (QTcpServer::listen(address, port)) {
+            return true;
+        }
+        stopServerThreads();
+        return false;
     }
 
     int MultithreadedServer::numberOfThreads()
@@ -92,6 +93,23 @@ namespace Tcp {
         return m_serverThreads.size();
     }
 
+    bool MultithreadedServer::isServing() const
+    {
+        // In reuse port mode the threads are listening on their own, while
+        // the main listener stays closed.
+        return QTcpServer::isListening() || !m_serverThreads.isEmpty();
+    }
+
+    MultithreadedServer::ListenMode MultithreadedServer::listenMode()
+    {
+        return m_listenMode.r();
+    }
+
+    void MultithreadedServer::setListenMode(ListenMode listenMode)
+    {
+        m_listenMode = listenMode;
+    }
+
     int MultithreadedServer::serverTimeoutSeconds()
     {
         return m_serverTimeoutSeconds.r();
@@ -124,29 +142,129 @@ namespace Tcp {
 
     void MultithreadedServer::incomingConnection(qintptr socketDescriptor)
     {
-        ServerThread* serverThread = 0;
-        ServerThread::NetworkServiceThreadState state;
+        ServerThread* serverThread = leastLoadedServerThread();
+        if (!serverThread) {
+            log("No server thread available, dropping connection.", Log::Warning);
+            return;
+        }
+
+        // The thread picks up the descriptor from its queue in its own event
+        // loop, so we never block the accepting thread here.
+        serverThread->enqueueConnection(socketDescriptor);
+    }
+
+    ServerThread* MultithreadedServer::leastLoadedServerThread()
+    {
+        int threadCount = m_serverThreads.size();
+        if (threadCount == 0) {
+            return 0;
+        }
 
-        QTimer timer;
-        timer.start(serverTimeoutSeconds() * 1000);
+        // Start scanning at a rotating offset, so threads with an equal load
+        // take turns instead of always favouring the first one.
+        ServerThread* leastLoadedThread = 0;
+        int leastConnectionCount = 0;
+        for (int i = 0; i < threadCount; i++) {
+            ServerThread* serverThread = m_serverThreads[(m_nextRequestDelegatedTo + i) % threadCount];
+            int connectionCount = serverThread->connectionCount();
+            if (!leastLoadedThread || connectionCount < leastConnectionCount) {
+                leastLoadedThread = serverThread;
+                leastConnectionCount = connectionCount;
+            }
+        }
 
-        do {
-            serverThread = m_serverThreads[m_nextRequestDelegatedTo];
-            state = serverThread->state();
+        m_nextRequestDelegatedTo = (m_nextRequestDelegatedTo + 1) % threadCount;
+        return leastLoadedThread;
+    }
 
-            m_nextRequestDelegatedTo++;
-            if (m_nextRequestDelegatedTo >= m_serverThreads.size()) {
-                m_nextRequestDelegatedTo = 0;
+    void MultithreadedServer::startServerThreads(int numberOfThreads)
+    {
+        // Create the specified number of threads and store them in a vector
+        int thread = numberOfThreads;
+        while (thread > 0) {
+            ServerThread* networkServiceThread = new ServerThread(*this);
+            networkServiceThread->start();
+            m_serverThreads.append(networkServiceThread);
+            thread--;
+        }
+
+        // The threads are only changed when no gauge refers to them.
+        Metrics& metrics = Metrics::instance();
+        m_connectionsGaugeId = metrics.addGauge("qtwebserver_tcp_connections",
+            "Open connections per server thread.",
+            [this]() {
+                QList<Metrics::GaugeSample> samples;
+                for (int i = 0; i < m_serverThreads.size(); i++) {
+                    Metrics::GaugeSample sample;
+                    sample.labels << qMakePair(QByteArray("thread"), QByteArray::number(i));
+                    sample.value = m_serverThreads.at(i)->connectionCount();
+                    samples.append(sample);
+                }
+                return samples;
+            });
+        m_busyGaugeId = metrics.addGauge("qtwebserver_tcp_thread_busy",
+            "Whether a server thread is busy serving a client.",
+            [this]() {
+                QList<Metrics::GaugeSample> samples;
+                for (int i = 0; i < m_serverThreads.size(); i++) {
+                    Metrics::GaugeSample sample;
+                    sample.labels << qMakePair(QByteArray("thread"), QByteArray::number(i));
+                    sample.value = m_serverThreads.at(i)->state() == ServerThread::NetworkServiceThreadStateBusy ? 1 : 0;
+                    samples.append(sample);
+                }
+                return samples;
+            });
+    }
+
+    void MultithreadedServer::stopServerThreads()
+    {
+        if (m_connectionsGaugeId != -1) {
+            Metrics::instance().removeGauge(m_connectionsGaugeId);
+            Metrics::instance().removeGauge(m_busyGaugeId);
+            m_connectionsGaugeId = -1;
+            m_busyGaugeId = -1;
+        }
+
+        // Sockets and listeners belong to the threads serving them, so they
+        // are closed and deleted there. Only the finished threads are
+        // deleted here.
+        foreach (ServerThread* networkServiceThread, m_serverThreads) {
+            if (networkServiceThread && networkServiceThread->isRunning()) {
+                QMetaObject::invokeMethod(
+                    networkServiceThread, [networkServiceThread]() {
+                        networkServiceThread->shutDown();
+                    },
+                    Qt::BlockingQueuedConnection);
+                networkServiceThread->quit();
+                networkServiceThread->wait();
             }
+            delete networkServiceThread;
+        }
+        m_serverThreads.clear();
+    }
 
-            if (state == ServerThread::NetworkServiceThreadStateBusy && timer.remainingTime() <= 0) {
-                // Abort on server timeout
-                return;
+    bool MultithreadedServer::listenReusePort(const QHostAddress& address, quint16 port)
+    {
+        foreach (ServerThread* serverThread, m_serverThreads) {
+            // The listening socket has to be created in the thread that is
+            // going to accept on it, so we block until the thread is done.
+            quint16 boundPort = 0;
+            QMetaObject::invokeMethod(
+                serverThread, [serverThread, address, port]() {
+                    return serverThread->listenReusePort(address, port);
+                },
+                Qt::BlockingQueuedConnection, &boundPort);
+
+            if (boundPort == 0) {
+                log(QString("Unable to listen with SO_REUSEPORT on port %1.").arg(port), Log::Error);
+                return false;
             }
-        } while (state == ServerThread::NetworkServiceThreadStateBusy);
 
-        // Use invokeMethod here to decouple threads
-        QMetaObject::invokeMethod(serverThread, "handleNewConnection", Q_ARG(int, socketDescriptor));
+            // If an arbitrary port was requested, all the other threads have
+            // to share the one the first thread has been given.
+            port = boundPort;
+        }
+        return true;
     }
 
     void MultithreadedServer::setDefaultSslConfiguration()
@@ -48,6 +48,14 @@ namespace Tcp {
     class MultithreadedServer : public QTcpServer, public Logger {
         Q_OBJECT
     public:
+        /**
+         * @brief The ListenMode enum
+         */
+        enum ListenMode {
+            ListenModeShared, /** One listener accepts and dispatches connections to the threads. */
+            ListenModeReusePort /** Each thread accepts on its own SO_REUSEPORT socket. */
+        };
+
         /** @brief WebService */
         MultithreadedServer();
 
@@ -71,14 +79,33 @@ namespace Tcp {
         /** Sets the number of threads this server owns. */
         int numberOfThreads();
 
+        /**
+         * @returns true, if the server is accepting connections in any mode.
+         * In ListenModeReusePort the server threads listen on their own
+         * sockets, so QTcpServer::isListening() is false in that mode.
+         */
+        bool isServing() const;
+
+        /** @returns the listen mode. */
+        ListenMode listenMode();
+
+        /**
+         * Sets the listen mode. In ListenModeReusePort each server thread
+         * opens its own socket on the same address and port and accepts
+         * connections itself, so the kernel spreads connections across the
+         * threads. This requires SO_REUSEPORT support by the operating system.
+         * @attention For this to take effect you have to close and listen again.
+         */
+        void setListenMode(ListenMode listenMode);
+
         /** @returns the server timeout in seconds. */
         int serverTimeoutSeconds();
 
         /**
-         * Sets the server timeout in seconds. If the server is not able
-         * to serve the cliend in the given amount of time (ie. all threads
-         * are busy for the given amount of seconds) it will simply ignore
-         * incoming connections.
+         * Sets the server timeout in seconds.
+         * @deprecated Incoming connections are queued on the least loaded
+         * thread and never wait for a thread to become idle, so this value
+         * is not used by the dispatcher anymore.
          */
         void setServerTimeoutSeconds(int seconds);
 
@@ -93,21 +120,39 @@ namespace Tcp {
 
     protected:
         /**
-         * @brief incomingConnection
-         * @param handle
+         * Dispatches an accepted connection to the server thread that
+         * currently serves the least connections.
+         * @param socketDescriptor The descriptor of the accepted connection.
          */
         void incomingConnection(qintptr socketDescriptor);
 
     private:
         void setDefaultSslConfiguration();
 
+        /** @returns the server thread with the least open connections. */
+        ServerThread* leastLoadedServerThread();
+
+        /** Creates and starts the given number of server threads. */
+        void startServerThreads(int numberOfThreads);
+
+        /** Stops and deletes all server threads. */
+        void stopServerThreads();
+
+        /** Lets every server thread listen on its own SO_REUSEPORT socket. */
+        bool listenReusePort(const QHostAddress& address, quint16 port);
+
         ThreadGuard<Responder*> m_responder;
         ThreadGuard<int> m_serverTimeoutSeconds;
+        ThreadGuard<ListenMode> m_listenMode;
 
         // Scheduler
         int m_nextRequestDelegatedTo;
         QVector<ServerThread*> m_serverThreads;
 
+        // Metrics
+        int m_connectionsGaugeId;
+        int m_busyGaugeId;
+
         ThreadGuard<QSslConfiguration> m_sslConfiguration;
     };
 
@@ -24,15 +24,63 @@
 #pragma once
 
 // Qt includes
+#include <QObject>
 #include <QSslSocket>
 
 namespace QtWebServer {
 
 namespace Tcp {
 
+    /**
+     * @class ConnectionData
+     * State a responder keeps for a single connection. It is owned by the
+     * server thread that owns the socket, accessed from that thread only and
+     * deleted when the connection has been closed.
+     */
+    class ConnectionData : public QObject {
+        Q_OBJECT
+    public:
+        ConnectionData(QObject* parent = 0)
+            : QObject(parent)
+        {
+        }
+
+        virtual ~ConnectionData()
+        {
+        }
+    };
+
     class Responder {
     public:
+        virtual ~Responder()
+        {
+        }
+
         virtual void respond(QSslSocket* sslSocket) = 0;
+
+        /**
+         * Creates the state kept for a connection. Called by the server thread
+         * of the connection when data arrives for the first time.
+         * @param sslSocket The socket of the connection.
+         * @returns the connection's state, or 0 if no state is needed.
+         */
+        virtual ConnectionData* createConnectionData(QSslSocket* sslSocket)
+        {
+            Q_UNUSED(sslSocket);
+            return 0;
+        }
+
+        /**
+         * Responds to data available on a socket. The default implementation
+         * ignores the connection's state.
+         * @param sslSocket The socket that shall be responded to.
+         * @param connectionData The state created for the connection, or 0.
+         */
+        virtual void respond(QSslSocket* sslSocket, ConnectionData* connectionData)
+        {
+            Q_UNUSED(connectionData);
+            respond(sslSocket);
+        }
     };
 
 } // namespace Tcp
@@ -25,22 +25,61 @@
 #include <QDateTime>
 #include <QEventLoop>
 #include <QMetaEnum>
+#include <QMetaObject>
 #include <QStringList>
 #include <QTimer>
 
 // Own includes
 #include "tcpserverthread.h"
 
+// Standard includes
+#include <cstring>
+
+// System includes
+#ifdef Q_OS_UNIX
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 namespace QtWebServer {
 
 namespace Tcp {
 
+    /**
+     * Listener that hands accepted connections directly to the server
+     * thread it lives in, without going through another event loop.
+     */
+    class ReusePortListener : public QTcpServer {
+    public:
+        ReusePortListener(ServerThread& serverThread)
+            : QTcpServer(&serverThread)
+            , m_serverThread(serverThread)
+        {
+        }
+
+    protected:
+        void incomingConnection(qintptr socketDescriptor)
+        {
+            m_serverThread.acceptConnection(socketDescriptor);
+        }
+
+    private:
+        ServerThread& m_serverThread;
+    };
+
     ServerThread::ServerThread(MultithreadedServer& multithreadedServer)
         : QThread(0)
         , Logger(QString("WebServer:NetworkServiceThread (%1)").arg((long)this))
         , m_multithreadedServer(multithreadedServer)
+        , m_connectionCount(0)
+        , m_reusePortListener(0)
     {
         m_networkServiceThreadState = NetworkServiceThreadStateIdle;
+
+        // Make this thread's own event loop handle the queued slots, so that
+        // sockets are created and served in this thread.
+        moveToThread(this);
     }
 
     ServerThread::~ServerThread()
@@ -58,7 +97,163 @@ namespace Tcp {
         emit stateChanged(state);
     }
 
-    void ServerThread::handleNewConnection(int socketHandle)
+    int ServerThread::connectionCount() const
+    {
+        return m_connectionCount.loadRelaxed();
+    }
+
+    void ServerThread::enqueueConnection(qintptr socketDescriptor)
+    {
+        // Account for the connection right away, so the dispatcher sees the
+        // load before this thread got the chance to pick it up.
+        m_connectionCount.ref();
+
+        bool wakeUp;
+        {
+            MutexLocker mutexLocker(m_pendingSocketDescriptorsMutex);
+            Q_UNUSED(mutexLocker);
+            wakeUp = m_pendingSocketDescriptors.isEmpty();
+            m_pendingSocketDescriptors.enqueue(socketDescriptor);
+        }
+
+        // If the queue was not empty, a wake up is already pending and will
+        // take care of this descriptor as well.
+        if (wakeUp) {
+            QMetaObject::invokeMethod(this, "processPendingConnections", Qt::QueuedConnection);
+        }
+    }
+
+    void ServerThread::processPendingConnections()
+    {
+        QQueue<qintptr> socketDescriptors;
+        {
+            MutexLocker mutexLocker(m_pendingSocketDescriptorsMutex);
+            Q_UNUSED(mutexLocker);
+            socketDescriptors.swap(m_pendingSocketDescriptors);
+        }
+
+        while (!socketDescriptors.isEmpty()) {
+            handleNewConnection(socketDescriptors.dequeue());
+        }
+    }
+
+    quint16 ServerThread::listenReusePort(const QHostAddress& address, quint16 port)
+    {
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+        // QHostAddress::Any is dual stack, so bind to IPv6 in that case and
+        // allow IPv4 mapped addresses.
+        bool ipv6 = address.protocol() != QAbstractSocket::IPv4Protocol;
+
+        int socketDescriptor = ::socket(ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+        if (socketDescriptor == -1) {
+            log("Unable to create listening socket.", Log::Error);
+            return 0;
+        }
+
+        int enable = 1;
+        int disable = 0;
+        ::setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        if (::setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1) {
+            log("Unable to set SO_REUSEPORT on listening socket.", Log::Error);
+            ::close(socketDescriptor);
+            return 0;
+        }
+
+        int result;
+        if (ipv6) {
+            if (address == QHostAddress::Any) {
+                ::setsockopt(socketDescriptor, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable));
+            }
+
+            sockaddr_in6 socketAddress = {};
+            socketAddress.sin6_family = AF_INET6;
+            socketAddress.sin6_port = htons(port);
+            Q_IPV6ADDR ipv6Address = address == QHostAddress::Any
+                ? QHostAddress(QHostAddress::AnyIPv6).toIPv6Address()
+                : address.toIPv6Address();
+            memcpy(&socketAddress.sin6_addr, &ipv6Address, sizeof(ipv6Address));
+            result = ::bind(socketDescriptor, (sockaddr*)&socketAddress, sizeof(socketAddress));
+        } else {
+            sockaddr_in socketAddress = {};
+            socketAddress.sin_family = AF_INET;
+            socketAddress.sin_port = htons(port);
+            socketAddress.sin_addr.s_addr = htonl(address.toIPv4Address());
+            result = ::bind(socketDescriptor, (sockaddr*)&socketAddress, sizeof(socketAddress));
+        }
+
+        if (result == -1 || ::listen(socketDescriptor, SOMAXCONN) == -1) {
+            log(QString("Unable to bind listening socket to port %1.").arg(port), Log::Error);
+            ::close(socketDescriptor);
+            return 0;
+        }
+
+        ReusePortListener* listener = new ReusePortListener(*this);
+        if (!listener->setSocketDescriptor(socketDescriptor)) {
+            log(QString("Unable to take over listening socket: %1").arg(listener->errorString()), Log::Error);
+            ::close(socketDescriptor);
+            delete listener;
+            return 0;
+        }
+
+        delete m_reusePortListener;
+        m_reusePortListener = listener;
+        return m_reusePortListener->serverPort();
+#else
+        Q_UNUSED(address);
+        Q_UNUSED(port);
+        log("SO_REUSEPORT is not supported on this platform.", Log::Error);
+        return 0;
+#endif
+    }
+
+    void ServerThread::acceptConnection(qintptr socketDescriptor)
+    {
+        m_connectionCount.ref();
+        handleNewConnection(socketDescriptor);
+    }
+
+    void ServerThread::shutDown()
+    {
+        // Children would move along with this object, so the listener and
+        // the sockets are detached to be deleted in this thread.
+        if (m_reusePortListener) {
+            m_reusePortListener->close();
+            m_reusePortListener->setParent(0);
+            m_reusePortListener->deleteLater();
+            m_reusePortListener = 0;
+        }
+
+        // The connection states still use their sockets while they are
+        // deleted, so their deletion is queued first. Deferred deletions
+        // are carried out when the thread finishes.
+        foreach (ConnectionData* connectionData, m_connectionData) {
+            connectionData->deleteLater();
+        }
+        m_connectionData.clear();
+
+        foreach (QSslSocket* sslSocket, findChildren<QSslSocket*>(QString(), Qt::FindDirectChildrenOnly)) {
+            sslSocket->disconnect(this);
+            sslSocket->close();
+            sslSocket->setParent(0);
+            sslSocket->deleteLater();
+        }
+
+        MutexLocker mutexLocker(m_pendingSocketDescriptorsMutex);
+        Q_UNUSED(mutexLocker);
+        while (!m_pendingSocketDescriptors.isEmpty()) {
+#ifdef Q_OS_UNIX
+            ::close(m_pendingSocketDescriptors.dequeue());
+#else
+            m_pendingSocketDescriptors.dequeue();
+#endif
+        }
+        m_connectionCount.storeRelaxed(0);
+
+        // Only the thread an object lives in can give it away.
+        moveToThread(m_multithreadedServer.thread());
+    }
+
+    void ServerThread::handleNewConnection(qintptr socketHandle)
     {
         setState(NetworkServiceThreadStateBusy);
 
@@ -73,7 +268,13 @@ namespace Tcp {
         connect(sslSocket, &QSslSocket::encrypted, this, &ServerThread::encrypted);
         connect(sslSocket, &QSslSocket::encryptedBytesWritten, this, &ServerThread::encryptedBytesWritten);
 
-        sslSocket->setSocketDescriptor(socketHandle);
+        if (!sslSocket->setSocketDescriptor(socketHandle)) {
+            log(QString("Unable to take over socket descriptor: %1").arg(sslSocket->errorString()), Log::Error);
+            m_connectionCount.deref();
+            sslSocket->deleteLater();
+            setState(NetworkServiceThreadStateIdle);
+            return;
+        }
         sslSocket->setSslConfiguration(m_multithreadedServer.sslConfiguration());
 
         setState(NetworkServiceThreadStateIdle);
@@ -87,7 +288,16 @@ namespace Tcp {
 
         Responder* responder = m_multithreadedServer.responder();
         if (responder) {
-            responder->respond(sslSocket);
+            // The state of a connection belongs to this thread, so it can be
+            // looked up without locking.
+            ConnectionData* connectionData = m_connectionData.value(sslSocket);
+            if (!connectionData) {
+                connectionData = responder->createConnectionData(sslSocket);
+                if (connectionData) {
+                    m_connectionData.insert(sslSocket, connectionData);
+                }
+            }
+            responder->respond(sslSocket, connectionData);
         }
 
         setState(NetworkServiceThreadStateIdle);
@@ -99,8 +309,16 @@ namespace Tcp {
 
         QSslSocket* sslSocket = (QSslSocket*)sender();
 
+        // The state may still be in use further up the stack, if the
+        // responder has closed the connection itself.
+        ConnectionData* connectionData = m_connectionData.take(sslSocket);
+        if (connectionData) {
+            connectionData->deleteLater();
+        }
+
         sslSocket->close();
         sslSocket->deleteLater();
+        m_connectionCount.deref();
 
         setState(NetworkServiceThreadStateIdle);
     }
@@ -112,10 +330,11 @@ namespace Tcp {
             log(sslSocket->errorString(), Log::Error);
         }
 
-        QMetaEnum metaEnum = QMetaEnum::fromType<QSslError::SslError>();
-        QString errorString = metaEnum.valueToKey(error.error());
-
-        log(QString("Socket error: %1 (%2)").arg(errorString).arg((int)error.error()));
+        logLazily([&error]() {
+            QMetaEnum metaEnum = QMetaEnum::fromType<QSslError::SslError>();
+            QString errorString = metaEnum.valueToKey(error.error());
+            return QString("Socket error: %1 (%2)").arg(errorString).arg((int)error.error());
+        });
     }
 
     void ServerThread::sslErrors(QList<QSslError> errors)
@@ -129,25 +348,25 @@ namespace Tcp {
     {
         switch (mode) {
         case QSslSocket::UnencryptedMode:
-            log("SSL socket mode changed to unencrypted mode.");
+            QTWEBSERVER_LOG(*this, Log::Verbose, "SSL socket mode changed to unencrypted mode.");
             break;
         case QSslSocket::SslClientMode:
-            log("SSL socket mode changed to client mode.");
+            QTWEBSERVER_LOG(*this, Log::Verbose, "SSL socket mode changed to client mode.");
             break;
         case QSslSocket::SslServerMode:
-            log("SSL socket mode changed to server mode.");
+            QTWEBSERVER_LOG(*this, Log::Verbose, "SSL socket mode changed to server mode.");
             break;
         }
     }
 
     void ServerThread::encrypted()
     {
-        log("SSL Socket entered encrypted state.");
+        QTWEBSERVER_LOG(*this, Log::Verbose, "SSL Socket entered encrypted state.");
     }
 
     void ServerThread::encryptedBytesWritten(qint64 bytes)
     {
-        log(QString("Encrypted bytes written: %1").arg(bytes));
+        QTWEBSERVER_LOG(*this, Log::Verbose, QString("Encrypted bytes written: %1").arg(bytes));
     }
 
 } // namespace Tcp
@@ -30,9 +30,15 @@
 #include "misc/threadsafety.h"
 
 // Qt includes
+#include <QAtomicInt>
+#include <QHash>
 #include <QList>
+#include <QMutex>
+#include <QQueue>
 #include <QSslError>
+#include <QHostAddress>
 #include <QSslSocket>
+#include <QTcpServer>
 #include <QThread>
 
 namespace QtWebServer {
@@ -47,6 +53,7 @@ namespace Tcp {
     class ServerThread : public QThread,
                          public Logger {
         friend class MultithreadedServer;
+        friend class ReusePortListener;
         Q_OBJECT
     public:
         /**
@@ -65,9 +72,26 @@ namespace Tcp {
          */
         NetworkServiceThreadState state();
 
+        /**
+         * @returns the number of connections this thread is serving, including
+         * connections that have been queued but not yet picked up.
+         */
+        int connectionCount() const;
+
+        /**
+         * Queues an accepted socket descriptor for this thread. The descriptor
+         * will be picked up asynchronously by this thread's event loop.
+         * @attention This method is threadsafe.
+         * @param socketDescriptor The descriptor of the accepted connection.
+         */
+        void enqueueConnection(qintptr socketDescriptor);
+
     private slots:
+        /** Takes all queued socket descriptors and handles them. */
+        void processPendingConnections();
+
         /** Handles a new incoming connection. */
-        void handleNewConnection(int socketHandle);
+        void handleNewConnection(qintptr socketHandle);
 
         /** Handles data from a client. */
         void clientDataAvailable();
@@ -97,6 +121,27 @@ namespace Tcp {
     private:
         ServerThread(MultithreadedServer& multithreadedServer);
 
+        /**
+         * Opens a listening socket with SO_REUSEPORT set in this thread, so
+         * this thread accepts connections on its own. Must be called from
+         * within this thread.
+         * @param address The server address.
+         * @param port The server port, or 0 for an arbitrary port.
+         * @returns the port listened on, or 0 on failure.
+         */
+        quint16 listenReusePort(const QHostAddress& address, quint16 port);
+
+        /** Takes over a connection this thread has accepted itself. */
+        void acceptConnection(qintptr socketDescriptor);
+
+        /**
+         * Closes the listener and all connections of this thread and hands
+         * this object over to the thread of the server, so it can be deleted
+         * there once the thread has finished. Must be called from within
+         * this thread.
+         */
+        void shutDown();
+
         /**
          * @brief setNetworkServiceThreadState
          * @param state
@@ -105,6 +150,15 @@ namespace Tcp {
 
         MultithreadedServer& m_multithreadedServer;
         ThreadGuard<NetworkServiceThreadState> m_networkServiceThreadState;
+
+        QAtomicInt m_connectionCount;
+        QQueue<qintptr> m_pendingSocketDescriptors;
+        QMutex m_pendingSocketDescriptorsMutex;
+
+        QTcpServer* m_reusePortListener;
+
+        /** State of the responder per connection, only accessed from this thread. */
+        QHash<QSslSocket*, ConnectionData*> m_connectionData;
     };
 
 } // namespace Tcp
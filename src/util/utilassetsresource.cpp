@@ -23,6 +23,7 @@
 
 // Own includes
 #include "utilassetsresource.h"
+#include "http/httpbyteranges.h"
 
 // Qt includes
 #include <QFile>
@@ -54,18 +55,20 @@ namespace Util {
     void AssetsResource::deliver(const Http::Request& request,
         Http::Response& response)
     {
-        QString id = uriParameters(request.uniqueResourceIdentifier()).value("id");
+        QString id = request.uriParameters().value("id");
 
         if (m_assetsPathMap.contains(id)) {
-            QFile assetFile(m_assetsPathMap.value(id));
-            assetFile.open(QFile::ReadOnly);
-            if (assetFile.isOpen()) {
-                QFileInfo fileInfo(assetFile);
-                response.setStatusCode(Http::Ok);
-                response.setHeader(Http::ContentType, m_mimeDatabase.mimeTypeForFile(fileInfo).name());
-                response.setBody(assetFile.readAll());
-                assetFile.close();
+            // The file is streamed to the client and deleted along with the
+            // connection, so it is never read into memory as a whole. Only
+            // the requested ranges are read, if the client asks for any.
+            QFile* assetFile = new QFile(m_assetsPathMap.value(id));
+            assetFile->open(QFile::ReadOnly);
+            if (assetFile->isOpen()) {
+                QFileInfo fileInfo(*assetFile);
+                Http::ByteRanges::deliverFile(request, response, assetFile,
+                    m_mimeDatabase.mimeTypeForFile(fileInfo).name());
             } else {
+                delete assetFile;
                 response.setStatusCode(Http::Forbidden);
                 response.setHeader(Http::ContentType, "text/plain");
             }
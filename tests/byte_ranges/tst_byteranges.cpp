@@ -0,0 +1,109 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "http/httpbyteranges.h"
+
+// Qt includes
+#include <QList>
+#include <QTest>
+
+using namespace QtWebServer;
+using namespace QtWebServer::Http;
+
+namespace {
+
+QByteArray rangesToString(const QList<ByteRange>& ranges)
+{
+    QList<QByteArray> parts;
+    for (const ByteRange& range : ranges) {
+        parts.append(QByteArray::number(range.first) + "-" + QByteArray::number(range.last));
+    }
+    return parts.join(',');
+}
+
+} // namespace
+
+class ByteRangesTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void parse_data();
+    void parse();
+};
+
+void ByteRangesTest::parse_data()
+{
+    QTest::addColumn<QByteArray>("value");
+    QTest::addColumn<qint64>("size");
+    QTest::addColumn<int>("result");
+    QTest::addColumn<QByteArray>("ranges");
+
+    QByteArray tooManyRanges("bytes=");
+    for (int i = 0; i < 33; i++) {
+        tooManyRanges += QByteArray::number(i * 2) + "-" + QByteArray::number(i * 2) + ",";
+    }
+
+    QTest::newRow("single") << QByteArray("bytes=0-4") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("0-4");
+    QTest::newRow("open end") << QByteArray("bytes=5-") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("5-9");
+    QTest::newRow("suffix") << QByteArray("bytes=-3") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("7-9");
+    QTest::newRow("suffix longer than file") << QByteArray("bytes=-20") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("0-9");
+    QTest::newRow("last beyond end") << QByteArray("bytes=8-100") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("8-9");
+    QTest::newRow("single byte") << QByteArray("bytes=9-9") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("9-9");
+    QTest::newRow("case and whitespace") << QByteArray(" Bytes = 1-2 ") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("1-2");
+    QTest::newRow("adjacent coalesced") << QByteArray("bytes=0-2,3-5") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("0-5");
+    QTest::newRow("overlapping sorted") << QByteArray("bytes=6-7,0-1,1-3") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("0-3,6-7");
+    QTest::newRow("empty elements") << QByteArray("bytes=0-1, ,4-5,") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("0-1,4-5");
+    QTest::newRow("one unsatisfiable") << QByteArray("bytes=20-30,0-0") << qint64(10) << int(ByteRanges::Satisfiable) << QByteArray("0-0");
+    QTest::newRow("first at end") << QByteArray("bytes=10-") << qint64(10) << int(ByteRanges::NotSatisfiable) << QByteArray();
+    QTest::newRow("empty suffix") << QByteArray("bytes=-0") << qint64(10) << int(ByteRanges::NotSatisfiable) << QByteArray();
+    QTest::newRow("empty file") << QByteArray("bytes=0-") << qint64(0) << int(ByteRanges::NotSatisfiable) << QByteArray();
+    QTest::newRow("suffix of empty file") << QByteArray("bytes=-5") << qint64(0) << int(ByteRanges::NotSatisfiable) << QByteArray();
+    QTest::newRow("reversed") << QByteArray("bytes=5-2") << qint64(10) << int(ByteRanges::Invalid) << QByteArray();
+    QTest::newRow("no dash") << QByteArray("bytes=5") << qint64(10) << int(ByteRanges::Invalid) << QByteArray();
+    QTest::newRow("no ranges") << QByteArray("bytes=") << qint64(10) << int(ByteRanges::Invalid) << QByteArray();
+    QTest::newRow("other unit") << QByteArray("items=0-1") << qint64(10) << int(ByteRanges::Invalid) << QByteArray();
+    QTest::newRow("no unit") << QByteArray("0-1") << qint64(10) << int(ByteRanges::Invalid) << QByteArray();
+    QTest::newRow("not a number") << QByteArray("bytes=a-b") << qint64(10) << int(ByteRanges::Invalid) << QByteArray();
+    QTest::newRow("negative suffix") << QByteArray("bytes=--1") << qint64(10) << int(ByteRanges::Invalid) << QByteArray();
+    QTest::newRow("overflow") << QByteArray("bytes=1234567890123456789-") << qint64(10) << int(ByteRanges::Invalid) << QByteArray();
+    QTest::newRow("too many ranges") << tooManyRanges << qint64(100) << int(ByteRanges::Invalid) << QByteArray();
+}
+
+void ByteRangesTest::parse()
+{
+    QFETCH(QByteArray, value);
+    QFETCH(qint64, size);
+    QFETCH(int, result);
+    QFETCH(QByteArray, ranges);
+
+    QList<ByteRange> parsedRanges;
+    QCOMPARE(int(ByteRanges::parse(value, size, parsedRanges)), result);
+    if (result == ByteRanges::Satisfiable) {
+        QCOMPARE(rangesToString(parsedRanges), ranges);
+    }
+}
+
+QTEST_APPLESS_MAIN(ByteRangesTest)
+
+#include "tst_byteranges.moc"
@@ -0,0 +1,145 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "sql/sqlconnectionpool.h"
+
+// Qt includes
+#include <QSemaphore>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTest>
+#include <QThread>
+
+// Standard includes
+#include <atomic>
+
+using namespace QtWebServer;
+using namespace QtWebServer::Sql;
+
+namespace {
+
+/**
+ * Runs a query with the deprecated ConnectionPool::exec() in a thread of
+ * its own, which keeps the query until it is told to finish.
+ */
+class QueryThread {
+public:
+    QueryThread()
+        : m_active(false)
+    {
+        m_thread = QThread::create([this]() {
+            QSqlQuery query = ConnectionPool::instance().exec("SELECT 1");
+            m_active = query.isActive();
+            m_executed.release();
+            m_finish.acquire();
+        });
+        m_thread->start();
+        m_executed.acquire();
+    }
+
+    ~QueryThread()
+    {
+        finish();
+        delete m_thread;
+    }
+
+    /** @returns true, if the thread has got a connection for its query. */
+    bool isActive() const
+    {
+        return m_active;
+    }
+
+    /** Lets the thread finish, which releases its connection. */
+    void finish()
+    {
+        if (m_thread->isRunning()) {
+            m_finish.release();
+            m_thread->wait();
+        }
+    }
+
+private:
+    QThread* m_thread;
+    QSemaphore m_executed;
+    QSemaphore m_finish;
+    std::atomic<bool> m_active;
+};
+
+} // namespace
+
+class ConnectionPoolTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void threadLeasesAreLimitedByCount();
+};
+
+void ConnectionPoolTest::initTestCase()
+{
+    if (!QSqlDatabase::drivers().contains("QSQLITE")) {
+        QSKIP("The SQLite driver is not available.");
+    }
+
+    ConnectionPool& pool = ConnectionPool::instance();
+    pool.setDriverName("QSQLITE");
+    pool.setDatabaseName(":memory:");
+    pool.resize(2);
+    QVERIFY(pool.open());
+}
+
+void ConnectionPoolTest::cleanupTestCase()
+{
+    ConnectionPool::instance().close();
+}
+
+void ConnectionPoolTest::threadLeasesAreLimitedByCount()
+{
+    ConnectionPool& pool = ConnectionPool::instance();
+    pool.setWaitTimeoutMilliseconds(100);
+
+    // Every thread using exec() keeps a connection until it finishes.
+    QueryThread first;
+    QueryThread second;
+    QVERIFY(first.isActive());
+    QVERIFY(second.isActive());
+    QCOMPARE(pool.leasedCount(), 2);
+
+    {
+        QueryThread third;
+        QVERIFY(!third.isActive());
+    }
+
+    // The connection is released once the thread has finished, which may
+    // only happen after wait() has returned.
+    pool.setWaitTimeoutMilliseconds(5000);
+    first.finish();
+    QueryThread fourth;
+    QVERIFY(fourth.isActive());
+}
+
+QTEST_GUILESS_MAIN(ConnectionPoolTest)
+
+#include "tst_connectionpool.moc"
@@ -0,0 +1,285 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "http/httprequestparser.h"
+
+// Qt includes
+#include <QList>
+#include <QTest>
+
+using namespace QtWebServer;
+using namespace QtWebServer::Http;
+
+namespace {
+
+QByteArray request(const QByteArray& headerLines, const QByteArray& body = QByteArray())
+{
+    return "POST /upload HTTP/1.1\r\nHost: example.com\r\n" + headerLines + "\r\n" + body;
+}
+
+/** Feeds the data and takes every request that is complete. */
+RequestParser::Result parseRequests(RequestParser& parser, const QByteArray& data, QList<Request>& requests)
+{
+    parser.feed(data);
+    RequestParser::Result result;
+    while ((result = parser.parse()) == RequestParser::Complete) {
+        requests.append(parser.takeRequest());
+    }
+    return result;
+}
+
+} // namespace
+
+class RequestParserTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void contentLength_data();
+    void contentLength();
+    void conflictingContentLengths();
+    void transferEncoding_data();
+    void transferEncoding();
+    void chunkedTrailers();
+    void malformedHeaderLines_data();
+    void malformedHeaderLines();
+    void maxBodySize();
+    void pipelinedRequestsSplitAtEveryByte();
+};
+
+void RequestParserTest::contentLength_data()
+{
+    QTest::addColumn<QByteArray>("contentLength");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("digits") << QByteArray("5") << true;
+    QTest::newRow("leading zeros") << QByteArray("005") << true;
+    QTest::newRow("empty") << QByteArray("") << false;
+    QTest::newRow("letters") << QByteArray("abc") << false;
+    QTest::newRow("trailing letter") << QByteArray("5a") << false;
+    QTest::newRow("negative") << QByteArray("-5") << false;
+    QTest::newRow("plus sign") << QByteArray("+5") << false;
+    QTest::newRow("inner space") << QByteArray("5 5") << false;
+    QTest::newRow("list") << QByteArray("5, 5") << false;
+    QTest::newRow("hexadecimal") << QByteArray("0x5") << false;
+    QTest::newRow("too many digits") << QByteArray("1234567890123456789") << false;
+}
+
+void RequestParserTest::contentLength()
+{
+    QFETCH(QByteArray, contentLength);
+    QFETCH(bool, valid);
+
+    RequestParser parser;
+    QList<Request> requests;
+    RequestParser::Result result = parseRequests(parser,
+        request("Content-Length: " + contentLength + "\r\n", "hello"), requests);
+
+    if (valid) {
+        QCOMPARE(requests.size(), 1);
+        QCOMPARE(requests.first().body(), QByteArray("hello"));
+        QCOMPARE(result, RequestParser::NeedMoreData);
+    } else {
+        QVERIFY(requests.isEmpty());
+        QCOMPARE(result, RequestParser::Error);
+    }
+}
+
+void RequestParserTest::conflictingContentLengths()
+{
+    RequestParser parser;
+    QList<Request> requests;
+    QCOMPARE(parseRequests(parser, request("Content-Length: 5\r\nContent-Length: 6\r\n", "hello!"), requests),
+        RequestParser::Error);
+    QVERIFY(requests.isEmpty());
+
+    // Repeating the same length is harmless.
+    RequestParser repeatedParser;
+    QCOMPARE(parseRequests(repeatedParser, request("Content-Length: 5\r\nContent-Length:  5\r\n", "hello"), requests),
+        RequestParser::NeedMoreData);
+    QCOMPARE(requests.size(), 1);
+    QCOMPARE(requests.first().body(), QByteArray("hello"));
+}
+
+void RequestParserTest::transferEncoding_data()
+{
+    QTest::addColumn<QByteArray>("transferEncoding");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("chunked") << QByteArray("chunked") << true;
+    QTest::newRow("upper case") << QByteArray("CHUNKED") << true;
+    QTest::newRow("chunked last") << QByteArray("gzip, chunked") << true;
+    QTest::newRow("no space") << QByteArray("gzip,chunked") << true;
+    QTest::newRow("tab") << QByteArray("gzip,\tchunked") << true;
+    QTest::newRow("not chunked") << QByteArray("gzip") << false;
+    QTest::newRow("chunked not last") << QByteArray("chunked, gzip") << false;
+    QTest::newRow("no token boundary") << QByteArray("xchunked") << false;
+    QTest::newRow("no token boundary in list") << QByteArray("gzip, xchunked") << false;
+}
+
+void RequestParserTest::transferEncoding()
+{
+    QFETCH(QByteArray, transferEncoding);
+    QFETCH(bool, valid);
+
+    // A Content-Length next to Transfer-Encoding is ignored.
+    RequestParser parser;
+    QList<Request> requests;
+    RequestParser::Result result = parseRequests(parser,
+        request("Transfer-Encoding: " + transferEncoding + "\r\nContent-Length: 3\r\n",
+            "5\r\nhello\r\n0\r\n\r\n"),
+        requests);
+
+    if (valid) {
+        QCOMPARE(requests.size(), 1);
+        QCOMPARE(requests.first().body(), QByteArray("hello"));
+        QCOMPARE(result, RequestParser::NeedMoreData);
+    } else {
+        QVERIFY(requests.isEmpty());
+        QCOMPARE(result, RequestParser::Error);
+    }
+}
+
+void RequestParserTest::chunkedTrailers()
+{
+    RequestParser parser;
+    QList<Request> requests;
+    parseRequests(parser,
+        request("Transfer-Encoding: chunked\r\nAuthorization: Basic dXNlcjpwYXNz\r\n",
+            "5\r\nhello\r\n0\r\n"
+            "X-Checksum: 5d41402a\r\n"
+            "Content-Length: 100\r\n"
+            "Host: attacker.example\r\n"
+            "Authorization: Basic YWRtaW46YWRtaW4=\r\n"
+            "Transfer-Encoding: identity\r\n"
+            "Proxy-Connection: close\r\n"
+            "Keep-Alive: timeout=5\r\n"
+            "\r\n"),
+        requests);
+
+    QCOMPARE(requests.size(), 1);
+    const Request& chunkedRequest = requests.first();
+    QCOMPARE(chunkedRequest.body(), QByteArray("hello"));
+    QCOMPARE(chunkedRequest.rawHeader(QByteArrayView("X-Checksum")).toByteArray(), QByteArray("5d41402a"));
+
+    // Fields that must not come from a trailer are dropped.
+    QVERIFY(!chunkedRequest.headerFields().contains(ContentLength));
+    QCOMPARE(chunkedRequest.rawHeader(Host).toByteArray(), QByteArray("example.com"));
+    QCOMPARE(chunkedRequest.rawHeader(Authorization).toByteArray(), QByteArray("Basic dXNlcjpwYXNz"));
+    QCOMPARE(chunkedRequest.rawHeader(TransferEncoding).toByteArray(), QByteArray("chunked"));
+    QVERIFY(!chunkedRequest.headerFields().contains(QByteArrayView("Proxy-Connection")));
+    QVERIFY(!chunkedRequest.headerFields().contains(QByteArrayView("Keep-Alive")));
+    QVERIFY(chunkedRequest.isChunked());
+}
+
+void RequestParserTest::malformedHeaderLines_data()
+{
+    QTest::addColumn<QByteArray>("headerLines");
+
+    QTest::newRow("space before colon") << QByteArray("Content-Length : 5\r\n");
+    QTest::newRow("tab before colon") << QByteArray("Transfer-Encoding\t: chunked\r\n");
+    QTest::newRow("space in name") << QByteArray("Content Length: 5\r\n");
+    QTest::newRow("no colon") << QByteArray("Content-Length 5\r\n");
+    QTest::newRow("empty name") << QByteArray(": 5\r\n");
+    QTest::newRow("obsolete line folding") << QByteArray("X-Folded: a\r\n b\r\n");
+    QTest::newRow("non-token character") << QByteArray("X-Na\"me: a\r\n");
+}
+
+void RequestParserTest::malformedHeaderLines()
+{
+    QFETCH(QByteArray, headerLines);
+
+    // Smuggling relies on a field being understood differently by two
+    // parsers, so every field has to be understood or refused.
+    RequestParser parser;
+    QList<Request> requests;
+    QCOMPARE(parseRequests(parser, request(headerLines, "hello"), requests), RequestParser::Error);
+    QVERIFY(requests.isEmpty());
+}
+
+void RequestParserTest::maxBodySize()
+{
+    QList<Request> requests;
+
+    RequestParser announcedParser;
+    announcedParser.setMaxBodySize(4);
+    QCOMPARE(parseRequests(announcedParser, request("Content-Length: 5\r\n"), requests), RequestParser::Error);
+
+    // The limit is checked before the body is buffered.
+    RequestParser hugeParser;
+    QCOMPARE(parseRequests(hugeParser, request("Content-Length: 999999999999\r\n"), requests), RequestParser::Error);
+
+    RequestParser chunkedParser;
+    chunkedParser.setMaxBodySize(4);
+    QCOMPARE(parseRequests(chunkedParser, request("Transfer-Encoding: chunked\r\n", "3\r\nabc\r\n2\r\nde\r\n"), requests),
+        RequestParser::Error);
+    QVERIFY(requests.isEmpty());
+
+    RequestParser limitParser;
+    limitParser.setMaxBodySize(5);
+    QCOMPARE(parseRequests(limitParser, request("Content-Length: 5\r\n", "hello"), requests), RequestParser::NeedMoreData);
+    QCOMPARE(requests.size(), 1);
+}
+
+void RequestParserTest::pipelinedRequestsSplitAtEveryByte()
+{
+    QByteArray data = QByteArray("GET /first HTTP/1.1\r\nHost: example.com\r\n\r\n")
+        + "POST /second HTTP/1.1\r\nHost: example.com\r\nContent-Length: 5\r\n\r\nhello"
+        + "POST /third HTTP/1.1\r\nHost: example.com\r\nTransfer-Encoding: chunked\r\n\r\n"
+          "3\r\nfoo\r\n4\r\nbar!\r\n0\r\nX-Trailer: yes\r\n\r\n"
+        + "GET /fourth HTTP/1.0\r\n\r\n";
+
+    for (int split = 0; split <= data.size(); split++) {
+        RequestParser parser;
+        QList<Request> requests;
+        QCOMPARE(parseRequests(parser, data.left(split), requests), RequestParser::NeedMoreData);
+        QCOMPARE(parseRequests(parser, data.mid(split), requests), RequestParser::NeedMoreData);
+
+        QCOMPARE(requests.size(), 4);
+        QCOMPARE(requests.at(0).method(), GET);
+        QCOMPARE(requests.at(0).uniqueResourceIdentifier(), QString("/first"));
+        QVERIFY(requests.at(0).body().isEmpty());
+        QCOMPARE(requests.at(1).method(), POST);
+        QCOMPARE(requests.at(1).uniqueResourceIdentifier(), QString("/second"));
+        QCOMPARE(requests.at(1).body(), QByteArray("hello"));
+        QCOMPARE(requests.at(2).uniqueResourceIdentifier(), QString("/third"));
+        QCOMPARE(requests.at(2).body(), QByteArray("foobar!"));
+        QCOMPARE(requests.at(2).rawHeader(QByteArrayView("X-Trailer")).toByteArray(), QByteArray("yes"));
+        QCOMPARE(requests.at(3).uniqueResourceIdentifier(), QString("/fourth"));
+        QVERIFY(requests.at(3).rawHeader(Host).isEmpty());
+        QVERIFY(parser.isEmpty());
+    }
+
+    // Byte by byte, every state has to resume where it stopped.
+    RequestParser parser;
+    QList<Request> requests;
+    for (char c : data) {
+        QCOMPARE(parseRequests(parser, QByteArray(1, c), requests), RequestParser::NeedMoreData);
+    }
+    QCOMPARE(requests.size(), 4);
+    QCOMPARE(requests.at(2).body(), QByteArray("foobar!"));
+}
+
+QTEST_APPLESS_MAIN(RequestParserTest)
+
+#include "tst_requestparser.moc"
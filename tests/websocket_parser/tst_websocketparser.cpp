@@ -0,0 +1,203 @@
+//
+// Copyright 2010-2015 Jacob Dawid <jacob@omg-it.works>
+//
+// This file is part of QtWebServer.
+//
+// QtWebServer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// QtWebServer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with QtWebServer.
+// If not, see <http://www.gnu.org/licenses/>.
+//
+// It is possible to obtain a commercial license of QtWebServer.
+// Please contact Jacob Dawid <jacob@omg-it.works>
+//
+
+// Own includes
+#include "http/httpwebsocketparser.h"
+
+// Qt includes
+#include <QList>
+#include <QTest>
+
+using namespace QtWebServer;
+using namespace QtWebServer::Http;
+
+namespace {
+
+/** Builds a client frame, which is always masked unless told otherwise. */
+QByteArray frame(bool finalFrame, int opcode, const QByteArray& payload, bool masked = true)
+{
+    const char mask[] = { 0x37, char(0xfa), 0x21, 0x3d };
+    QByteArray frame;
+    frame.append(char((finalFrame ? 0x80 : 0x00) | opcode));
+    char maskBit = masked ? char(0x80) : char(0x00);
+    if (payload.size() < 126) {
+        frame.append(char(maskBit | payload.size()));
+    } else if (payload.size() < 0x10000) {
+        frame.append(char(maskBit | 126));
+        frame.append(char(payload.size() >> 8));
+        frame.append(char(payload.size() & 0xff));
+    } else {
+        frame.append(char(maskBit | 127));
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame.append(char((quint64(payload.size()) >> shift) & 0xff));
+        }
+    }
+    if (!masked) {
+        return frame + payload;
+    }
+    frame.append(mask, 4);
+    for (int i = 0; i < payload.size(); i++) {
+        frame.append(char(payload.at(i) ^ mask[i % 4]));
+    }
+    return frame;
+}
+
+} // namespace
+
+class WebSocketParserTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void fragmentedMessage();
+    void extendedLengthSplitAtEveryByte();
+    void protocolErrors_data();
+    void protocolErrors();
+    void messageTooBig();
+};
+
+void WebSocketParserTest::fragmentedMessage()
+{
+    // A ping may arrive between the fragments of a message.
+    QByteArray data = frame(false, WebSocketParser::TextFrame, "Hel")
+        + frame(true, WebSocketParser::PingFrame, "ping")
+        + frame(false, WebSocketParser::ContinuationFrame, "")
+        + frame(true, WebSocketParser::ContinuationFrame, "lo")
+        + frame(true, WebSocketParser::BinaryFrame, QByteArray("\x00\xff", 2));
+
+    WebSocketParser parser;
+    parser.feed(data);
+
+    WebSocketParser::Opcode opcode;
+    QByteArray payload;
+    QCOMPARE(parser.parse(opcode, payload), WebSocketParser::Complete);
+    QCOMPARE(opcode, WebSocketParser::PingFrame);
+    QCOMPARE(payload, QByteArray("ping"));
+
+    QCOMPARE(parser.parse(opcode, payload), WebSocketParser::Complete);
+    QCOMPARE(opcode, WebSocketParser::TextFrame);
+    QCOMPARE(payload, QByteArray("Hello"));
+
+    QCOMPARE(parser.parse(opcode, payload), WebSocketParser::Complete);
+    QCOMPARE(opcode, WebSocketParser::BinaryFrame);
+    QCOMPARE(payload, QByteArray("\x00\xff", 2));
+
+    QCOMPARE(parser.parse(opcode, payload), WebSocketParser::NeedMoreData);
+}
+
+void WebSocketParserTest::extendedLengthSplitAtEveryByte()
+{
+    // Long enough for a 16 bit length and for the vectorized unmasking.
+    QByteArray longPayload;
+    for (int i = 0; i < 300; i++) {
+        longPayload.append(char('a' + i % 26));
+    }
+    QByteArray data = frame(false, WebSocketParser::BinaryFrame, longPayload.left(100))
+        + frame(true, WebSocketParser::ContinuationFrame, longPayload.mid(100))
+        + frame(true, WebSocketParser::CloseFrame, QByteArray("\x03\xe8", 2));
+
+    for (int split = 0; split <= data.size(); split++) {
+        WebSocketParser parser;
+        QList<QByteArray> payloads;
+        WebSocketParser::Opcode opcode;
+        QByteArray payload;
+        for (const QByteArray& part : { data.left(split), data.mid(split) }) {
+            parser.feed(part);
+            WebSocketParser::Result result;
+            while ((result = parser.parse(opcode, payload)) == WebSocketParser::Complete) {
+                payloads.append(payload);
+            }
+            QCOMPARE(result, WebSocketParser::NeedMoreData);
+        }
+
+        QCOMPARE(payloads.size(), 2);
+        QCOMPARE(payloads.at(0), longPayload);
+        QCOMPARE(payloads.at(1), QByteArray("\x03\xe8", 2));
+        QCOMPARE(opcode, WebSocketParser::CloseFrame);
+    }
+}
+
+void WebSocketParserTest::protocolErrors_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("unmasked") << frame(true, WebSocketParser::TextFrame, "hello", false);
+    QTest::newRow("continuation without message") << frame(true, WebSocketParser::ContinuationFrame, "hello");
+    QTest::newRow("message inside message") << frame(false, WebSocketParser::TextFrame, "he")
+                                            + frame(true, WebSocketParser::TextFrame, "llo");
+    QTest::newRow("fragmented control frame") << frame(false, WebSocketParser::PingFrame, "ping");
+    QTest::newRow("long control frame") << frame(true, WebSocketParser::PingFrame, QByteArray(126, 'p'));
+    QTest::newRow("reserved opcode") << frame(true, 0x3, "hello");
+    QTest::newRow("reserved control opcode") << frame(true, 0xb, "hello");
+
+    QByteArray reservedBit = frame(true, WebSocketParser::TextFrame, "hello");
+    reservedBit[0] = char(reservedBit.at(0) | 0x40);
+    QTest::newRow("reserved bit") << reservedBit;
+}
+
+void WebSocketParserTest::protocolErrors()
+{
+    QFETCH(QByteArray, data);
+
+    WebSocketParser parser;
+    parser.feed(data);
+
+    WebSocketParser::Opcode opcode;
+    QByteArray payload;
+    QCOMPARE(parser.parse(opcode, payload), WebSocketParser::Error);
+    QCOMPARE(parser.closeCode(), ProtocolError);
+
+    // The parser stays failed.
+    parser.feed(frame(true, WebSocketParser::TextFrame, "hello"));
+    QCOMPARE(parser.parse(opcode, payload), WebSocketParser::Error);
+}
+
+void WebSocketParserTest::messageTooBig()
+{
+    WebSocketParser::Opcode opcode;
+    QByteArray payload;
+
+    WebSocketParser singleFrameParser;
+    singleFrameParser.setMaxMessageSize(4);
+    singleFrameParser.feed(frame(true, WebSocketParser::TextFrame, "hello"));
+    QCOMPARE(singleFrameParser.parse(opcode, payload), WebSocketParser::Error);
+    QCOMPARE(singleFrameParser.closeCode(), MessageTooBig);
+
+    // Fragmented messages are limited as a whole.
+    WebSocketParser fragmentedParser;
+    fragmentedParser.setMaxMessageSize(4);
+    fragmentedParser.feed(frame(false, WebSocketParser::TextFrame, "hel"));
+    fragmentedParser.feed(frame(true, WebSocketParser::ContinuationFrame, "lo"));
+    QCOMPARE(fragmentedParser.parse(opcode, payload), WebSocketParser::Error);
+    QCOMPARE(fragmentedParser.closeCode(), MessageTooBig);
+
+    // Control frames do not count against the limit.
+    WebSocketParser controlParser;
+    controlParser.setMaxMessageSize(4);
+    controlParser.feed(frame(true, WebSocketParser::PingFrame, "hello"));
+    QCOMPARE(controlParser.parse(opcode, payload), WebSocketParser::Complete);
+    QCOMPARE(payload, QByteArray("hello"));
+}
+
+QTEST_APPLESS_MAIN(WebSocketParserTest)
+
+#include "tst_websocketparser.moc"